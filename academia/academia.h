@@ -12,6 +12,7 @@
 #include <fcntl.h>
 #include <semaphore.h>
 #include <errno.h>
+#include "arena.h"
 
 #define PORT 8080
 #define MAX_CLIENTS 10
@@ -20,6 +21,11 @@
 #define MAX_NAME 50
 #define MAX_PASS 50
 #define MAX_ID 10
+#define STORAGE_WORKERS 4
+#define REQUEST_QUEUE_SIZE 256
+#define ENROLL_BATCH_MAX 32     // Enroll/drop requests applied to one course with a single write
+#define DEFAULT_LOCK_TIMEOUT_MS 2000   // Longest wait of an operation for its file locks
+#define CATALOG_VERSION_MAX 40         // Catalog version string, terminator included
 
 // Error codes
 #define ERR_NONE 0
@@ -29,10 +35,43 @@
 #define ERR_NOT_ENROLLED -4
 #define ERR_INVALID_INPUT -5
 #define ERR_COURSE_NOT_FOUND -6
+#define ERR_LOCK_TIMEOUT -7     // The file locks were not free in time; the operation did nothing and may be retried
+#define ERR_NOT_MODIFIED -8     // Not an error: the course listing is still the version the client holds
 
 // User roles
 enum Role { ADMIN, STUDENT, FACULTY };
 
+// Request opcodes: storage operations handed to the storage workers, plus
+// session-level opcodes of the binary protocol (see protocol.h)
+enum Opcode {
+    OP_AUTHENTICATE = 1,
+    OP_ADD_STUDENT,
+    OP_VIEW_ALL_STUDENTS,
+    OP_ADD_FACULTY,
+    OP_VIEW_ALL_FACULTY,
+    OP_ACTIVATE_STUDENT,
+    OP_BLOCK_STUDENT,
+    OP_UPDATE_STUDENT,
+    OP_UPDATE_FACULTY,
+    OP_VIEW_ALL_COURSES,
+    OP_ENROLL_COURSE,
+    OP_DROP_COURSE,
+    OP_VIEW_ENROLLED_COURSES,
+    OP_CHANGE_PASSWORD,
+    OP_VIEW_FACULTY_COURSES,
+    OP_ADD_COURSE,
+    OP_REMOVE_COURSE,
+    OP_UPDATE_COURSE,
+    OP_HELLO,
+    OP_LOGOUT,
+    OP_GET_MENU,
+    OP_VIEW_METRICS,
+    OP_RESUME,
+    OP_SUBSCRIBE,
+    OP_UNSUBSCRIBE,
+    OP_SEAT_EVENT
+};
+
 // User structure
 typedef struct {
     char id[MAX_ID];
@@ -64,10 +103,18 @@ typedef struct {
     char name[MAX_NAME];
 } Faculty;
 
+// One enroll or drop in a batch of changes to the same course
+typedef struct {
+    char student_id[MAX_ID];
+    int enroll;             // 1 to enroll, 0 to drop
+    int result;             // Set by apply_enrollments: 0, the ERR_* code for this change, or -1 if not written
+} EnrollmentChange;
+
 // Utility functions
 int validate_id(const char *id);
 int validate_name(const char *name);
 int validate_password(const char *password);
+int validate_seats(int seats);
 int validate_number(const char *input, int min, int max);
 
 // Server functions
@@ -77,7 +124,12 @@ void serve_admin(int client_socket, char *user_id);
 void serve_student(int client_socket, char *user_id);
 void serve_faculty(int client_socket, char *user_id);
 
-// File operation functions
+// File operation functions. Every operation gives up on its locks after the
+// lock timeout (0: never) and returns ERR_LOCK_TIMEOUT; listings return NULL
+// then. Listings report how they went in *status: 0, ERR_LOCK_TIMEOUT, or -1
+// for any other failure.
+void set_lock_timeout(int ms);
+int check_credentials(char *user_id, char *password, enum Role role);
 int read_lock(int fd);
 int write_lock(int fd);
 int unlock(int fd);
@@ -90,14 +142,30 @@ int update_faculty(char *id, char *new_name);
 int add_course(char *id, char *name, char *faculty_id, int seats);
 int update_course(char *id, char *new_name, int new_seats);
 int remove_course(char *id);
-int enroll_course(char *student_id, char *course_id);
-int unenroll_course(char *student_id, char *course_id);
-char *view_enrolled_courses(char *student_id);
-char *view_course_enrollments(char *course_id);
-char *view_all_courses();
-char *view_faculty_courses(char *faculty_id);
-char *view_all_students();
-char *view_all_faculty();
+int apply_enrollments(char *course_id, EnrollmentChange *changes, int count);
+// Listings are rendered into arena (arena.h) and live until its next reset
+char *view_enrolled_courses(char *student_id, Arena *arena, int *status);
+char *view_course_enrollments(char *course_id, Arena *arena, int *status);
+char *view_all_courses(Arena *arena, int *status);
+char *view_faculty_courses(char *faculty_id, Arena *arena, int *status);
+// Course listings as cached, pre-framed memfds (listing_cache.h): the fd to
+// send and close, with the text length in *len; or -1 with the rendered text
+// (NULL on error) in *text when the listing could not be cached. version
+// (CATALOG_VERSION_MAX bytes) receives the catalog version the listing shows.
+int view_all_courses_listing(size_t *len, char **text, char *version, Arena *arena, int *status);
+int view_faculty_courses_listing(char *faculty_id, size_t *len, char **text, char *version, Arena *arena,
+                                 int *status);
+// Whether a catalog version handed out with a listing is still current
+int catalog_unchanged(const char *version);
+// While another process shares courses.dat no version is current; ending
+// the sharing moves the generation past every version handed out meanwhile
+void catalog_set_shared(int shared);
+// Called, with the locks released, after a change freed seats in a course
+// or changed its total seats
+typedef void (*SeatListener)(const char *course_id, int free_seats, int total_seats);
+void set_seat_listener(SeatListener listener);
+char *view_all_students(Arena *arena, int *status);
+char *view_all_faculty(Arena *arena, int *status);
 int change_password(char *user_id, char *new_password);
 void initial_setup();
 
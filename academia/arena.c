@@ -0,0 +1,190 @@
+#include "arena.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN sizeof(void *)
+#define STRBUF_MIN_CLAIM 256   // A builder starts a new chunk rather than begin in less room
+
+static pthread_key_t arena_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static _Thread_local Arena thread_arena;   // Zeroed: an empty arena
+static _Thread_local int thread_arena_registered;
+
+static size_t align_up(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+void arena_init(Arena *arena) {
+    arena->first = arena->current = NULL;
+}
+
+void arena_free(Arena *arena) {
+    ArenaChunk *chunk = arena->first;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena_init(arena);
+}
+
+void arena_reset(Arena *arena) {
+    size_t kept = 0;
+    ArenaChunk **link = &arena->first;
+    while (*link) {
+        ArenaChunk *chunk = *link;
+        if (kept + chunk->cap > ARENA_RETAIN) {
+            *link = chunk->next;
+            free(chunk);
+            continue;
+        }
+        kept += chunk->cap;
+        chunk->used = 0;
+        link = &chunk->next;
+    }
+    arena->current = arena->first;
+}
+
+// Make the first chunk from current on with size bytes free the current one,
+// appending a new chunk when none has room
+static ArenaChunk *chunk_with_room(Arena *arena, size_t size) {
+    ArenaChunk *chunk = arena->current;
+    while (chunk && chunk->cap - chunk->used < size && chunk->next) chunk = chunk->next;
+    if (chunk && chunk->cap - chunk->used >= size) {
+        arena->current = chunk;
+        return chunk;
+    }
+
+    size_t cap = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+    ArenaChunk *fresh = malloc(sizeof(ArenaChunk) + cap);
+    if (!fresh) return NULL;
+    fresh->next = NULL;
+    fresh->cap = cap;
+    fresh->used = 0;
+    // chunk is the last one here, or NULL for an empty arena
+    if (chunk) {
+        chunk->next = fresh;
+    } else {
+        arena->first = fresh;
+    }
+    arena->current = fresh;
+    return fresh;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size = align_up(size ? size : 1);
+    ArenaChunk *chunk = chunk_with_room(arena, size);
+    if (!chunk) return NULL;
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+char *arena_strndup(Arena *arena, const char *str, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static void thread_arena_release(void *arg) {
+    arena_free(arg);
+}
+
+static void make_key(void) {
+    pthread_key_create(&arena_key, thread_arena_release);
+}
+
+Arena *arena_thread(void) {
+    if (!thread_arena_registered) {
+        pthread_once(&key_once, make_key);
+        pthread_setspecific(arena_key, &thread_arena);
+        thread_arena_registered = 1;
+    }
+    return &thread_arena;
+}
+
+// The builder claims all free space of a chunk and returns what it did not
+// use in strbuf_end
+static void claim(StrBuf *buf, ArenaChunk *chunk) {
+    buf->chunk = chunk;
+    buf->data = chunk->data + chunk->used;
+    buf->cap = chunk->cap - chunk->used;
+    chunk->used = chunk->cap;
+}
+
+void strbuf_begin(StrBuf *buf, Arena *arena) {
+    buf->arena = arena;
+    buf->len = 0;
+    buf->failed = 0;
+    ArenaChunk *chunk = chunk_with_room(arena, STRBUF_MIN_CLAIM);
+    if (!chunk) {
+        buf->failed = 1;
+        buf->chunk = NULL;
+        buf->data = NULL;
+        buf->cap = 0;
+        return;
+    }
+    claim(buf, chunk);
+    buf->data[0] = '\0';
+}
+
+// Room for extra more bytes and the NUL, moving the text to a larger chunk if needed
+static int reserve(StrBuf *buf, size_t extra) {
+    if (buf->failed) return -1;
+    if (buf->len + extra < buf->cap) return 0;
+    size_t cap = buf->cap * 2;
+    while (cap <= buf->len + extra) cap *= 2;
+    ArenaChunk *chunk = chunk_with_room(buf->arena, cap);
+    if (!chunk) {
+        buf->failed = 1;
+        return -1;
+    }
+    char *old = buf->data;
+    claim(buf, chunk);
+    memcpy(buf->data, old, buf->len);
+    return 0;
+}
+
+void strbuf_append(StrBuf *buf, const char *str, size_t len) {
+    if (reserve(buf, len) < 0) return;
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+
+void strbuf_puts(StrBuf *buf, const char *str) {
+    strbuf_append(buf, str, strlen(str));
+}
+
+void strbuf_printf(StrBuf *buf, const char *fmt, ...) {
+    if (buf->failed) return;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        buf->failed = 1;
+        return;
+    }
+    // Formatted in place; only a row that does not fit is formatted again
+    if ((size_t)n >= buf->cap - buf->len) {
+        if (reserve(buf, n) < 0) return;
+        va_start(args, fmt);
+        vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+        va_end(args);
+    }
+    buf->len += n;
+}
+
+char *strbuf_end(StrBuf *buf, size_t *len) {
+    if (buf->failed) return NULL;
+    size_t used = align_up(buf->data - buf->chunk->data + buf->len + 1);
+    buf->chunk->used = used < buf->chunk->cap ? used : buf->chunk->cap;
+    if (len) *len = buf->len;
+    return buf->data;
+}
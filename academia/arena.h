@@ -0,0 +1,58 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator and string builder for response text.
+//
+// Allocations come from chunks that survive arena_reset(), so a thread
+// rendering one response after another stops calling malloc once its arena
+// has grown to fit the largest one. Everything is released at once by the
+// reset, after the response has been encoded. Each thread has its own arena
+// (arena_thread()); the storage worker that renders a reply also encodes it,
+// so the text never leaves the thread that allocated it.
+
+#define ARENA_CHUNK_SIZE (16 * 1024)
+#define ARENA_RETAIN (256 * 1024)   // Chunk bytes kept by a reset; the rest is freed
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t cap, used;
+    char data[];
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk *first;
+    ArenaChunk *current;   // Chunks after it are empty
+} Arena;
+
+void arena_init(Arena *arena);
+void arena_free(Arena *arena);
+// Make all memory reusable; keeps up to ARENA_RETAIN bytes of chunks
+void arena_reset(Arena *arena);
+void *arena_alloc(Arena *arena, size_t size);
+char *arena_strndup(Arena *arena, const char *str, size_t len);
+
+// The calling thread's arena, freed when the thread exits
+Arena *arena_thread(void);
+
+// Text appended in place at the end of an arena: rows are formatted straight
+// into it and the length is tracked, so nothing is copied or rescanned until
+// the builder outgrows its chunk. Nothing else may allocate from the arena
+// between strbuf_begin and strbuf_end.
+typedef struct {
+    Arena *arena;
+    ArenaChunk *chunk;
+    char *data;
+    size_t len, cap;
+    int failed;
+} StrBuf;
+
+void strbuf_begin(StrBuf *buf, Arena *arena);
+void strbuf_append(StrBuf *buf, const char *str, size_t len);
+void strbuf_puts(StrBuf *buf, const char *str);
+void strbuf_printf(StrBuf *buf, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+// The NUL-terminated text and its length, or NULL if memory ran out
+char *strbuf_end(StrBuf *buf, size_t *len);
+
+#endif
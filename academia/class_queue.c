@@ -0,0 +1,86 @@
+#include "class_queue.h"
+#include <errno.h>
+#include <sched.h>
+
+int class_queue_init(ClassQueue *q, const int *weights, int class_count, size_t capacity) {
+    if (class_count < 1 || class_count > CLASS_QUEUE_MAX_CLASSES) return -1;
+    int total = 0;
+    for (int c = 0; c < class_count; c++) {
+        if (weights[c] < 1) return -1;
+        total += weights[c];
+    }
+    if (total > CLASS_QUEUE_MAX_ROUND) return -1;
+
+    // Smooth weighted round robin: every turn each class gains its weight and
+    // the richest one is served and pays the total
+    int credit[CLASS_QUEUE_MAX_CLASSES] = {0};
+    for (int t = 0; t < total; t++) {
+        int best = 0;
+        for (int c = 0; c < class_count; c++) {
+            credit[c] += weights[c];
+            if (credit[c] > credit[best]) best = c;
+        }
+        credit[best] -= total;
+        q->round[t] = (unsigned char)best;
+    }
+    q->round_len = total;
+    q->class_count = class_count;
+    atomic_init(&q->turn, 0);
+    atomic_init(&q->closed, 0);
+
+    for (int c = 0; c < class_count; c++) {
+        if (work_queue_init(&q->classes[c], capacity) < 0) {
+            while (c-- > 0) work_queue_destroy(&q->classes[c]);
+            return -1;
+        }
+    }
+    if (sem_init(&q->pending, 0, 0) < 0) {
+        for (int c = 0; c < class_count; c++) work_queue_destroy(&q->classes[c]);
+        return -1;
+    }
+    return 0;
+}
+
+int class_queue_push(ClassQueue *q, int cls, void *item) {
+    if (work_queue_push(&q->classes[cls], item) < 0) return -1;
+    sem_post(&q->pending);
+    return 0;
+}
+
+// One item from the class whose turn it is, or else from any class
+static int take_next(ClassQueue *q, void **item) {
+    unsigned int turn = atomic_fetch_add_explicit(&q->turn, 1, memory_order_relaxed);
+    int cls = q->round[turn % q->round_len];
+    if (work_queue_try_pop(&q->classes[cls], item)) return 1;
+    for (int c = 0; c < q->class_count; c++) {
+        if (c != cls && work_queue_try_pop(&q->classes[c], item)) return 1;
+    }
+    return 0;
+}
+
+int class_queue_pop_batch(ClassQueue *q, void **items, int max) {
+    // Block for the first item only, then take whatever else is already there
+    while (sem_wait(&q->pending) < 0 && errno == EINTR);
+    int tokens = 1;
+    while (tokens < max && sem_trywait(&q->pending) == 0) tokens++;
+
+    int count = 0;
+    while (count < tokens) {
+        if (take_next(q, &items[count])) {
+            count++;
+        } else if (atomic_load_explicit(&q->closed, memory_order_acquire)) {
+            // Drained, and this was the close token: hand it on so the next consumer exits too
+            sem_post(&q->pending);
+            break;
+        } else {
+            sched_yield(); // Another consumer took the item this token was for; its own is still coming
+        }
+    }
+    return count;
+}
+
+void class_queue_close(ClassQueue *q) {
+    atomic_store_explicit(&q->closed, 1, memory_order_release);
+    for (int c = 0; c < q->class_count; c++) work_queue_close(&q->classes[c]);
+    sem_post(&q->pending);
+}
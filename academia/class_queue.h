@@ -0,0 +1,42 @@
+#ifndef CLASS_QUEUE_H
+#define CLASS_QUEUE_H
+
+#include "work_queue.h"
+
+// Work queue split into priority classes.
+//
+// Each class is a WorkQueue of its own, so a flood in one class cannot take
+// the slots of another. Consumers serve the classes in a fixed weighted
+// round robin, interleaved the way smooth weighted round robin orders it
+// (weights 3,1 give A A B A, not A A A B). A turn whose class is empty goes
+// to the first class, in class order, that has work, so no consumer idles
+// while anything is queued. One shared semaphore counts the items of all
+// classes and is the only thing consumers sleep on.
+
+#define CLASS_QUEUE_MAX_CLASSES 4
+#define CLASS_QUEUE_MAX_ROUND 64   // Sum of the weights
+
+typedef struct {
+    WorkQueue classes[CLASS_QUEUE_MAX_CLASSES];
+    int class_count;
+    unsigned char round[CLASS_QUEUE_MAX_ROUND];   // Class served at each turn
+    int round_len;
+    atomic_uint turn;
+    sem_t pending;   // Items queued in any class, plus the close token
+    atomic_int closed;
+} ClassQueue;
+
+// Weights are at least 1; capacity is per class
+int class_queue_init(ClassQueue *q, const int *weights, int class_count, size_t capacity);
+
+// Block while the item's class is full. Return 0, or -1 once the queue is closed.
+int class_queue_push(ClassQueue *q, int cls, void *item);
+
+// Block while every class is empty, then take up to max items, each from the
+// class whose turn it is. Return 0 once closed and drained.
+int class_queue_pop_batch(ClassQueue *q, void **items, int max);
+
+// As work_queue_close(), for every class
+void class_queue_close(ClassQueue *q);
+
+#endif
@@ -0,0 +1,621 @@
+#include "client_lib.h"
+#include "protocol.h"
+#include "framed_io.h"
+#include "compress.h"
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+
+enum ConnState {
+    CONN_CLOSED,
+    CONN_OPENING,    // Being connected and logged in by one caller
+    CONN_OPEN,
+    CONN_FAILING     // Dropped; its reader is still completing the calls that were in flight
+};
+
+typedef struct PendingCall {
+    uint32_t request_id;
+    int op;
+    ClientCallback done;
+    void *arg;
+    char password[MAX_PASS];   // OP_CHANGE_PASSWORD: the pool's password once it succeeds
+    char course_id[MAX_ID];    // OP_SUBSCRIBE, OP_UNSUBSCRIBE: the course, for the pool's list
+    struct PendingCall *next;
+} PendingCall;
+
+typedef struct {
+    ClientPool *pool;
+    enum ConnState state;
+    int fd;                    // -1 while closed
+    FramedConn in;             // Read by the reader thread (and by conn_open before it starts)
+    FramedConn out;            // Written under send_lock
+    pthread_mutex_t send_lock;
+    pthread_t reader;
+    int reader_started;        // The reader has to be joined before the slot is opened again
+    PendingCall *pending;      // Calls sent and not answered
+    int inflight;
+    uint32_t next_id;
+    char *buf;                 // PROTO_MAX_FRAME bytes for incoming frames
+} PoolConn;
+
+// Last course listing of one kind and the catalog version it shows
+typedef struct {
+    char version[CATALOG_VERSION_MAX];   // "" while there is none
+    char *text;
+} CachedListing;
+
+struct ClientPool {
+    ClientConfig config;
+    char unix_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    char host[INET_ADDRSTRLEN];
+    enum Role role;
+    char user_id[MAX_ID];
+    char password[MAX_PASS];
+    char token[SESSION_TOKEN_MAX];   // Latest session token, "" if none
+    pthread_mutex_t lock;            // The fields below, and state, pending and inflight of the connections
+    pthread_cond_t changed;          // A call completed, or a connection opened or closed
+    int closing;
+    CachedListing catalog;           // OP_VIEW_ALL_COURSES
+    CachedListing faculty_courses;   // OP_VIEW_FACULTY_COURSES
+    char subscribed[CLIENT_MAX_SUBSCRIPTIONS][MAX_ID];   // Courses watched, "" for a free entry
+    ClientSeatCallback seat_handler;
+    void *seat_arg;
+    PoolConn conns[CLIENT_POOL_MAX];
+};
+
+static CachedListing *cached_listing(ClientPool *pool, int op) {
+    return op == OP_VIEW_ALL_COURSES ? &pool->catalog : op == OP_VIEW_FACULTY_COURSES ? &pool->faculty_courses : NULL;
+}
+
+// Under pool->lock: serve an unchanged listing from the cache, or keep a new one
+static void revalidate_listing(ClientPool *pool, int op, const ProtoMessage *msg, ClientResult *result) {
+    CachedListing *cached = cached_listing(pool, op);
+    if (!cached) return;
+    if (result->status == ERR_NOT_MODIFIED && cached->text) {
+        char *text = strdup(cached->text);
+        if (!text) return;
+        free(result->text);
+        result->text = text;
+        result->status = 0;
+    } else if (result->status == 0 && result->text && msg->field_count > 2 && msg->fields[2].type == PROTO_FIELD_STR) {
+        char *text = strdup(result->text);
+        if (!text) return;
+        free(cached->text);
+        cached->text = text;
+        proto_get_str(msg, 2, cached->version, sizeof(cached->version));
+    }
+}
+
+static int connect_server(const ClientPool *pool) {
+    const ClientConfig *config = &pool->config;
+    int sock = socket(config->unix_path ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    struct sockaddr_storage server_addr = {0};
+    socklen_t addr_len;
+    if (config->unix_path) {
+        struct sockaddr_un *addr = (struct sockaddr_un *)&server_addr;
+        addr->sun_family = AF_UNIX;
+        strncpy(addr->sun_path, config->unix_path, sizeof(addr->sun_path) - 1);
+        addr_len = sizeof(*addr);
+    } else {
+        int flag = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        struct sockaddr_in *addr = (struct sockaddr_in *)&server_addr;
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(config->port ? config->port : PORT);
+        addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (config->host && inet_pton(AF_INET, config->host, &addr->sin_addr) != 1) {
+            close(sock);
+            return -1;
+        }
+        addr_len = sizeof(*addr);
+    }
+    if (connect(sock, (struct sockaddr *)&server_addr, addr_len) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// One request and its response on a connection whose reader is not running:
+// the status, or CLIENT_ERR_CONNECTION. A session token in the response is
+// copied to token.
+static int open_exchange(PoolConn *c, ProtoBuffer *frame, char *token) {
+    proto_finish(frame);
+    if (framed_send(&c->out, frame->data, frame->len, 0) < 0) return CLIENT_ERR_CONNECTION;
+    int len = framed_read_message(&c->in, c->buf, PROTO_MAX_FRAME);
+    ProtoMessage msg;
+    if (len < 0 || proto_parse(c->buf, len, &msg) < 0) return CLIENT_ERR_CONNECTION;
+    if (msg.field_count > 2 && msg.fields[2].type == PROTO_FIELD_STR) proto_get_str(&msg, 2, token, SESSION_TOKEN_MAX);
+    return proto_get_int(&msg, 0);
+}
+
+static void *reader_main(void *arg);
+
+// Connect, switch to the binary protocol and resume the pool's session, or
+// log in if there is none (or it was revoked). 0, or the status of the
+// failed login or CLIENT_ERR_CONNECTION.
+static int conn_open(ClientPool *pool, PoolConn *c) {
+    if (c->reader_started) {
+        pthread_join(c->reader, NULL);
+        c->reader_started = 0;
+    }
+    if (!c->buf && !(c->buf = malloc(PROTO_MAX_FRAME))) return CLIENT_ERR_CONNECTION;
+    int fd = connect_server(pool);
+    if (fd < 0) return CLIENT_ERR_CONNECTION;
+    if (framed_init(&c->in, fd, NULL) < 0 || framed_init(&c->out, fd, NULL) < 0) {
+        framed_free(&c->in);
+        close(fd);
+        return CLIENT_ERR_CONNECTION;
+    }
+
+    // Login screen, then the magic and the capability request in one send;
+    // the server answers each
+    ProtoBuffer frame;
+    proto_buffer_init(&frame);
+    proto_begin(&frame, OP_HELLO, 0, ++c->next_id);
+    proto_add_int(&frame, pool->config.compress ? PROTO_CAP_DEFLATE : 0);
+    proto_finish(&frame);
+    int status = framed_read_message(&c->in, c->buf, PROTO_MAX_FRAME) >= 0 &&
+                 framed_send(&c->out, PROTO_MAGIC, PROTO_MAGIC_LEN, 1) == 0 &&
+                 framed_send(&c->out, frame.data, frame.len, 0) == 0 &&
+                 framed_read_message(&c->in, c->buf, PROTO_MAX_FRAME) >= 0 &&
+                 framed_read_message(&c->in, c->buf, PROTO_MAX_FRAME) >= 0 ? 0 : CLIENT_ERR_CONNECTION;
+
+    char token[SESSION_TOKEN_MAX], password[MAX_PASS];
+    pthread_mutex_lock(&pool->lock);
+    strcpy(token, pool->token);
+    strcpy(password, pool->password);
+    pthread_mutex_unlock(&pool->lock);
+    int resumed = 0;
+    if (status == 0 && token[0]) {
+        proto_begin(&frame, OP_RESUME, 0, ++c->next_id);
+        proto_add_str(&frame, token);
+        int ret = open_exchange(c, &frame, token);
+        if (ret == CLIENT_ERR_CONNECTION) status = ret;
+        resumed = ret == 0;
+    }
+    if (status == 0 && !resumed) {
+        proto_begin(&frame, OP_AUTHENTICATE, PROTO_FLAG_TERSE, ++c->next_id);
+        proto_add_int(&frame, pool->role);
+        proto_add_str(&frame, pool->user_id);
+        proto_add_str(&frame, password);
+        status = open_exchange(c, &frame, token);
+    }
+    if (status == 0 && c == &pool->conns[0]) {
+        // The server forgot the subscriptions of the connection this replaces
+        char subscribed[CLIENT_MAX_SUBSCRIPTIONS][MAX_ID];
+        pthread_mutex_lock(&pool->lock);
+        memcpy(subscribed, pool->subscribed, sizeof(subscribed));
+        pthread_mutex_unlock(&pool->lock);
+        for (int i = 0; status == 0 && i < CLIENT_MAX_SUBSCRIPTIONS; i++) {
+            if (!subscribed[i][0]) continue;
+            proto_begin(&frame, OP_SUBSCRIBE, PROTO_FLAG_TERSE, ++c->next_id);
+            proto_add_str(&frame, subscribed[i]);
+            if (open_exchange(c, &frame, token) == CLIENT_ERR_CONNECTION) status = CLIENT_ERR_CONNECTION;
+        }
+    }
+    proto_buffer_free(&frame);
+    if (status == 0 && pthread_create(&c->reader, NULL, reader_main, c) != 0) status = CLIENT_ERR_CONNECTION;
+    if (status != 0) {
+        framed_free(&c->in);
+        framed_free(&c->out);
+        close(fd);
+        return status;
+    }
+    c->reader_started = 1;
+    pthread_mutex_lock(&c->send_lock);
+    c->fd = fd;
+    pthread_mutex_unlock(&c->send_lock);
+    pthread_mutex_lock(&pool->lock);
+    strcpy(pool->token, token);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+// The connection dropped: close it and complete its calls in flight
+static void conn_fail(PoolConn *c) {
+    ClientPool *pool = c->pool;
+    pthread_mutex_lock(&c->send_lock);
+    close(c->fd);
+    c->fd = -1;
+    framed_free(&c->in);
+    framed_free(&c->out);
+    pthread_mutex_unlock(&c->send_lock);
+
+    pthread_mutex_lock(&pool->lock);
+    PendingCall *calls = c->pending;
+    c->pending = NULL;
+    c->inflight = 0;
+    c->state = CONN_FAILING;
+    pthread_mutex_unlock(&pool->lock);
+    while (calls) {
+        PendingCall *next = calls->next;
+        ClientResult result = {CLIENT_ERR_CONNECTION, strdup("")};
+        calls->done(&result, calls->arg);
+        free(calls);
+        calls = next;
+    }
+    // Only now may a callback's call reopen the slot (and join this thread)
+    pthread_mutex_lock(&pool->lock);
+    c->state = CONN_CLOSED;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Status and text of a response; the text is inflated if it came compressed
+static void decode_result(const ProtoMessage *msg, ClientResult *result) {
+    result->status = proto_get_int(msg, 0);
+    if ((msg->flags & PROTO_FLAG_DEFLATE) && msg->field_count > 1) {
+        result->text = decompress_text(msg->fields[1].str, msg->fields[1].len);
+        if (!result->text) {
+            result->status = CLIENT_ERR_CONNECTION;
+            result->text = strdup("");
+        }
+        return;
+    }
+    size_t size = msg->field_count > 1 ? msg->fields[1].len + 1 : 1;
+    result->text = malloc(size);
+    if (result->text) proto_get_str(msg, 1, result->text, size);
+}
+
+// Under pool->lock: keep the list of watched courses in step with the server
+static void note_subscription(ClientPool *pool, int op, const char *course_id) {
+    int found = -1, free_entry = -1;
+    for (int i = 0; i < CLIENT_MAX_SUBSCRIPTIONS; i++) {
+        if (strcmp(pool->subscribed[i], course_id) == 0) found = i;
+        if (!pool->subscribed[i][0] && free_entry < 0) free_entry = i;
+    }
+    if (op == OP_UNSUBSCRIBE && found >= 0) pool->subscribed[found][0] = '\0';
+    if (op == OP_SUBSCRIBE && found < 0 && free_entry >= 0) strcpy(pool->subscribed[free_entry], course_id);
+}
+
+// A frame the server sent on its own
+static void handle_push(ClientPool *pool, const ProtoMessage *msg) {
+    if (msg->opcode != OP_SEAT_EVENT || msg->field_count < 5) return;
+    char text[256], course_id[MAX_ID];
+    proto_get_str(msg, 1, text, sizeof(text));
+    proto_get_str(msg, 2, course_id, sizeof(course_id));
+    ClientSeatEvent event = {course_id, proto_get_int(msg, 3), proto_get_int(msg, 4), text};
+    pthread_mutex_lock(&pool->lock);
+    ClientSeatCallback handler = pool->seat_handler;
+    void *arg = pool->seat_arg;
+    pthread_mutex_unlock(&pool->lock);
+    if (handler) handler(&event, arg);
+}
+
+static void *reader_main(void *arg) {
+    PoolConn *c = arg;
+    ClientPool *pool = c->pool;
+    int len;
+    while ((len = framed_read_message(&c->in, c->buf, PROTO_MAX_FRAME)) >= 0) {
+        ProtoMessage msg;
+        if (proto_parse(c->buf, len, &msg) < 0) break;
+        if (msg.flags & PROTO_FLAG_PUSH) {
+            handle_push(pool, &msg);
+            continue;
+        }
+        ClientResult result;
+        decode_result(&msg, &result);
+
+        pthread_mutex_lock(&pool->lock);
+        PendingCall **link = &c->pending;
+        while (*link && (*link)->request_id != msg.request_id) link = &(*link)->next;
+        PendingCall *call = *link;
+        if (call) {
+            *link = call->next;
+            c->inflight--;
+            if (call->password[0] && result.status == 0) {
+                // The server revoked the session token with the old password
+                strcpy(pool->password, call->password);
+                pool->token[0] = '\0';
+            }
+            revalidate_listing(pool, call->op, &msg, &result);
+            if (result.status == 0 && (call->op == OP_SUBSCRIBE || call->op == OP_UNSUBSCRIBE)) {
+                note_subscription(pool, call->op, call->course_id);
+            }
+        }
+        if ((msg.opcode == OP_CHANGE_PASSWORD || msg.opcode == OP_RESUME) && msg.field_count > 2 &&
+            msg.fields[2].type == PROTO_FIELD_STR) {
+            proto_get_str(&msg, 2, pool->token, sizeof(pool->token));
+        }
+        pthread_cond_broadcast(&pool->changed);
+        pthread_mutex_unlock(&pool->lock);
+
+        if (call) {
+            call->done(&result, call->arg);
+            free(call);
+        } else {
+            client_result_free(&result);
+        }
+    }
+    conn_fail(c);
+    return NULL;
+}
+
+// Register call on a connection with room for it: pinned, or else the open
+// connection with the fewest calls in flight, opening another one while all
+// are busy (unless may_open is 0). Returns the connection with the call's id
+// in *request_id, or NULL with the reason in *status.
+static PoolConn *acquire(ClientPool *pool, PoolConn *pinned, int may_open, PendingCall *call, uint32_t *request_id,
+                         int *status) {
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        if (pool->closing || (pinned && !may_open && pinned->state != CONN_OPEN)) {
+            pthread_mutex_unlock(&pool->lock);
+            *status = CLIENT_ERR_CONNECTION;
+            return NULL;
+        }
+        PoolConn *best = NULL, *closed = NULL;
+        int active = 0;
+        for (int i = 0; i < pool->config.size; i++) {
+            PoolConn *c = pinned ? pinned : &pool->conns[i];
+            if (c->state == CONN_OPEN || c->state == CONN_OPENING) active++;
+            if (c->state == CONN_OPEN && c->inflight < PROTO_MAX_INFLIGHT && (!best || c->inflight < best->inflight)) {
+                best = c;
+            }
+            if (c->state == CONN_CLOSED && !closed) closed = c;
+            if (pinned) break;
+        }
+        if (best && (best->inflight == 0 || !closed || !may_open)) {
+            call->request_id = *request_id = ++best->next_id;
+            call->next = best->pending;
+            best->pending = call;
+            best->inflight++;
+            pthread_mutex_unlock(&pool->lock);
+            return best;
+        }
+        if (closed && may_open) {
+            closed->state = CONN_OPENING;
+            pthread_mutex_unlock(&pool->lock);
+            int ret = conn_open(pool, closed);
+            pthread_mutex_lock(&pool->lock);
+            closed->state = ret == 0 ? CONN_OPEN : CONN_CLOSED;
+            pthread_cond_broadcast(&pool->changed);
+            if (ret != 0) {
+                // Make do with the connections that are open, if any
+                may_open = 0;
+                if (active == 0) {
+                    pthread_mutex_unlock(&pool->lock);
+                    *status = ret;
+                    return NULL;
+                }
+            }
+            continue;
+        }
+        if (active == 0 && !may_open) {
+            pthread_mutex_unlock(&pool->lock);
+            *status = CLIENT_ERR_CONNECTION;
+            return NULL;
+        }
+        pthread_cond_wait(&pool->changed, &pool->lock);
+    }
+}
+
+static int submit(ClientPool *pool, PoolConn *pinned, int op, const char *const *fields, ClientCallback done, void *arg) {
+    PendingCall *call = calloc(1, sizeof(PendingCall));
+    if (!call) return CLIENT_ERR_CONNECTION;
+    call->op = op;
+    call->done = done;
+    call->arg = arg;
+    const char *types = proto_op_fields(op);
+    if (op == OP_CHANGE_PASSWORD) strncpy(call->password, fields[0], MAX_PASS - 1);
+    // A cached listing is only sent again if the catalog changed since
+    char version[CATALOG_VERSION_MAX] = "";
+    CachedListing *cached = cached_listing(pool, op);
+    if (cached) {
+        pthread_mutex_lock(&pool->lock);
+        if (cached->text) strcpy(version, cached->version);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    uint32_t request_id;
+    int status;
+    // Subscriptions live on the first connection, which restores them when it reopens
+    if (op == OP_SUBSCRIBE || op == OP_UNSUBSCRIBE) {
+        pinned = &pool->conns[0];
+        strncpy(call->course_id, fields[0], MAX_ID - 1);
+    }
+    PoolConn *c = acquire(pool, pinned, !pinned || op != OP_LOGOUT, call, &request_id, &status);
+    if (!c) {
+        free(call);
+        return status;
+    }
+    // From here on the reader owns call: it may even have failed it already
+    ProtoBuffer frame;
+    proto_buffer_init(&frame);
+    proto_begin(&frame, op, PROTO_FLAG_TERSE, request_id);
+    for (int i = 0; types[i]; i++) {
+        if (types[i] == 's') proto_add_int(&frame, atoi(fields[i]));
+        else proto_add_str(&frame, fields[i]);
+    }
+    if (version[0]) proto_add_str(&frame, version);
+    proto_finish(&frame);
+    pthread_mutex_lock(&c->send_lock);
+    // A failed send leaves the call to the reader, which fails everything in flight
+    if (c->fd >= 0 && framed_send(&c->out, frame.data, frame.len, 0) < 0) shutdown(c->fd, SHUT_RDWR);
+    pthread_mutex_unlock(&c->send_lock);
+    proto_buffer_free(&frame);
+    return 0;
+}
+
+int client_call_async(ClientPool *pool, int op, const char *const *fields, ClientCallback done, void *arg) {
+    return submit(pool, NULL, op, fields, done, arg);
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int done;
+    ClientResult result;
+} Waiter;
+
+static void wake_waiter(ClientResult *result, void *arg) {
+    Waiter *waiter = arg;
+    pthread_mutex_lock(&waiter->lock);
+    waiter->result = *result;
+    waiter->done = 1;
+    pthread_cond_signal(&waiter->cond);
+    pthread_mutex_unlock(&waiter->lock);
+}
+
+static int call_on(ClientPool *pool, PoolConn *pinned, int op, const char *const *fields, ClientResult *result) {
+    Waiter waiter = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, {0, NULL}};
+    int status = submit(pool, pinned, op, fields, wake_waiter, &waiter);
+    if (status != 0) {
+        waiter.result.status = status;
+        waiter.result.text = strdup("");
+    } else {
+        pthread_mutex_lock(&waiter.lock);
+        while (!waiter.done) pthread_cond_wait(&waiter.cond, &waiter.lock);
+        pthread_mutex_unlock(&waiter.lock);
+    }
+    pthread_mutex_destroy(&waiter.lock);
+    pthread_cond_destroy(&waiter.cond);
+    status = waiter.result.status;
+    if (result) *result = waiter.result;
+    else client_result_free(&waiter.result);
+    return status;
+}
+
+int client_call(ClientPool *pool, int op, const char *const *fields, ClientResult *result) {
+    return call_on(pool, NULL, op, fields, result);
+}
+
+int client_list_courses(ClientPool *pool, ClientResult *result) {
+    return call_on(pool, NULL, OP_VIEW_ALL_COURSES, NULL, result);
+}
+
+int client_enrolled_courses(ClientPool *pool, ClientResult *result) {
+    return call_on(pool, NULL, OP_VIEW_ENROLLED_COURSES, NULL, result);
+}
+
+int client_faculty_courses(ClientPool *pool, ClientResult *result) {
+    return call_on(pool, NULL, OP_VIEW_FACULTY_COURSES, NULL, result);
+}
+
+int client_enroll(ClientPool *pool, const char *course_id, ClientResult *result) {
+    const char *fields[] = {course_id};
+    return call_on(pool, NULL, OP_ENROLL_COURSE, fields, result);
+}
+
+int client_drop(ClientPool *pool, const char *course_id, ClientResult *result) {
+    const char *fields[] = {course_id};
+    return call_on(pool, NULL, OP_DROP_COURSE, fields, result);
+}
+
+int client_change_password(ClientPool *pool, const char *password, ClientResult *result) {
+    const char *fields[] = {password};
+    return call_on(pool, NULL, OP_CHANGE_PASSWORD, fields, result);
+}
+
+int client_subscribe(ClientPool *pool, const char *course_id, ClientResult *result) {
+    const char *fields[] = {course_id};
+    return call_on(pool, NULL, OP_SUBSCRIBE, fields, result);
+}
+
+int client_unsubscribe(ClientPool *pool, const char *course_id, ClientResult *result) {
+    const char *fields[] = {course_id};
+    return call_on(pool, NULL, OP_UNSUBSCRIBE, fields, result);
+}
+
+void client_set_seat_handler(ClientPool *pool, ClientSeatCallback handler, void *arg) {
+    pthread_mutex_lock(&pool->lock);
+    pool->seat_handler = handler;
+    pool->seat_arg = arg;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int client_logout(ClientPool *pool, ClientResult *result) {
+    int status = CLIENT_ERR_CONNECTION, answered = 0;
+    for (int i = 0; i < pool->config.size; i++) {
+        pthread_mutex_lock(&pool->lock);
+        int open = pool->conns[i].state == CONN_OPEN;
+        pthread_mutex_unlock(&pool->lock);
+        if (!open) continue;
+        // The server answers once the connection's other calls are done, then closes it
+        ClientResult reply;
+        int ret = call_on(pool, &pool->conns[i], OP_LOGOUT, NULL, &reply);
+        if (!answered || ret != 0) {
+            if (answered && result) client_result_free(result);
+            if (result) *result = reply;
+            else client_result_free(&reply);
+            status = ret;
+            answered = 1;
+        } else {
+            client_result_free(&reply);
+        }
+    }
+    if (!answered && result) {
+        result->status = status;
+        result->text = strdup("");
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->closing = 1;
+    pool->token[0] = '\0';
+    pthread_mutex_unlock(&pool->lock);
+    return status;
+}
+
+ClientPool *client_pool_open(const ClientConfig *config, enum Role role, const char *user_id, const char *password,
+                             int *status) {
+    ClientPool *pool = calloc(1, sizeof(ClientPool));
+    *status = CLIENT_ERR_CONNECTION;
+    if (!pool) return NULL;
+    if (config->size < 1 || config->size > CLIENT_POOL_MAX ||
+        (config->unix_path && strlen(config->unix_path) >= sizeof(pool->unix_path)) ||
+        (config->host && strlen(config->host) >= sizeof(pool->host))) {
+        free(pool);
+        *status = ERR_INVALID_INPUT;
+        return NULL;
+    }
+    pool->config = *config;
+    if (config->unix_path) pool->config.unix_path = strcpy(pool->unix_path, config->unix_path);
+    if (config->host) pool->config.host = strcpy(pool->host, config->host);
+    pool->role = role;
+    strncpy(pool->user_id, user_id, MAX_ID - 1);
+    strncpy(pool->password, password, MAX_PASS - 1);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->changed, NULL);
+    for (int i = 0; i < CLIENT_POOL_MAX; i++) {
+        pool->conns[i].pool = pool;
+        pool->conns[i].fd = -1;
+        pthread_mutex_init(&pool->conns[i].send_lock, NULL);
+    }
+
+    // The first connection logs in right away, so bad credentials show here
+    pool->conns[0].state = CONN_OPENING;
+    *status = conn_open(pool, &pool->conns[0]);
+    if (*status != 0) {
+        pool->conns[0].state = CONN_CLOSED;
+        client_pool_close(pool);
+        return NULL;
+    }
+    pool->conns[0].state = CONN_OPEN;
+    return pool;
+}
+
+void client_pool_close(ClientPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->closing = 1;
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < CLIENT_POOL_MAX; i++) {
+        PoolConn *c = &pool->conns[i];
+        pthread_mutex_lock(&c->send_lock);
+        if (c->fd >= 0) shutdown(c->fd, SHUT_RDWR);
+        pthread_mutex_unlock(&c->send_lock);
+        if (c->reader_started) pthread_join(c->reader, NULL);
+        free(c->buf);
+        pthread_mutex_destroy(&c->send_lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->changed);
+    free(pool->catalog.text);
+    free(pool->faculty_courses.text);
+    free(pool);
+}
+
+void client_result_free(ClientResult *result) {
+    free(result->text);
+    result->text = NULL;
+}
@@ -0,0 +1,97 @@
+#ifndef CLIENT_LIB_H
+#define CLIENT_LIB_H
+
+#include "academia.h"
+#include "session_token.h"
+
+// Client library: typed calls to the server over a pool of logged-in
+// binary-protocol connections (protocol.h).
+//
+// A pool belongs to one user. Its first connection logs in with the user's
+// password; further connections, opened on demand while the others are busy,
+// resume the session with its token (OP_RESUME) instead. Each connection
+// pipelines up to PROTO_MAX_INFLIGHT calls and has a reader thread that
+// completes them as their responses arrive, in whatever order. A call
+// goes to the open connection with the fewest calls in flight.
+//
+// When a connection drops, its calls in flight complete with
+// CLIENT_ERR_CONNECTION; whether a change went through is then unknown. The
+// next call that needs the connection opens it again.
+//
+// The pool keeps the last course listing of each kind (all courses, the
+// faculty's courses) with its catalog version, and asks for it again only
+// if the catalog changed since (protocol.h); an unchanged listing is served
+// from the cache.
+//
+// Calls are made in command mode (PROTO_FLAG_TERSE): a result's text is the
+// listing, and empty for replies that only carry a status. result_message()
+// (menus.h) has the message for a status.
+
+#define CLIENT_POOL_MAX 32
+#define CLIENT_ERR_CONNECTION -100   // No reply: the connection failed or could not be opened
+#define CLIENT_MAX_SUBSCRIPTIONS 16
+
+typedef struct {
+    const char *unix_path;   // Server's Unix domain socket, NULL for TCP
+    const char *host;        // IPv4 address of the server, NULL for the local host
+    int port;                // 0 for PORT
+    int size;                // Most connections the pool opens, 1 to CLIENT_POOL_MAX
+    int compress;            // Ask for compressed listings
+} ClientConfig;
+
+typedef struct {
+    int status;              // ERR_* code, or CLIENT_ERR_CONNECTION
+    char *text;              // malloc'd, never NULL
+} ClientResult;
+
+// Seat availability changed in a watched course (client_subscribe)
+typedef struct {
+    const char *course_id;
+    int free_seats;
+    int total_seats;
+    const char *text;        // The server's message for it
+} ClientSeatEvent;
+
+// Completion of an asynchronous call, on the reader thread of its
+// connection. The callback owns result->text. It must not wait for another
+// call of the pool, whose response that reader thread may be the one to read.
+typedef void (*ClientCallback)(ClientResult *result, void *arg);
+
+// Called on a reader thread, under the same rule as ClientCallback
+typedef void (*ClientSeatCallback)(const ClientSeatEvent *event, void *arg);
+
+typedef struct ClientPool ClientPool;
+
+// Open a pool for a user and log in on its first connection. NULL if that
+// fails, with the login status (or CLIENT_ERR_CONNECTION) in *status.
+ClientPool *client_pool_open(const ClientConfig *config, enum Role role, const char *user_id, const char *password,
+                             int *status);
+// Close every connection; calls still in flight complete with CLIENT_ERR_CONNECTION
+void client_pool_close(ClientPool *pool);
+
+// Any request: fields as strings in proto_op_fields() order ('s' is a number).
+// The asynchronous form returns 0 once the call is sent, or the status it
+// failed with (the callback is not called then).
+int client_call_async(ClientPool *pool, int op, const char *const *fields, ClientCallback done, void *arg);
+// Wait for the result; returns its status
+int client_call(ClientPool *pool, int op, const char *const *fields, ClientResult *result);
+
+// Typed calls. Each returns the status; result may be NULL when only that matters.
+int client_list_courses(ClientPool *pool, ClientResult *result);
+int client_enrolled_courses(ClientPool *pool, ClientResult *result);
+int client_faculty_courses(ClientPool *pool, ClientResult *result);
+int client_enroll(ClientPool *pool, const char *course_id, ClientResult *result);
+int client_drop(ClientPool *pool, const char *course_id, ClientResult *result);
+int client_change_password(ClientPool *pool, const char *password, ClientResult *result);
+// Watch a course for free seats (students). Events go to the pool's seat
+// handler; the first connection carries the subscriptions and renews them
+// when it is reopened, though events from while it was down are lost.
+int client_subscribe(ClientPool *pool, const char *course_id, ClientResult *result);
+int client_unsubscribe(ClientPool *pool, const char *course_id, ClientResult *result);
+void client_set_seat_handler(ClientPool *pool, ClientSeatCallback handler, void *arg);
+// Log out on every connection; the pool still has to be closed
+int client_logout(ClientPool *pool, ClientResult *result);
+
+void client_result_free(ClientResult *result);
+
+#endif
@@ -0,0 +1,77 @@
+#include "compress.h"
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+static pthread_key_t stream_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+
+static void stream_free(void *arg) {
+    z_stream *stream = arg;
+    deflateEnd(stream);
+    free(stream);
+}
+
+static void make_key(void) {
+    pthread_key_create(&stream_key, stream_free);
+}
+
+// The calling thread's deflate stream, created on first use. Reusing it
+// avoids allocating and faulting in the compressor's tables for every reply.
+static z_stream *thread_stream(void) {
+    pthread_once(&key_once, make_key);
+    z_stream *stream = pthread_getspecific(stream_key);
+    if (stream) return stream;
+    stream = calloc(1, sizeof(z_stream));
+    if (!stream) return NULL;
+    if (deflateInit(stream, Z_BEST_SPEED) != Z_OK) {
+        free(stream);
+        return NULL;
+    }
+    pthread_setspecific(stream_key, stream);
+    return stream;
+}
+
+long compress_text(const char *text, size_t len, char **out) {
+    z_stream *stream = thread_stream();
+    if (!stream || len > COMPRESS_MAX_TEXT || deflateReset(stream) != Z_OK) return -1;
+
+    size_t cap = COMPRESS_HEADER_SIZE + deflateBound(stream, len);
+    char *body = malloc(cap);
+    if (!body) return -1;
+    uint32_t len_net = htonl((uint32_t)len);
+    memcpy(body, &len_net, sizeof(len_net));
+
+    stream->next_in = (Bytef *)text;
+    stream->avail_in = len;
+    stream->next_out = (Bytef *)body + COMPRESS_HEADER_SIZE;
+    stream->avail_out = cap - COMPRESS_HEADER_SIZE;
+    if (deflate(stream, Z_FINISH) != Z_STREAM_END || COMPRESS_HEADER_SIZE + stream->total_out >= len) {
+        free(body);
+        return -1;
+    }
+    *out = body;
+    return COMPRESS_HEADER_SIZE + stream->total_out;
+}
+
+char *decompress_text(const char *data, size_t len) {
+    if (len < COMPRESS_HEADER_SIZE) return NULL;
+    uint32_t len_net;
+    memcpy(&len_net, data, sizeof(len_net));
+    uLongf text_len = ntohl(len_net);
+    if (text_len > COMPRESS_MAX_TEXT) return NULL;
+
+    char *text = malloc(text_len + 1);
+    if (!text) return NULL;
+    uLongf got = text_len;
+    if (uncompress((Bytef *)text, &got, (const Bytef *)data + COMPRESS_HEADER_SIZE, len - COMPRESS_HEADER_SIZE) != Z_OK ||
+        got != text_len) {
+        free(text);
+        return NULL;
+    }
+    text[text_len] = '\0';
+    return text;
+}
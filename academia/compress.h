@@ -0,0 +1,24 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+
+// Response compression for the binary protocol (PROTO_FLAG_DEFLATE).
+//
+// A compressed text field holds the text's length (4 bytes, network order)
+// followed by a zlib stream. Roster and course listings repeat the same
+// labels on every line, so the fastest deflate level already shrinks them
+// several times; each thread keeps its deflate state between calls.
+
+#define COMPRESS_DEFAULT_THRESHOLD 1024       // Shorter replies go out as they are
+#define COMPRESS_HEADER_SIZE 4
+#define COMPRESS_MAX_TEXT (64 * 1024 * 1024)  // Largest text a client inflates
+
+// Deflate len bytes of text into a malloc'd field body and return its size,
+// or -1 if that fails or would not be smaller than the text
+long compress_text(const char *text, size_t len, char **out);
+
+// Inflate a field body into a malloc'd NUL-terminated string, NULL if corrupt
+char *decompress_text(const char *data, size_t len);
+
+#endif
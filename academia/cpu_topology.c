@@ -0,0 +1,75 @@
+#define _GNU_SOURCE // cpu_set_t, pthread_attr_setaffinity_np
+#include "cpu_topology.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int cpu_list_parse(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char *p = list;
+    while (*p) {
+        if (!isdigit((unsigned char)*p)) return -1;
+        char *end;
+        long first = strtol(p, &end, 10), last = first;
+        if (*end == '-') {
+            if (!isdigit((unsigned char)end[1])) return -1;
+            last = strtol(end + 1, &end, 10);
+        }
+        if (last < first || last >= CPU_SETSIZE) return -1;
+        for (long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, set);
+        if (*end == ',') end++;
+        else if (*end) return -1;
+        p = end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+int cpu_nth(const cpu_set_t *set, int n) {
+    int count = CPU_COUNT(set);
+    if (count == 0) return -1;
+    n %= count;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, set) && n-- == 0) return cpu;
+    }
+    return -1;
+}
+
+int cpu_node(int cpu) {
+    // The CPU's sysfs directory links to its node as "node<N>"
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (!dir) return 0;
+    int node = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && isdigit((unsigned char)entry->d_name[4])) {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node < CPU_MAX_NODES ? node : 0;
+}
+
+int cpu_thread_create(pthread_t *thread, int cpu, void *(*start)(void *), void *arg) {
+    if (cpu < 0) return pthread_create(thread, NULL, start, arg);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    int ret = pthread_create(thread, &attr, start, arg);
+    pthread_attr_destroy(&attr);
+    return ret;
+}
+
+int cpu_run_on(int cpu, void *(*fn)(void *), void *arg, void **result) {
+    pthread_t thread;
+    int ret = cpu_thread_create(&thread, cpu, fn, arg);
+    if (ret != 0) return ret;
+    return pthread_join(thread, result);
+}
@@ -0,0 +1,35 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <pthread.h>
+#include <sched.h>   // cpu_set_t: include with _GNU_SOURCE defined
+
+// Thread placement on CPUs and NUMA nodes.
+//
+// Nothing is bound explicitly to a node: Linux places a page on the node of
+// the CPU that first touches it. A thread started on its CPU
+// (cpu_thread_create) therefore gets its stack, arena and I/O buffers
+// node-local as long as it allocates them itself, and memory shared by the
+// threads of one node is set up by cpu_run_on() from a CPU of that node.
+// Node numbers come from sysfs; without it every CPU is on node 0.
+
+#define CPU_MAX_NODES 64
+
+// Parse a list such as "0-3,8,10-11" into set; -1 on a syntax error or an
+// empty list
+int cpu_list_parse(const char *list, cpu_set_t *set);
+
+// The n-th (wrapping) CPU in set, -1 if it is empty
+int cpu_nth(const cpu_set_t *set, int n);
+
+// NUMA node of cpu, 0 if the kernel does not say
+int cpu_node(int cpu);
+
+// pthread_create with the thread running on cpu from its first instruction;
+// a cpu of -1 leaves the thread to the scheduler
+int cpu_thread_create(pthread_t *thread, int cpu, void *(*start)(void *), void *arg);
+
+// Run fn(arg) on a thread of its own on cpu and wait for it; its result
+int cpu_run_on(int cpu, void *(*fn)(void *), void *arg, void **result);
+
+#endif
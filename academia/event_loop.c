@@ -0,0 +1,85 @@
+#include "event_loop.h"
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+int event_loop_init(EventLoop *loop) {
+    loop->head = loop->tail = NULL;
+    loop->epoll_fd = epoll_create1(0);
+    if (loop->epoll_fd < 0) return -1;
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK);
+    // The wakeup is the one event without a watch
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (loop->wake_fd < 0 || epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &event) < 0) {
+        if (loop->wake_fd >= 0) close(loop->wake_fd);
+        close(loop->epoll_fd);
+        return -1;
+    }
+    pthread_mutex_init(&loop->lock, NULL);
+    return 0;
+}
+
+int event_loop_watch(EventLoop *loop, EventWatch *watch, uint32_t events) {
+    if (events == watch->events) return 0;
+    int op = watch->events == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    struct epoll_event event = {.events = events, .data.ptr = watch};
+    if (epoll_ctl(loop->epoll_fd, op, watch->fd, &event) < 0) return -1;
+    watch->events = events;
+    return 0;
+}
+
+void event_loop_post(EventLoop *loop, EventTask *task) {
+    task->next = NULL;
+    pthread_mutex_lock(&loop->lock);
+    int idle = loop->head == NULL;
+    if (loop->tail) {
+        loop->tail->next = task;
+    } else {
+        loop->head = task;
+    }
+    loop->tail = task;
+    pthread_mutex_unlock(&loop->lock);
+    // A loop with tasks pending has been woken already and takes this one too
+    if (idle) {
+        uint64_t one = 1;
+        while (write(loop->wake_fd, &one, sizeof(one)) < 0 && errno == EINTR);
+    }
+}
+
+static void run_tasks(EventLoop *loop) {
+    uint64_t count;
+    while (read(loop->wake_fd, &count, sizeof(count)) < 0 && errno == EINTR);
+    pthread_mutex_lock(&loop->lock);
+    EventTask *task = loop->head;
+    loop->head = loop->tail = NULL;
+    pthread_mutex_unlock(&loop->lock);
+    while (task) {
+        // The task may be freed by its own run
+        EventTask *next = task->next;
+        task->run(task->arg);
+        task = next;
+    }
+}
+
+void event_loop_run(EventLoop *loop) {
+    struct epoll_event events[EVENT_LOOP_BATCH];
+    while (1) {
+        int count = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_BATCH, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait failed");
+            return;
+        }
+        int woken = 0;
+        for (int i = 0; i < count; i++) {
+            EventWatch *watch = events[i].data.ptr;
+            if (watch) {
+                watch->handler(watch, events[i].events);
+            } else {
+                woken = 1;
+            }
+        }
+        if (woken) run_tasks(loop);
+    }
+}
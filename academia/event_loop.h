@@ -0,0 +1,50 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+// Readiness-driven loop run by a single thread.
+//
+// Sockets are watched with level-triggered epoll, and each watch names the
+// handler for its events. Other threads hand work to the loop by posting
+// tasks, which run on the loop thread in the order they were posted; a post
+// to a loop with nothing pending wakes it through an eventfd. What a loop's
+// handlers and tasks touch is therefore only ever touched by that thread.
+
+#define EVENT_LOOP_BATCH 64   // epoll events taken per wakeup
+
+typedef struct EventWatch {
+    int fd;
+    uint32_t events;   // EPOLLIN / EPOLLOUT asked for, 0 while not watched
+    void (*handler)(struct EventWatch *watch, uint32_t events);
+    void *context;
+} EventWatch;
+
+typedef struct EventTask {
+    void (*run)(void *arg);
+    void *arg;
+    struct EventTask *next;
+} EventTask;
+
+typedef struct {
+    int epoll_fd;
+    int wake_fd;
+    pthread_mutex_t lock;
+    EventTask *head, *tail;   // Posted tasks not yet run
+} EventLoop;
+
+int event_loop_init(EventLoop *loop);
+// Dispatch events and tasks forever
+void event_loop_run(EventLoop *loop);
+
+// Ask for events on watch->fd, changing what was asked before; 0 stops
+// watching it (so a hung-up socket does not keep reporting EPOLLHUP).
+// Only the loop thread calls this once the loop runs.
+int event_loop_watch(EventLoop *loop, EventWatch *watch, uint32_t events);
+
+// Any thread: run task->run(task->arg) on the loop thread
+void event_loop_post(EventLoop *loop, EventTask *task);
+
+#endif
@@ -1,4 +1,9 @@
+#define _GNU_SOURCE // sem_clockwait
 #include "academia.h"
+#include "io_backend.h"
+#include "metrics.h"
+#include "logger.h"
+#include "listing_cache.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,9 +11,85 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/file.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <time.h>
 
 extern sem_t file_sem;
 
+// Operations waiting for file_sem, and how often it has been taken. A long
+// scan lets the waiters in between two records (scan_yield).
+static atomic_int file_sem_waiters;
+static atomic_uint file_sem_taken;
+
+// The operation holding file_sem and since when, for the contention report
+// and for the warning of a waiter that gives up
+static _Atomic(const char *) file_sem_holder;
+static atomic_uint_fast64_t file_sem_held_since;
+
+// Longest wait for the locks of an operation, in ms; 0 waits forever
+static atomic_int lock_timeout_ms = DEFAULT_LOCK_TIMEOUT_MS;
+
+#define FCNTL_POLL_MAX_NS 10000000   // Longest sleep between two tries of a timed fcntl lock
+
+#define SCAN_YIELD_RECORDS 256   // Records a yielding scan reads between checks for waiters
+
+// Catalog generation: bumped, while file_sem is held, by every change to a
+// Course record, so a rendering made under file_sem is current exactly as
+// long as the generation has not moved. Course listings are cached per
+// generation (listing_cache.h).
+static atomic_uint_fast64_t catalog_generation = 1;
+
+static void catalog_changed(void) {
+    atomic_fetch_add(&catalog_generation, 1);
+}
+
+// Catalog versions handed to clients name this process as well: a
+// generation counted by another server process (before a restart, or the
+// one handing over its sockets) says nothing about this one's catalog
+static uint64_t catalog_epoch;
+static pthread_once_t catalog_epoch_once = PTHREAD_ONCE_INIT;
+
+static void pick_catalog_epoch(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    catalog_epoch = ((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec) ^ ((uint64_t)getpid() << 40);
+}
+
+static void format_catalog_version(uint64_t generation, char *version) {
+    pthread_once(&catalog_epoch_once, pick_catalog_epoch);
+    snprintf(version, CATALOG_VERSION_MAX, "%llx.%llx", (unsigned long long)catalog_epoch,
+             (unsigned long long)generation);
+}
+
+// Set while another process may still write courses.dat behind the
+// generation's back (the server being taken over, as it drains)
+static atomic_int catalog_shared;
+
+void catalog_set_shared(int shared) {
+    // Versions handed out while shared may already be stale
+    if (!shared) catalog_changed();
+    atomic_store(&catalog_shared, shared);
+}
+
+int catalog_unchanged(const char *version) {
+    if (atomic_load(&catalog_shared)) return 0;
+    char current[CATALOG_VERSION_MAX];
+    format_catalog_version(atomic_load(&catalog_generation), current);
+    return strcmp(version, current) == 0;
+}
+
+static _Atomic(SeatListener) seat_listener;
+
+void set_seat_listener(SeatListener listener) {
+    atomic_store(&seat_listener, listener);
+}
+
+static void seats_changed(const char *course_id, int enrolled, int total_seats) {
+    SeatListener listener = atomic_load(&seat_listener);
+    if (listener) listener(course_id, enrolled < total_seats ? total_seats - enrolled : 0, total_seats);
+}
+
 // Utility functions
 int validate_id(const char *id) {
     if (strlen(id) == 0 || strlen(id) >= MAX_ID) return ERR_INVALID_INPUT;
@@ -31,6 +112,12 @@ int validate_password(const char *password) {
     return 0;
 }
 
+// A course's seat count: at least one, and no more than the roster holds
+int validate_seats(int seats) {
+    if (seats < 1 || seats > MAX_USERS) return ERR_INVALID_INPUT;
+    return 0;
+}
+
 int validate_number(const char *input, int min, int max) {
     for (int i = 0; input[i]; i++) {
         if (!isdigit(input[i])) return ERR_INVALID_INPUT;
@@ -40,15 +127,98 @@ int validate_number(const char *input, int min, int max) {
     return num;
 }
 
+void set_lock_timeout(int ms) {
+    atomic_store(&lock_timeout_ms, ms);
+}
+
+// metrics_now() by which an operation starting now must hold its locks, 0 for no limit
+static uint64_t lock_deadline(void) {
+    int ms = atomic_load(&lock_timeout_ms);
+    return ms > 0 ? metrics_now() + (uint64_t)ms * 1000000 : 0;
+}
+
+// Whole-file fcntl lock of type on fd by deadline. There is no timed
+// F_SETLKW, so with a deadline the lock is polled with a growing sleep;
+// these locks only ever wait for another server process. -1 with errno
+// ETIMEDOUT if the deadline passed first.
+static int fcntl_lock(int fd, short type, uint64_t deadline) {
+    struct flock lock = {type, SEEK_SET, 0, 0, 0};
+    uint64_t start = metrics_now();
+    int ret;
+    if (deadline == 0) {
+        ret = fcntl(fd, F_SETLKW, &lock);
+    } else {
+        long pause_ns = 100000;
+        while ((ret = fcntl(fd, F_SETLK, &lock)) < 0 && (errno == EACCES || errno == EAGAIN || errno == EINTR)) {
+            if (metrics_now() >= deadline) {
+                errno = ETIMEDOUT;
+                break;
+            }
+            struct timespec pause = {0, pause_ns};
+            nanosleep(&pause, NULL);
+            if (pause_ns < FCNTL_POLL_MAX_NS) pause_ns *= 2;
+        }
+    }
+    metrics_record_lock_wait(type == F_RDLCK ? METRICS_LOCK_FCNTL_READ : METRICS_LOCK_FCNTL_WRITE, metrics_now() - start);
+    return ret;
+}
+
 // File locking functions
 int read_lock(int fd) {
-    struct flock lock = {F_RDLCK, SEEK_SET, 0, 0, 0};
-    return fcntl(fd, F_SETLKW, &lock);
+    return fcntl_lock(fd, F_RDLCK, lock_deadline());
 }
 
 int write_lock(int fd) {
-    struct flock lock = {F_WRLCK, SEEK_SET, 0, 0, 0};
-    return fcntl(fd, F_SETLKW, &lock);
+    return fcntl_lock(fd, F_WRLCK, lock_deadline());
+}
+
+// Take file_sem for holder by deadline (0: no limit), recording how long
+// the caller waited for it. -1 if the deadline passed first; the wait is
+// then charged to the operation holding it.
+static int file_sem_wait(const char *holder, uint64_t deadline) {
+    uint64_t start = metrics_now();
+    atomic_fetch_add(&file_sem_waiters, 1);
+    int ret;
+    if (deadline == 0) {
+        while ((ret = sem_wait(&file_sem)) < 0 && errno == EINTR);
+    } else {
+        struct timespec until = {deadline / 1000000000, deadline % 1000000000};
+        while ((ret = sem_clockwait(&file_sem, CLOCK_MONOTONIC, &until)) < 0 && errno == EINTR);
+    }
+    atomic_fetch_sub(&file_sem_waiters, 1);
+    uint64_t now = metrics_now();
+    metrics_record_lock_wait(METRICS_LOCK_FILE_SEM, now - start);
+    if (ret < 0) {
+        const char *blocker = atomic_load(&file_sem_holder);
+        metrics_record_lock_timeout(blocker);
+        log_sampled(LOG_WARN, "Server: %s gave up on file_sem after %llu ms, held by %s for %llu ms\n", holder,
+                    (unsigned long long)(now - start) / 1000000, blocker ? blocker : "?",
+                    (unsigned long long)(now - atomic_load(&file_sem_held_since)) / 1000000);
+        return -1;
+    }
+    atomic_fetch_add(&file_sem_taken, 1);
+    atomic_store(&file_sem_holder, holder);
+    atomic_store(&file_sem_held_since, now);
+    return 0;
+}
+
+// Release file_sem, charging the hold to its holder along with the
+// operations left waiting behind it
+static void file_sem_release(void) {
+    metrics_record_lock_hold(atomic_load(&file_sem_holder), metrics_now() - atomic_load(&file_sem_held_since),
+                             atomic_load(&file_sem_waiters));
+    sem_post(&file_sem);
+}
+
+// Take file_sem and a whole-file lock of type on fd for holder, both by
+// deadline. 0, or ERR_LOCK_TIMEOUT holding neither.
+static int lock_file(int fd, short type, const char *holder, uint64_t deadline) {
+    if (file_sem_wait(holder, deadline) < 0) return ERR_LOCK_TIMEOUT;
+    if (fcntl_lock(fd, type, deadline) < 0 && errno == ETIMEDOUT) {
+        file_sem_release();
+        return ERR_LOCK_TIMEOUT;
+    }
+    return 0;
 }
 
 int unlock(int fd) {
@@ -56,12 +226,122 @@ int unlock(int fd) {
     return fcntl(fd, F_SETLK, &lock);
 }
 
+// Sequential reader over fixed-size records. Fills the thread's I/O buffer
+// with one pread per IO_BUFFER_SIZE bytes instead of one read() per record.
+typedef struct {
+    int fd;
+    off_t file_pos;   // Offset of the next pread
+    char *buf;
+    int buf_index;    // Registered buffer index, -1 if not registered
+    size_t cap, len, pos;
+    int yielding;     // Gives file_sem to waiters every SCAN_YIELD_RECORDS records
+    int since_yield;
+    short lock_type;  // fcntl lock the yielding scan holds on fd
+} RecordScan;
+
+static void scan_begin(RecordScan *scan, int fd) {
+    scan->fd = fd;
+    scan->file_pos = 0;
+    scan->len = scan->pos = 0;
+    scan->buf = io_thread_buffer(&scan->cap, &scan->buf_index);
+    scan->yielding = 0;
+}
+
+// A scan of a whole file that need not see it at one instant: between two
+// records it may let the operations waiting for file_sem run first. Each
+// record is still read whole under file_sem and the fcntl lock of lock_type.
+static void scan_begin_yielding(RecordScan *scan, int fd, short lock_type) {
+    scan_begin(scan, fd);
+    scan->yielding = 1;
+    scan->since_yield = 0;
+    scan->lock_type = lock_type;
+}
+
+// File offset just past the last record returned by scan_next
+static off_t scan_offset(RecordScan *scan) {
+    return scan->file_pos - (off_t)(scan->len - scan->pos);
+}
+
+// Hand file_sem to the waiting operations and take it back after them. What
+// the scan had buffered may have changed meanwhile, so it is dropped and the
+// next record read again. fcntl locks belong to the process: a waiter that
+// unlocked or closed the same file dropped the scan's lock too, so that is
+// taken again as well.
+static void scan_yield(RecordScan *scan) {
+    scan->since_yield = 0;
+    if (atomic_load(&file_sem_waiters) == 0) return;
+    unsigned int taken = atomic_load(&file_sem_taken);
+    const char *holder = atomic_load(&file_sem_holder);
+    file_sem_release();
+    // sem_post does not hand over: give a waiter the chance to take it
+    while (atomic_load(&file_sem_taken) == taken && atomic_load(&file_sem_waiters) > 0) sched_yield();
+    file_sem_wait(holder, 0);
+    fcntl_lock(scan->fd, scan->lock_type, 0);
+    scan->file_pos = scan_offset(scan);
+    scan->len = scan->pos = 0;
+}
+
+static int scan_next(RecordScan *scan, void *record, size_t size) {
+    if (scan->yielding && ++scan->since_yield >= SCAN_YIELD_RECORDS) scan_yield(scan);
+    if (!scan->buf) {
+        // No buffer available: fall back to one pread per record
+        if (io_pread_full(scan->fd, record, size, scan->file_pos, -1) != (ssize_t)size) return 0;
+        scan->file_pos += size;
+        return 1;
+    }
+    if (scan->len - scan->pos < size) {
+        size_t left = scan->len - scan->pos;
+        memmove(scan->buf, scan->buf + scan->pos, left);
+        IoOp op = {.opcode = IO_OP_PREAD, .fd = scan->fd, .buf = scan->buf + left, .len = scan->cap - left,
+                   .offset = scan->file_pos, .buf_index = scan->buf_index};
+        io_submit_batch(&op, 1);
+        if (op.result <= 0) return 0;
+        scan->file_pos += op.result;
+        scan->len = left + op.result;
+        scan->pos = 0;
+        if (scan->len < size) return 0; // Truncated trailing record
+    }
+    memcpy(record, scan->buf + scan->pos, size);
+    scan->pos += size;
+    return 1;
+}
+
+// Returns 1 if the credentials match a user of the given role, 0 if not, -1 on error
+// (ERR_LOCK_TIMEOUT if users.dat stayed locked)
+int check_credentials(char *user_id, char *password, enum Role role) {
+    int fd = open("users.dat", O_RDONLY);
+    if (fd < 0) return -1;
+
+    if (lock_file(fd, F_RDLCK, __func__, lock_deadline()) < 0) {
+        close(fd);
+        return ERR_LOCK_TIMEOUT;
+    }
+
+    User user;
+    int authenticated = 0;
+    RecordScan scan;
+    scan_begin(&scan, fd);
+    while (scan_next(&scan, &user, sizeof(User))) {
+        if (strcmp(user.id, user_id) == 0 && strcmp(user.password, password) == 0 && user.role == role) {
+            authenticated = 1;
+            break;
+        }
+    }
+
+    unlock(fd);
+    file_sem_release();
+    close(fd);
+    return authenticated;
+}
+
 int add_user(char *id, char *password, enum Role role) {
     int fd = open("users.dat", O_WRONLY | O_APPEND | O_CREAT, 0644);
     if (fd < 0) return -1;
 
-    sem_wait(&file_sem);
-    write_lock(fd);
+    if (lock_file(fd, F_WRLCK, __func__, lock_deadline()) < 0) {
+        close(fd);
+        return ERR_LOCK_TIMEOUT;
+    }
 
     User user;
     strncpy(user.id, id, MAX_ID);
@@ -71,7 +351,7 @@ int add_user(char *id, char *password, enum Role role) {
     write(fd, &user, sizeof(User));
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
     return 0;
 }
@@ -80,8 +360,10 @@ int add_student(char *id, char *name) {
     int fd = open("students.dat", O_WRONLY | O_APPEND | O_CREAT, 0644);
     if (fd < 0) return -1;
 
-    sem_wait(&file_sem);
-    write_lock(fd);
+    if (lock_file(fd, F_WRLCK, __func__, lock_deadline()) < 0) {
+        close(fd);
+        return ERR_LOCK_TIMEOUT;
+    }
 
     Student student;
     strncpy(student.id, id, MAX_ID);
@@ -92,7 +374,7 @@ int add_student(char *id, char *name) {
     write(fd, &student, sizeof(Student));
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
     return 0;
 }
@@ -101,8 +383,10 @@ int add_faculty(char *id, char *name) {
     int fd = open("faculty.dat", O_WRONLY | O_APPEND | O_CREAT, 0644);
     if (fd < 0) return -1;
 
-    sem_wait(&file_sem);
-    write_lock(fd);
+    if (lock_file(fd, F_WRLCK, __func__, lock_deadline()) < 0) {
+        close(fd);
+        return ERR_LOCK_TIMEOUT;
+    }
 
     Faculty faculty;
     strncpy(faculty.id, id, MAX_ID);
@@ -111,7 +395,7 @@ int add_faculty(char *id, char *name) {
     write(fd, &faculty, sizeof(Faculty));
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
     return 0;
 }
@@ -120,18 +404,21 @@ int activate_deactivate_student(char *id, int activate) {
     int fd = open("students.dat", O_RDWR);
     if (fd < 0) return -1;
 
-    sem_wait(&file_sem);
-    write_lock(fd);
+    if (lock_file(fd, F_WRLCK, __func__, lock_deadline()) < 0) {
+        close(fd);
+        return ERR_LOCK_TIMEOUT;
+    }
 
     Student student;
     off_t pos = 0;
-    while (read(fd, &student, sizeof(Student)) > 0) {
+    RecordScan scan;
+    scan_begin(&scan, fd);
+    while (scan_next(&scan, &student, sizeof(Student))) {
         if (strcmp(student.id, id) == 0) {
             student.active = activate;
-            lseek(fd, pos, SEEK_SET);
-            write(fd, &student, sizeof(Student));
+            io_pwrite_full(fd, &student, sizeof(Student), pos);
             unlock(fd);
-            sem_post(&file_sem);
+            file_sem_release();
             close(fd);
             return 0;
         }
@@ -139,7 +426,7 @@ int activate_deactivate_student(char *id, int activate) {
     }
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
     return -1;
 }
@@ -148,18 +435,21 @@ int update_student(char *id, char *new_name) {
     int fd = open("students.dat", O_RDWR);
     if (fd < 0) return -1;
 
-    sem_wait(&file_sem);
-    write_lock(fd);
+    if (lock_file(fd, F_WRLCK, __func__, lock_deadline()) < 0) {
+        close(fd);
+        return ERR_LOCK_TIMEOUT;
+    }
 
     Student student;
     off_t pos = 0;
-    while (read(fd, &student, sizeof(Student)) > 0) {
+    RecordScan scan;
+    scan_begin(&scan, fd);
+    while (scan_next(&scan, &student, sizeof(Student))) {
         if (strcmp(student.id, id) == 0) {
             strncpy(student.name, new_name, MAX_NAME);
-            lseek(fd, pos, SEEK_SET);
-            write(fd, &student, sizeof(Student));
+            io_pwrite_full(fd, &student, sizeof(Student), pos);
             unlock(fd);
-            sem_post(&file_sem);
+            file_sem_release();
             close(fd);
             return 0;
         }
@@ -167,7 +457,7 @@ int update_student(char *id, char *new_name) {
     }
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
     return -1;
 }
@@ -176,18 +466,21 @@ int update_faculty(char *id, char *new_name) {
     int fd = open("faculty.dat", O_RDWR);
     if (fd < 0) return -1;
 
-    sem_wait(&file_sem);
-    write_lock(fd);
+    if (lock_file(fd, F_WRLCK, __func__, lock_deadline()) < 0) {
+        close(fd);
+        return ERR_LOCK_TIMEOUT;
+    }
 
     Faculty faculty;
     off_t pos = 0;
-    while (read(fd, &faculty, sizeof(Faculty)) > 0) {
+    RecordScan scan;
+    scan_begin(&scan, fd);
+    while (scan_next(&scan, &faculty, sizeof(Faculty))) {
         if (strcmp(faculty.id, id) == 0) {
             strncpy(faculty.name, new_name, MAX_NAME);
-            lseek(fd, pos, SEEK_SET);
-            write(fd, &faculty, sizeof(Faculty));
+            io_pwrite_full(fd, &faculty, sizeof(Faculty), pos);
             unlock(fd);
-            sem_post(&file_sem);
+            file_sem_release();
             close(fd);
             return 0;
         }
@@ -195,24 +488,29 @@ int update_faculty(char *id, char *new_name) {
     }
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
     return -1;
 }
 
 int add_course(char *id, char *name, char *faculty_id, int seats) {
+    if (validate_seats(seats) != 0) return ERR_INVALID_INPUT;
     int fd = open("courses.dat", O_RDWR | O_CREAT, 0644);
     if (fd < 0) return -1;
 
-    sem_wait(&file_sem);
-    write_lock(fd);
+    if (lock_file(fd, F_WRLCK, __func__, lock_deadline()) < 0) {
+        close(fd);
+        return ERR_LOCK_TIMEOUT;
+    }
 
     // Check for duplicate course ID
     Course course;
-    while (read(fd, &course, sizeof(Course)) > 0) {
+    RecordScan scan;
+    scan_begin(&scan, fd);
+    while (scan_next(&scan, &course, sizeof(Course))) {
         if (strcmp(course.id, id) == 0) {
             unlock(fd);
-            sem_post(&file_sem);
+            file_sem_release();
             close(fd);
             return -1; // Duplicate course ID
         }
@@ -227,25 +525,32 @@ int add_course(char *id, char *name, char *faculty_id, int seats) {
     course.enrolled_count = 0;
     memset(course.enrolled_students, 0, sizeof(course.enrolled_students));
 
-    write(fd, &course, sizeof(Course));
+    io_pwrite_full(fd, &course, sizeof(Course), scan_offset(&scan));
+    catalog_changed();
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
     return 0;
 }
 
 int update_course(char *id, char *new_name, int new_seats) {
+    if (validate_seats(new_seats) != 0) return ERR_INVALID_INPUT;
     int fd = open("courses.dat", O_RDWR);
     if (fd < 0) return -1;
 
-    sem_wait(&file_sem);
-    write_lock(fd);
+    if (lock_file(fd, F_WRLCK, __func__, lock_deadline()) < 0) {
+        close(fd);
+        return ERR_LOCK_TIMEOUT;
+    }
 
     Course course;
     off_t pos = 0;
-    while (read(fd, &course, sizeof(Course)) > 0) {
+    RecordScan scan;
+    scan_begin(&scan, fd);
+    while (scan_next(&scan, &course, sizeof(Course))) {
         if (strcmp(course.id, id) == 0) {
+            int seats_moved = course.total_seats != new_seats;
             strncpy(course.name, new_name, MAX_NAME);
             course.total_seats = new_seats;
             if (course.enrolled_count > new_seats) {
@@ -254,18 +559,19 @@ int update_course(char *id, char *new_name, int new_seats) {
                     memset(course.enrolled_students[i], 0, MAX_ID);
                 }
             }
-            lseek(fd, pos, SEEK_SET);
-            write(fd, &course, sizeof(Course));
+            io_pwrite_full(fd, &course, sizeof(Course), pos);
+            catalog_changed();
             unlock(fd);
-            sem_post(&file_sem);
+            file_sem_release();
             close(fd);
+            if (seats_moved) seats_changed(id, course.enrolled_count, new_seats);
             return 0;
         }
         pos += sizeof(Course);
     }
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
     return -1;
 }
@@ -274,13 +580,17 @@ int remove_course(char *id) {
     int fd = open("courses.dat", O_RDWR);
     if (fd < 0) return -1;
 
-    sem_wait(&file_sem);
-    write_lock(fd);
+    if (lock_file(fd, F_WRLCK, __func__, lock_deadline()) < 0) {
+        close(fd);
+        return ERR_LOCK_TIMEOUT;
+    }
 
     Course course;
     off_t pos = 0;
     int found = 0;
-    while (read(fd, &course, sizeof(Course)) > 0) {
+    RecordScan scan;
+    scan_begin(&scan, fd);
+    while (scan_next(&scan, &course, sizeof(Course))) {
         if (strcmp(course.id, id) == 0) {
             found = 1;
             break;
@@ -292,13 +602,13 @@ int remove_course(char *id) {
         int temp_fd = open("courses_temp.dat", O_WRONLY | O_CREAT | O_TRUNC, 0644);
         if (temp_fd < 0) {
             unlock(fd);
-            sem_post(&file_sem);
+            file_sem_release();
             close(fd);
             return -1;
         }
 
-        lseek(fd, 0, SEEK_SET);
-        while (read(fd, &course, sizeof(Course)) > 0) {
+        scan_begin(&scan, fd);
+        while (scan_next(&scan, &course, sizeof(Course))) {
             if (strcmp(course.id, id) != 0) {
                 write(temp_fd, &course, sizeof(Course));
             }
@@ -306,21 +616,24 @@ int remove_course(char *id) {
 
         close(temp_fd);
         rename("courses_temp.dat", "courses.dat");
+        catalog_changed();
     }
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
 
     // Unenroll all students from this course
     int sfd = open("students.dat", O_RDWR);
     if (sfd >= 0) {
-        sem_wait(&file_sem);
-        write_lock(sfd);
+        // The course is gone already: its enrollments are cleared however long that waits
+        lock_file(sfd, F_WRLCK, __func__, 0);
 
         Student student;
         off_t spos = 0;
-        while (read(sfd, &student, sizeof(Student)) > 0) {
+        RecordScan sscan;
+        scan_begin_yielding(&sscan, sfd, F_WRLCK);
+        while (scan_next(&sscan, &student, sizeof(Student))) {
             int changed = 0;
             for (int i = 0; i < MAX_COURSES; i++) {
                 if (strcmp(student.enrolled_courses[i], id) == 0) {
@@ -329,677 +642,512 @@ int remove_course(char *id) {
                 }
             }
             if (changed) {
-                lseek(sfd, spos, SEEK_SET);
-                write(sfd, &student, sizeof(Student));
+                io_pwrite_full(sfd, &student, sizeof(Student), spos);
             }
             spos += sizeof(Student);
         }
 
         unlock(sfd);
-        sem_post(&file_sem);
+        file_sem_release();
         close(sfd);
     }
 
     return found ? 0 : -1;
 }
 
-int enroll_course(char *student_id, char *course_id) {
-    // 1. Open and lock students.dat first to check student status and update their record
+// Apply up to ENROLL_BATCH_MAX enroll/drop changes to one course under a single
+// lock. Each change sees the ones before it, exactly as if they had run one
+// by one, but the Course record and each affected Student record are written
+// once for the whole batch.
+int apply_enrollments(char *course_id, EnrollmentChange *changes, int count) {
+    if (count <= 0 || count > ENROLL_BATCH_MAX) return -1;
     int sfd = open("students.dat", O_RDWR);
     if (sfd < 0) return -1;
-
-    sem_wait(&file_sem);
-    write_lock(sfd);
-
-    Student student;
-    off_t spos = 0;
-    int student_found = 0;
-    int already_enrolled = 0;
-    int empty_slot = -1;
-    while (read(sfd, &student, sizeof(Student)) > 0) {
-        if (strcmp(student.id, student_id) == 0) {
-            student_found = 1;
-            if (!student.active) {
-                unlock(sfd);
-                sem_post(&file_sem);
-                close(sfd);
-                return ERR_INVALID_INPUT; // Student is blocked
-            }
-            // Check if already enrolled
-            for (int i = 0; i < MAX_COURSES; i++) {
-                if (strcmp(student.enrolled_courses[i], course_id) == 0) {
-                    already_enrolled = 1;
-                    break;
-                }
-                if (empty_slot == -1 && student.enrolled_courses[i][0] == '\0') {
-                    empty_slot = i;
-                }
-            }
-            break;
-        }
-        spos += sizeof(Student);
-    }
-
-    if (!student_found) {
-        unlock(sfd);
-        sem_post(&file_sem);
-        close(sfd);
-        return ERR_NOT_FOUND; // Student does not exist
-    }
-    if (already_enrolled) {
-        unlock(sfd);
-        sem_post(&file_sem);
+    int cfd = open("courses.dat", O_RDWR);
+    if (cfd < 0) {
         close(sfd);
-        return ERR_ALREADY_ENROLLED;
+        return -1;
     }
-    if (empty_slot == -1) {
-        unlock(sfd);
-        sem_post(&file_sem);
+
+    // students.dat, then courses.dat
+    uint64_t deadline = lock_deadline();
+    if (lock_file(sfd, F_WRLCK, __func__, deadline) < 0) {
+        close(cfd);
         close(sfd);
-        return ERR_FULL; // No slot for more courses
+        return ERR_LOCK_TIMEOUT;
     }
-
-    // 2. Now open and lock courses.dat, check course existence and seat availability
-    int cfd = open("courses.dat", O_RDWR);
-    if (cfd < 0) {
+    if (fcntl_lock(cfd, F_WRLCK, deadline) < 0 && errno == ETIMEDOUT) {
         unlock(sfd);
-        sem_post(&file_sem);
+        file_sem_release();
+        close(cfd);
         close(sfd);
-        return -1;
+        return ERR_LOCK_TIMEOUT;
     }
-    write_lock(cfd);
 
     Course course;
     off_t cpos = 0;
     int course_found = 0;
-    int course_full = 0;
-    int course_already = 0;
-    while (read(cfd, &course, sizeof(Course)) > 0) {
+    RecordScan scan;
+    scan_begin(&scan, cfd);
+    while (scan_next(&scan, &course, sizeof(Course))) {
         if (strcmp(course.id, course_id) == 0) {
             course_found = 1;
-            if (course.enrolled_count >= course.total_seats) {
-                course_full = 1;
-                break;
-            }
-            for (int i = 0; i < course.enrolled_count; i++) {
-                if (strcmp(course.enrolled_students[i], student_id) == 0) {
-                    course_already = 1;
-                    break;
-                }
-            }
             break;
         }
         cpos += sizeof(Course);
     }
 
-    if (!course_found) {
-        unlock(cfd);
-        unlock(sfd);
-        sem_post(&file_sem);
-        close(cfd);
-        close(sfd);
-        return ERR_COURSE_NOT_FOUND;
-    }
-    if (course_full) {
-        unlock(cfd);
-        unlock(sfd);
-        sem_post(&file_sem);
-        close(cfd);
-        close(sfd);
-        return ERR_FULL;
-    }
-    if (course_already) {
-        unlock(cfd);
-        unlock(sfd);
-        sem_post(&file_sem);
-        close(cfd);
-        close(sfd);
-        return ERR_ALREADY_ENROLLED;
-    }
-
-    // 3. Update both records
-    // Update student
-    strncpy(student.enrolled_courses[empty_slot], course_id, MAX_ID);
-    lseek(sfd, spos, SEEK_SET);
-    write(sfd, &student, sizeof(Student));
-
-    // Update course
-    strncpy(course.enrolled_students[course.enrolled_count], student_id, MAX_ID);
-    course.enrolled_count++;
-    lseek(cfd, cpos, SEEK_SET);
-    write(cfd, &course, sizeof(Course));
-
-    unlock(cfd);
-    close(cfd);
-    unlock(sfd);
-    sem_post(&file_sem);
-    close(sfd);
+    // The students named in the batch, read in one pass over students.dat
+    Student students[ENROLL_BATCH_MAX];
+    off_t spos[ENROLL_BATCH_MAX];
+    int dirty[ENROLL_BATCH_MAX] = {0};
+    int slot_of[ENROLL_BATCH_MAX];
+    int loaded = 0, unresolved = count;
+    for (int i = 0; i < count; i++) slot_of[i] = -1;
 
-    return 0;
-}
-
-int unenroll_course(char *student_id, char *course_id) {
-    int fd = open("courses.dat", O_RDWR);
-    if (fd < 0) return -1;
-
-    sem_wait(&file_sem);
-    write_lock(fd);
-
-    Course course;
+    Student student;
     off_t pos = 0;
-    while (read(fd, &course, sizeof(Course)) > 0) {
-        if (strcmp(course.id, course_id) == 0) {
-            for (int i = 0; i < course.enrolled_count; i++) {
-                if (strcmp(course.enrolled_students[i], student_id) == 0) {
-                    for (int j = i; j < course.enrolled_count - 1; j++) {
-                        strncpy(course.enrolled_students[j], course.enrolled_students[j + 1], MAX_ID);
+    scan_begin(&scan, sfd);
+    while (unresolved > 0 && scan_next(&scan, &student, sizeof(Student))) {
+        int slot = -1;
+        for (int i = 0; i < count; i++) {
+            if (slot_of[i] != -1 || strcmp(changes[i].student_id, student.id) != 0) continue;
+            if (slot == -1) {
+                slot = loaded++;
+                students[slot] = student;
+                spos[slot] = pos;
+            }
+            slot_of[i] = slot;
+            unresolved--;
+        }
+        pos += sizeof(Student);
+    }
+
+    int course_dirty = 0;
+    int enrolled_before = course_found ? course.enrolled_count : 0;
+    for (int i = 0; i < count; i++) {
+        EnrollmentChange *change = &changes[i];
+        Student *s = slot_of[i] >= 0 ? &students[slot_of[i]] : NULL;
+
+        if (!change->enroll) {
+            // Drop: take the student off the course list, then the course off the student
+            for (int j = 0; course_found && j < course.enrolled_count; j++) {
+                if (strcmp(course.enrolled_students[j], change->student_id) == 0) {
+                    for (int k = j; k < course.enrolled_count - 1; k++) {
+                        strncpy(course.enrolled_students[k], course.enrolled_students[k + 1], MAX_ID);
                     }
                     course.enrolled_count--;
-                    lseek(fd, pos, SEEK_SET);
-                    write(fd, &course, sizeof(Course));
+                    course_dirty = 1;
                     break;
                 }
             }
-            break;
+            change->result = s ? ERR_NOT_ENROLLED : -1;
+            for (int j = 0; s && j < MAX_COURSES; j++) {
+                if (strcmp(s->enrolled_courses[j], course_id) == 0) {
+                    memset(s->enrolled_courses[j], 0, MAX_ID);
+                    dirty[slot_of[i]] = 1;
+                    change->result = 0;
+                    break;
+                }
+            }
+            continue;
         }
-        pos += sizeof(Course);
-    }
-
-    unlock(fd);
-    sem_post(&file_sem);
-    close(fd);
 
-    // Update student's enrolled courses
-    fd = open("students.dat", O_RDWR);
-    if (fd < 0) return -1;
+        if (!s) {
+            change->result = ERR_NOT_FOUND;
+            continue;
+        }
+        if (!s->active) {
+            change->result = ERR_INVALID_INPUT;
+            continue;
+        }
+        int already_enrolled = 0;
+        int empty_slot = -1;
+        for (int j = 0; j < MAX_COURSES; j++) {
+            if (strcmp(s->enrolled_courses[j], course_id) == 0) {
+                already_enrolled = 1;
+                break;
+            }
+            if (empty_slot == -1 && s->enrolled_courses[j][0] == '\0') empty_slot = j;
+        }
+        int course_already = 0;
+        for (int j = 0; course_found && j < course.enrolled_count; j++) {
+            if (strcmp(course.enrolled_students[j], change->student_id) == 0) course_already = 1;
+        }
 
-    sem_wait(&file_sem);
-    write_lock(fd);
+        if (already_enrolled) {
+            change->result = ERR_ALREADY_ENROLLED;
+        } else if (empty_slot == -1) {
+            change->result = ERR_FULL;
+        } else if (!course_found) {
+            change->result = ERR_COURSE_NOT_FOUND;
+        } else if (course.enrolled_count >= course.total_seats) {
+            change->result = ERR_FULL;
+        } else if (course_already) {
+            change->result = ERR_ALREADY_ENROLLED;
+        } else {
+            strncpy(s->enrolled_courses[empty_slot], course_id, MAX_ID);
+            strncpy(course.enrolled_students[course.enrolled_count], change->student_id, MAX_ID);
+            course.enrolled_count++;
+            dirty[slot_of[i]] = 1;
+            course_dirty = 1;
+            change->result = 0;
+        }
+    }
 
-    Student student;
-    pos = 0;
-    while (read(fd, &student, sizeof(Student)) > 0) {
-        if (strcmp(student.id, student_id) == 0) {
-            for (int i = 0; i < MAX_COURSES; i++) {
-                if (strcmp(student.enrolled_courses[i], course_id) == 0) {
-                    memset(student.enrolled_courses[i], 0, MAX_ID);
-                    lseek(fd, pos, SEEK_SET);
-                    write(fd, &student, sizeof(Student));
-                    unlock(fd);
-                    sem_post(&file_sem);
-                    close(fd);
-                    return 0;
-                }
-            }
-            unlock(fd);
-            sem_post(&file_sem);
-            close(fd);
-            return ERR_NOT_ENROLLED;
+    // Every modified record goes to the kernel in one submission
+    IoOp writes[ENROLL_BATCH_MAX + 1];
+    int write_slot[ENROLL_BATCH_MAX + 1];   // Student slot written, -1 for the course
+    int nwrites = 0;
+    if (course_dirty) {
+        write_slot[nwrites] = -1;
+        writes[nwrites++] = (IoOp){.opcode = IO_OP_PWRITE, .fd = cfd, .buf = &course, .len = sizeof(Course),
+                                   .offset = cpos, .buf_index = -1};
+    }
+    for (int i = 0; i < loaded; i++) {
+        if (!dirty[i]) continue;
+        write_slot[nwrites] = i;
+        writes[nwrites++] = (IoOp){.opcode = IO_OP_PWRITE, .fd = sfd, .buf = &students[i], .len = sizeof(Student),
+                                   .offset = spos[i], .buf_index = -1};
+    }
+    if (nwrites > 0) io_submit_batch(writes, nwrites);
+    for (int i = 0; i < nwrites; i++) {
+        // Finish short writes; a failed one (or one whose outcome is unknown)
+        // is redone whole, as writing the record again at its offset is harmless
+        ssize_t done = writes[i].result > 0 ? writes[i].result : 0;
+        if ((size_t)done >= writes[i].len) continue;
+        if (io_pwrite_full(writes[i].fd, (char *)writes[i].buf + done, writes[i].len - done,
+                           writes[i].offset + done) >= 0) {
+            continue;
+        }
+        log_write(LOG_ERROR, "Server: Failed to write %s for enrollments in %s, errno=%d\n",
+                  write_slot[i] < 0 ? "courses.dat" : "students.dat", course_id, errno);
+        // Every change this record carried failed with it
+        for (int j = 0; j < count; j++) {
+            if (changes[j].result == 0 && (write_slot[i] < 0 || slot_of[j] == write_slot[i])) changes[j].result = -1;
         }
-        pos += sizeof(Student);
     }
+    if (course_dirty) catalog_changed();
 
-    unlock(fd);
-    sem_post(&file_sem);
-    close(fd);
-    return -1;
+    unlock(cfd);
+    close(cfd);
+    unlock(sfd);
+    file_sem_release();
+    close(sfd);
+    // Seats that drops freed and the batch's own enrollments did not take again
+    if (course_found && course.enrolled_count < enrolled_before) {
+        seats_changed(course_id, course.enrolled_count, course.total_seats);
+    }
+    return 0;
 }
 
-char *view_enrolled_courses(char *student_id) {
+char *view_enrolled_courses(char *student_id, Arena *arena, int *status) {
     int fd = open("students.dat", O_RDONLY);
     if (fd < 0) {
         printf("Server: Failed to open students.dat, errno=%d\n", errno);
+        *status = -1;
         return NULL;
     }
 
-    sem_wait(&file_sem);
-    read_lock(fd);
-
-    size_t buffer_size = 2048;
-    char *result = malloc(buffer_size);
-    if (!result) {
-        printf("Server: Failed to allocate memory for result in view_enrolled_courses\n");
-        unlock(fd);
-        sem_post(&file_sem);
+    if (lock_file(fd, F_RDLCK, __func__, lock_deadline()) < 0) {
         close(fd);
+        *status = ERR_LOCK_TIMEOUT;
         return NULL;
     }
-    snprintf(result, buffer_size, "Enrolled Courses:\n");
 
     Student student;
     int found = 0;
-    while (read(fd, &student, sizeof(Student)) > 0) {
+    RecordScan scan;
+    scan_begin(&scan, fd);
+    while (scan_next(&scan, &student, sizeof(Student))) {
         if (strcmp(student.id, student_id) == 0) {
             found = 1;
-            int count = 1;
-            for (int i = 0; i < MAX_COURSES; i++) {
-                if (student.enrolled_courses[i][0] != '\0') {
-                    char course_info[100];
-                    snprintf(course_info, sizeof(course_info), "%d. %s\n", count++, student.enrolled_courses[i]);
-                    size_t needed_size = strlen(result) + strlen(course_info) + 1;
-                    if (needed_size > buffer_size) {
-                        buffer_size = needed_size + 1024;
-                        char *new_result = realloc(result, buffer_size);
-                        if (!new_result) {
-                            printf("Server: Failed to reallocate memory for result in view_enrolled_courses\n");
-                            free(result);
-                            unlock(fd);
-                            sem_post(&file_sem);
-                            close(fd);
-                            return NULL;
-                        }
-                        result = new_result;
-                    }
-                    strcat(result, course_info);
-                }
-            }
-            if (count == 1) {
-                size_t needed_size = strlen(result) + strlen("No courses enrolled.\n") + 1;
-                if (needed_size > buffer_size) {
-                    buffer_size = needed_size + 1024;
-                    char *new_result = realloc(result, buffer_size);
-                    if (!new_result) {
-                        printf("Server: Failed to reallocate memory for result in view_enrolled_courses\n");
-                        free(result);
-                        unlock(fd);
-                        sem_post(&file_sem);
-                        close(fd);
-                        return NULL;
-                    }
-                    result = new_result;
-                }
-                strcat(result, "No courses enrolled.\n");
-            }
             break;
         }
     }
 
-    if (!found) {
-        size_t needed_size = strlen("Student not found\n") + 1;
-        if (needed_size > buffer_size) {
-            buffer_size = needed_size + 1024;
-            char *new_result = realloc(result, buffer_size);
-            if (!new_result) {
-                printf("Server: Failed to reallocate memory for result in view_enrolled_courses\n");
-                free(result);
-                unlock(fd);
-                sem_post(&file_sem);
-                close(fd);
-                return NULL;
+    unlock(fd);
+    file_sem_release();
+    close(fd);
+
+    StrBuf text;
+    strbuf_begin(&text, arena);
+    if (found) {
+        strbuf_puts(&text, "Enrolled Courses:\n");
+        int count = 1;
+        for (int i = 0; i < MAX_COURSES; i++) {
+            if (student.enrolled_courses[i][0] != '\0') {
+                strbuf_printf(&text, "%d. %s\n", count++, student.enrolled_courses[i]);
             }
-            result = new_result;
         }
-        strcpy(result, "Student not found\n");
+        if (count == 1) strbuf_puts(&text, "No courses enrolled.\n");
+    } else {
+        strbuf_puts(&text, "Student not found\n");
     }
-
-    unlock(fd);
-    sem_post(&file_sem);
-    close(fd);
+    char *result = strbuf_end(&text, NULL);
+    if (!result) printf("Server: Failed to allocate memory for result in view_enrolled_courses\n");
+    *status = result ? 0 : -1;
     return result;
 }
 
-char *view_course_enrollments(char *course_id) {
+char *view_course_enrollments(char *course_id, Arena *arena, int *status) {
     int fd = open("courses.dat", O_RDONLY);
     if (fd < 0) {
         printf("Server: Failed to open courses.dat, errno=%d\n", errno);
+        *status = -1;
         return NULL;
     }
 
-    sem_wait(&file_sem);
-    read_lock(fd);
-
-    size_t buffer_size = 2048;
-    char *result = malloc(buffer_size);
-    if (!result) {
-        printf("Server: Failed to allocate memory for result in view_course_enrollments\n");
-        unlock(fd);
-        sem_post(&file_sem);
+    if (lock_file(fd, F_RDLCK, __func__, lock_deadline()) < 0) {
         close(fd);
+        *status = ERR_LOCK_TIMEOUT;
         return NULL;
     }
-    snprintf(result, buffer_size, "Enrollments for Course %s:\n", course_id);
 
     Course course;
     int found = 0;
-    while (read(fd, &course, sizeof(Course)) > 0) {
+    RecordScan scan;
+    scan_begin(&scan, fd);
+    while (scan_next(&scan, &course, sizeof(Course))) {
         if (strcmp(course.id, course_id) == 0) {
             found = 1;
-            int count = 1;
-            for (int i = 0; i < course.enrolled_count; i++) {
-                char student_info[100];
-                snprintf(student_info, sizeof(student_info), "%d. %s\n", count++, course.enrolled_students[i]);
-                size_t needed_size = strlen(result) + strlen(student_info) + 1;
-                if (needed_size > buffer_size) {
-                    buffer_size = needed_size + 1024;
-                    char *new_result = realloc(result, buffer_size);
-                    if (!new_result) {
-                        printf("Server: Failed to reallocate memory for result in view_course_enrollments\n");
-                        free(result);
-                        unlock(fd);
-                        sem_post(&file_sem);
-                        close(fd);
-                        return NULL;
-                    }
-                    result = new_result;
-                }
-                strcat(result, student_info);
-            }
-            if (count == 1) {
-                size_t needed_size = strlen(result) + strlen("No students enrolled.\n") + 1;
-                if (needed_size > buffer_size) {
-                    buffer_size = needed_size + 1024;
-                    char *new_result = realloc(result, buffer_size);
-                    if (!new_result) {
-                        printf("Server: Failed to reallocate memory for result in view_course_enrollments\n");
-                        free(result);
-                        unlock(fd);
-                        sem_post(&file_sem);
-                        close(fd);
-                        return NULL;
-                    }
-                    result = new_result;
-                }
-                strcat(result, "No students enrolled.\n");
-            }
             break;
         }
     }
 
-    if (!found) {
-        size_t needed_size = strlen("Course not found\n") + 1;
-        if (needed_size > buffer_size) {
-            buffer_size = needed_size + 1024;
-            char *new_result = realloc(result, buffer_size);
-            if (!new_result) {
-                printf("Server: Failed to reallocate memory for result in view_course_enrollments\n");
-                free(result);
-                unlock(fd);
-                sem_post(&file_sem);
-                close(fd);
-                return NULL;
-            }
-            result = new_result;
-        }
-        strcpy(result, "Course not found\n");
-    }
-
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
+
+    StrBuf text;
+    strbuf_begin(&text, arena);
+    if (found) {
+        strbuf_printf(&text, "Enrollments for Course %s:\n", course_id);
+        for (int i = 0; i < course.enrolled_count; i++) {
+            strbuf_printf(&text, "%d. %s\n", i + 1, course.enrolled_students[i]);
+        }
+        if (course.enrolled_count == 0) strbuf_puts(&text, "No students enrolled.\n");
+    } else {
+        strbuf_puts(&text, "Course not found\n");
+    }
+    char *result = strbuf_end(&text, NULL);
+    if (!result) printf("Server: Failed to allocate memory for result in view_course_enrollments\n");
+    *status = result ? 0 : -1;
     return result;
 }
 
-char *view_all_courses() {
+// Render the catalog into arena; *generation is the catalog generation it shows
+static char *render_all_courses(Arena *arena, size_t *len, uint64_t *generation, int *status) {
     int fd = open("courses.dat", O_RDONLY);
     if (fd < 0) {
         printf("Server: Failed to open courses.dat, errno=%d\n", errno);
+        *status = -1;
         return NULL;
     }
 
-    sem_wait(&file_sem);
-    read_lock(fd);
-
-    size_t buffer_size = 2048;
-    char *result = malloc(buffer_size);
-    if (!result) {
-        printf("Server: Failed to allocate memory for result in view_all_courses\n");
-        unlock(fd);
-        sem_post(&file_sem);
+    if (lock_file(fd, F_RDLCK, __func__, lock_deadline()) < 0) {
         close(fd);
+        *status = ERR_LOCK_TIMEOUT;
         return NULL;
     }
-    strcpy(result, "All Available Courses:\n");
+    *generation = atomic_load(&catalog_generation);
+
+    StrBuf text;
+    strbuf_begin(&text, arena);
+    strbuf_puts(&text, "All Available Courses:\n");
 
     Course course;
     int count = 1;
-    while (read(fd, &course, sizeof(Course)) > 0) {
-        char course_info[200];
-        snprintf(course_info, sizeof(course_info), "%d. ID: %s, Name: %s, Faculty ID: %s, Seats: %d, Enrolled: %d\n",
-                 count++, course.id, course.name, course.faculty_id, course.total_seats, course.enrolled_count);
-        size_t needed_size = strlen(result) + strlen(course_info) + 1;
-        if (needed_size > buffer_size) {
-            buffer_size = needed_size + 1024;
-            char *new_result = realloc(result, buffer_size);
-            if (!new_result) {
-                printf("Server: Failed to reallocate memory for result in view_all_courses\n");
-                free(result);
-                unlock(fd);
-                sem_post(&file_sem);
-                close(fd);
-                return NULL;
-            }
-            result = new_result;
-        }
-        strcat(result, course_info);
-    }
-
-    if (count == 1) {
-        size_t needed_size = strlen(result) + strlen("No courses available.\n") + 1;
-        if (needed_size > buffer_size) {
-            buffer_size = needed_size + 1024;
-            char *new_result = realloc(result, buffer_size);
-            if (!new_result) {
-                printf("Server: Failed to reallocate memory for result in view_all_courses\n");
-                free(result);
-                unlock(fd);
-                sem_post(&file_sem);
-                close(fd);
-                return NULL;
-            }
-            result = new_result;
-        }
-        strcat(result, "No courses available.\n");
+    RecordScan scan;
+    scan_begin(&scan, fd);
+    while (scan_next(&scan, &course, sizeof(Course))) {
+        strbuf_printf(&text, "%d. ID: %s, Name: %s, Faculty ID: %s, Seats: %d, Enrolled: %d\n",
+                      count++, course.id, course.name, course.faculty_id, course.total_seats, course.enrolled_count);
     }
+    if (count == 1) strbuf_puts(&text, "No courses available.\n");
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
+    char *result = strbuf_end(&text, len);
+    if (!result) printf("Server: Failed to allocate memory for result in view_all_courses\n");
+    *status = result ? 0 : -1;
     return result;
 }
 
-char *view_faculty_courses(char *faculty_id) {
+// Render the courses of one faculty member, like render_all_courses
+static char *render_faculty_courses(char *faculty_id, Arena *arena, size_t *len, uint64_t *generation,
+                                    int *status) {
     int fd = open("courses.dat", O_RDONLY);
     if (fd < 0) {
         printf("Server: Failed to open courses.dat, errno=%d\n", errno);
+        *status = -1;
         return NULL;
     }
 
-    sem_wait(&file_sem);
-    read_lock(fd);
-
-    size_t buffer_size = 2048;
-    char *result = malloc(buffer_size);
-    if (!result) {
-        printf("Server: Failed to allocate memory for result in view_faculty_courses\n");
-        unlock(fd);
-        sem_post(&file_sem);
+    if (lock_file(fd, F_RDLCK, __func__, lock_deadline()) < 0) {
         close(fd);
+        *status = ERR_LOCK_TIMEOUT;
         return NULL;
     }
-    snprintf(result, buffer_size, "Courses Offered by Faculty %s:\n", faculty_id);
+    *generation = atomic_load(&catalog_generation);
+
+    StrBuf text;
+    strbuf_begin(&text, arena);
+    strbuf_printf(&text, "Courses Offered by Faculty %s:\n", faculty_id);
 
     Course course;
     int count = 1;
-    while (read(fd, &course, sizeof(Course)) > 0) {
+    RecordScan scan;
+    scan_begin(&scan, fd);
+    while (scan_next(&scan, &course, sizeof(Course))) {
         if (strcmp(course.faculty_id, faculty_id) == 0) {
-            char course_info[200];
-            snprintf(course_info, sizeof(course_info), "%d. ID: %s, Name: %s, Seats: %d, Enrolled: %d\n",
-                     count++, course.id, course.name, course.total_seats, course.enrolled_count);
-            size_t needed_size = strlen(result) + strlen(course_info) + 1;
-            if (needed_size > buffer_size) {
-                buffer_size = needed_size + 1024;
-                char *new_result = realloc(result, buffer_size);
-                if (!new_result) {
-                    printf("Server: Failed to reallocate memory for result in view_faculty_courses\n");
-                    free(result);
-                    unlock(fd);
-                    sem_post(&file_sem);
-                    close(fd);
-                    return NULL;
-                }
-                result = new_result;
-            }
-            strcat(result, course_info);
+            strbuf_printf(&text, "%d. ID: %s, Name: %s, Seats: %d, Enrolled: %d\n",
+                          count++, course.id, course.name, course.total_seats, course.enrolled_count);
         }
     }
-
-    if (count == 1) {
-        size_t needed_size = strlen(result) + strlen("No courses offered.\n") + 1;
-        if (needed_size > buffer_size) {
-            buffer_size = needed_size + 1024;
-            char *new_result = realloc(result, buffer_size);
-            if (!new_result) {
-                printf("Server: Failed to reallocate memory for result in view_faculty_courses\n");
-                free(result);
-                unlock(fd);
-                sem_post(&file_sem);
-                close(fd);
-                return NULL;
-            }
-            result = new_result;
-        }
-        strcat(result, "No courses offered.\n");
-    }
+    if (count == 1) strbuf_puts(&text, "No courses offered.\n");
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
+    char *result = strbuf_end(&text, len);
+    if (!result) printf("Server: Failed to allocate memory for result in view_faculty_courses\n");
+    *status = result ? 0 : -1;
     return result;
 }
 
-char *view_all_students() {
+// Cached listing for key, rendering it on a miss. Returns a memfd as
+// described for view_all_courses_listing, or -1 and the text in *text; the
+// version it shows goes to version unless that is NULL.
+static int course_listing(const char *key, char *faculty_id, size_t *len, char **text, char *version, Arena *arena,
+                          int *status) {
+    *text = NULL;
+    *status = 0;
+    uint64_t generation = atomic_load(&catalog_generation);
+    int fd = listing_cache_get(key, generation, len);
+    metrics_record_cache(METRICS_CACHE_CATALOG, fd >= 0);
+    if (fd >= 0) {
+        if (version) format_catalog_version(generation, version);
+        return fd;
+    }
+
+    char *rendered = faculty_id ? render_faculty_courses(faculty_id, arena, len, &generation, status)
+                                : render_all_courses(arena, len, &generation, status);
+    if (!rendered) return -1;
+    if (version) format_catalog_version(generation, version);
+    fd = listing_cache_store(key, generation, rendered, *len);
+    if (fd < 0) *text = rendered;
+    return fd;
+}
+
+// Text form of a course listing, for callers that cannot send a memfd
+static char *course_listing_text(const char *key, char *faculty_id, Arena *arena, int *status) {
+    size_t len;
+    char *text;
+    int fd = course_listing(key, faculty_id, &len, &text, NULL, arena, status);
+    if (fd < 0) return text;
+    text = listing_read_text(fd, len, arena);
+    close(fd);
+    if (!text) *status = -1;
+    return text;
+}
+
+static void faculty_listing_key(char *key, const char *faculty_id) {
+    snprintf(key, LISTING_KEY_MAX, "faculty/%s", faculty_id);
+}
+
+char *view_all_courses(Arena *arena, int *status) {
+    return course_listing_text("catalog", NULL, arena, status);
+}
+
+int view_all_courses_listing(size_t *len, char **text, char *version, Arena *arena, int *status) {
+    return course_listing("catalog", NULL, len, text, version, arena, status);
+}
+
+char *view_faculty_courses(char *faculty_id, Arena *arena, int *status) {
+    char key[LISTING_KEY_MAX];
+    faculty_listing_key(key, faculty_id);
+    return course_listing_text(key, faculty_id, arena, status);
+}
+
+int view_faculty_courses_listing(char *faculty_id, size_t *len, char **text, char *version, Arena *arena,
+                                 int *status) {
+    char key[LISTING_KEY_MAX];
+    faculty_listing_key(key, faculty_id);
+    return course_listing(key, faculty_id, len, text, version, arena, status);
+}
+
+char *view_all_students(Arena *arena, int *status) {
     int fd = open("students.dat", O_RDONLY);
     if (fd < 0) {
         printf("Server: Failed to open students.dat, errno=%d\n", errno);
+        *status = -1;
         return NULL;
     }
 
-    sem_wait(&file_sem);
-    read_lock(fd);
-
-    size_t buffer_size = 2048;
-    char *result = malloc(buffer_size);
-    if (!result) {
-        printf("Server: Failed to allocate memory for result in view_all_students\n");
-        unlock(fd);
-        sem_post(&file_sem);
+    if (lock_file(fd, F_RDLCK, __func__, lock_deadline()) < 0) {
         close(fd);
+        *status = ERR_LOCK_TIMEOUT;
         return NULL;
     }
-    strcpy(result, "All Students:\n");
+
+    StrBuf text;
+    strbuf_begin(&text, arena);
+    strbuf_puts(&text, "All Students:\n");
 
     Student student;
     int count = 1;
-    while (read(fd, &student, sizeof(Student)) > 0) {
-        char student_info[200];
-        snprintf(student_info, sizeof(student_info), "%d. ID: %s, Name: %s, Status: %s\n",
-                 count++, student.id, student.name, student.active ? "Active" : "Blocked");
-        size_t needed_size = strlen(result) + strlen(student_info) + 1;
-        if (needed_size > buffer_size) {
-            buffer_size = needed_size + 1024;
-            char *new_result = realloc(result, buffer_size);
-            if (!new_result) {
-                printf("Server: Failed to reallocate memory for result in view_all_students\n");
-                free(result);
-                unlock(fd);
-                sem_post(&file_sem);
-                close(fd);
-                return NULL;
-            }
-            result = new_result;
-        }
-        strcat(result, student_info);
-    }
-
-    if (count == 1) {
-        size_t needed_size = strlen(result) + strlen("No students available.\n") + 1;
-        if (needed_size > buffer_size) {
-            buffer_size = needed_size + 1024;
-            char *new_result = realloc(result, buffer_size);
-            if (!new_result) {
-                printf("Server: Failed to reallocate memory for result in view_all_students\n");
-                free(result);
-                unlock(fd);
-                sem_post(&file_sem);
-                close(fd);
-                return NULL;
-            }
-            result = new_result;
-        }
-        strcat(result, "No students available.\n");
+    RecordScan scan;
+    scan_begin_yielding(&scan, fd, F_RDLCK);
+    while (scan_next(&scan, &student, sizeof(Student))) {
+        strbuf_printf(&text, "%d. ID: %s, Name: %s, Status: %s\n",
+                      count++, student.id, student.name, student.active ? "Active" : "Blocked");
     }
+    if (count == 1) strbuf_puts(&text, "No students available.\n");
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
+    char *result = strbuf_end(&text, NULL);
+    if (!result) printf("Server: Failed to allocate memory for result in view_all_students\n");
+    *status = result ? 0 : -1;
     return result;
 }
 
-char *view_all_faculty() {
+char *view_all_faculty(Arena *arena, int *status) {
     int fd = open("faculty.dat", O_RDONLY);
     if (fd < 0) {
         printf("Server: Failed to open faculty.dat, errno=%d\n", errno);
+        *status = -1;
         return NULL;
     }
 
-    sem_wait(&file_sem);
-    read_lock(fd);
-
-    size_t buffer_size = 2048;
-    char *result = malloc(buffer_size);
-    if (!result) {
-        printf("Server: Failed to allocate memory for result in view_all_faculty\n");
-        unlock(fd);
-        sem_post(&file_sem);
+    if (lock_file(fd, F_RDLCK, __func__, lock_deadline()) < 0) {
         close(fd);
+        *status = ERR_LOCK_TIMEOUT;
         return NULL;
     }
-    strcpy(result, "All Faculty:\n");
+
+    StrBuf text;
+    strbuf_begin(&text, arena);
+    strbuf_puts(&text, "All Faculty:\n");
 
     Faculty faculty;
     int count = 1;
-    while (read(fd, &faculty, sizeof(Faculty)) > 0) {
-        char faculty_info[200];
-        snprintf(faculty_info, sizeof(faculty_info), "%d. ID: %s, Name: %s\n",
-                 count++, faculty.id, faculty.name);
-        size_t needed_size = strlen(result) + strlen(faculty_info) + 1;
-        if (needed_size > buffer_size) {
-            buffer_size = needed_size + 1024;
-            char *new_result = realloc(result, buffer_size);
-            if (!new_result) {
-                printf("Server: Failed to reallocate memory for result in view_all_faculty\n");
-                free(result);
-                unlock(fd);
-                sem_post(&file_sem);
-                close(fd);
-                return NULL;
-            }
-            result = new_result;
-        }
-        strcat(result, faculty_info);
-    }
-
-    if (count == 1) {
-        size_t needed_size = strlen(result) + strlen("No faculty available.\n") + 1;
-        if (needed_size > buffer_size) {
-            buffer_size = needed_size + 1024;
-            char *new_result = realloc(result, buffer_size);
-            if (!new_result) {
-                printf("Server: Failed to reallocate memory for result in view_all_faculty\n");
-                free(result);
-                unlock(fd);
-                sem_post(&file_sem);
-                close(fd);
-                return NULL;
-            }
-            result = new_result;
-        }
-        strcat(result, "No faculty available.\n");
+    RecordScan scan;
+    scan_begin_yielding(&scan, fd, F_RDLCK);
+    while (scan_next(&scan, &faculty, sizeof(Faculty))) {
+        strbuf_printf(&text, "%d. ID: %s, Name: %s\n", count++, faculty.id, faculty.name);
     }
+    if (count == 1) strbuf_puts(&text, "No faculty available.\n");
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
+    char *result = strbuf_end(&text, NULL);
+    if (!result) printf("Server: Failed to allocate memory for result in view_all_faculty\n");
+    *status = result ? 0 : -1;
     return result;
 }
 
@@ -1007,18 +1155,21 @@ int change_password(char *user_id, char *new_password) {
     int fd = open("users.dat", O_RDWR);
     if (fd < 0) return -1;
 
-    sem_wait(&file_sem);
-    write_lock(fd);
+    if (lock_file(fd, F_WRLCK, __func__, lock_deadline()) < 0) {
+        close(fd);
+        return ERR_LOCK_TIMEOUT;
+    }
 
     User user;
     off_t pos = 0;
-    while (read(fd, &user, sizeof(User)) > 0) {
+    RecordScan scan;
+    scan_begin(&scan, fd);
+    while (scan_next(&scan, &user, sizeof(User))) {
         if (strcmp(user.id, user_id) == 0) {
             strncpy(user.password, new_password, MAX_PASS);
-            lseek(fd, pos, SEEK_SET);
-            write(fd, &user, sizeof(User));
+            io_pwrite_full(fd, &user, sizeof(User), pos);
             unlock(fd);
-            sem_post(&file_sem);
+            file_sem_release();
             close(fd);
             return 0;
         }
@@ -1026,7 +1177,7 @@ int change_password(char *user_id, char *new_password) {
     }
 
     unlock(fd);
-    sem_post(&file_sem);
+    file_sem_release();
     close(fd);
     return -1;
 }
@@ -0,0 +1,356 @@
+#include "academia.h"
+#include "framed_io.h"
+#include <arpa/inet.h>
+#include <sys/sendfile.h>
+
+// Read buffer a nonblocking connection gave back, for the next one of this thread
+static _Thread_local char *spare_rbuf;
+
+// Default writer: sendmsg() until every iovec is out
+static ssize_t socket_writer(int fd, struct iovec *iov, int iovcnt) {
+    size_t total = 0;
+    while (iovcnt > 0) {
+        struct msghdr msg = {.msg_iov = iov, .msg_iovlen = iovcnt};
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n == 0) errno = EPIPE;
+            return -1;
+        }
+        total += n;
+
+        // Skip the fully sent iovecs and trim the partially sent one
+        size_t sent = n;
+        while (iovcnt > 0 && sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return total;
+}
+
+int framed_init(FramedConn *conn, int fd, FramedWriter writer) {
+    conn->fd = fd;
+    conn->writer = writer ? writer : socket_writer;
+    conn->rpos = conn->rlen = 0;
+    conn->wbuf = NULL;
+    conn->wlen = conn->wcap = 0;
+    conn->corked = 0;
+    conn->nonblocking = 0;
+    conn->rbuf = malloc(FRAMED_READ_BUFFER);
+    return conn->rbuf ? 0 : -1;
+}
+
+void framed_init_nonblocking(FramedConn *conn, int fd) {
+    conn->fd = fd;
+    conn->writer = socket_writer;
+    conn->rbuf = NULL;
+    conn->rpos = conn->rlen = 0;
+    conn->wbuf = NULL;
+    conn->wlen = conn->wcap = 0;
+    conn->corked = 0;
+    conn->nonblocking = 1;
+}
+
+void framed_free(FramedConn *conn) {
+    free(conn->rbuf);
+    free(conn->wbuf);
+    conn->rbuf = conn->wbuf = NULL;
+    conn->rpos = conn->rlen = conn->wlen = conn->wcap = 0;
+}
+
+// Room for len more queued bytes
+static int reserve(FramedConn *conn, size_t len) {
+    if (conn->wlen + len > conn->wcap) {
+        size_t cap = conn->wcap ? conn->wcap : 1024;
+        while (cap < conn->wlen + len) cap *= 2;
+        char *wbuf = realloc(conn->wbuf, cap);
+        if (!wbuf) return -1;
+        conn->wbuf = wbuf;
+        conn->wcap = cap;
+    }
+    return 0;
+}
+
+static int queue(FramedConn *conn, const void *data, size_t len) {
+    if (len == 0) return 0;
+    if (reserve(conn, len) < 0) return -1;
+    memcpy(conn->wbuf + conn->wlen, data, len);
+    conn->wlen += len;
+    return 0;
+}
+
+// Nonblocking: one sendmsg() of the queued bytes plus header and payload;
+// whatever the socket does not take stays (or is added to) the queue
+static int write_some(FramedConn *conn, const void *header, size_t header_len, const void *data, size_t len,
+                      int flags) {
+    struct iovec iov[3];
+    int count = 0;
+    if (conn->wlen > 0) iov[count++] = (struct iovec){conn->wbuf, conn->wlen};
+    if (header_len > 0) iov[count++] = (struct iovec){(void *)header, header_len};
+    if (len > 0) iov[count++] = (struct iovec){(void *)data, len};
+    if (count == 0) return 0;
+
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = count};
+    ssize_t n;
+    do {
+        n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT | flags);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        conn->wlen = 0;
+        return -1;
+    }
+    size_t sent = n > 0 ? n : 0;
+
+    // The socket takes bytes in order, so only the unsent tail of each part is kept
+    size_t from_queue = sent < conn->wlen ? sent : conn->wlen;
+    memmove(conn->wbuf, conn->wbuf + from_queue, conn->wlen - from_queue);
+    conn->wlen -= from_queue;
+    sent -= from_queue;
+    size_t from_header = sent < header_len ? sent : header_len;
+    sent -= from_header;
+    if (queue(conn, (const char *)header + from_header, header_len - from_header) < 0 ||
+        queue(conn, (const char *)data + sent, len - sent) < 0) {
+        conn->wlen = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Send the queued bytes plus an optional header and payload with one writer call
+static int write_out(FramedConn *conn, const void *header, size_t header_len, const void *data, size_t len) {
+    if (conn->nonblocking) return write_some(conn, header, header_len, data, len, 0);
+    struct iovec iov[3];
+    int count = 0;
+    if (conn->wlen > 0) iov[count++] = (struct iovec){conn->wbuf, conn->wlen};
+    if (header_len > 0) iov[count++] = (struct iovec){(void *)header, header_len};
+    if (len > 0) iov[count++] = (struct iovec){(void *)data, len};
+    conn->wlen = 0;
+    if (count == 0) return 0;
+    return conn->writer(conn->fd, iov, count) < 0 ? -1 : 0;
+}
+
+static int send_parts(FramedConn *conn, const void *header, size_t header_len, const void *data, size_t len, int more) {
+    if ((more || conn->corked) && len <= FRAMED_COPY_LIMIT) {
+        if (queue(conn, header, header_len) < 0 || queue(conn, data, len) < 0) {
+            conn->wlen = 0;
+            return -1;
+        }
+        return 0;
+    }
+    return write_out(conn, header, header_len, data, len);
+}
+
+int framed_send(FramedConn *conn, const void *data, size_t len, int more) {
+    return send_parts(conn, NULL, 0, data, len, more);
+}
+
+int framed_send_message(FramedConn *conn, const void *data, size_t len, int more) {
+    uint32_t len_net = htonl((uint32_t)len);
+    return send_parts(conn, &len_net, sizeof(len_net), data, len, more);
+}
+
+// Nonblocking: sendfile() until the socket is full, then copy the rest of
+// the file into the queue
+static int send_file_some(FramedConn *conn, int file_fd, off_t offset, size_t len) {
+    if (write_some(conn, NULL, 0, NULL, 0, len > 0 ? MSG_MORE : 0) < 0) return -1;
+    while (len > 0 && conn->wlen == 0) {
+        ssize_t n = sendfile(conn->fd, file_fd, &offset, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) return -1;
+        len -= n;
+    }
+    if (len == 0) return 0;
+    if (reserve(conn, len) < 0) return -1;
+    while (len > 0) {
+        ssize_t n = pread(file_fd, conn->wbuf + conn->wlen, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        conn->wlen += n;
+        offset += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int framed_send_file(FramedConn *conn, const void *header, size_t header_len, int file_fd, off_t offset, size_t len) {
+    if (header_len > 0 && queue(conn, header, header_len) < 0) {
+        conn->wlen = 0;
+        return -1;
+    }
+    if (conn->nonblocking) return send_file_some(conn, file_fd, offset, len);
+    // MSG_MORE lets the queued bytes share a segment with the start of the file
+    size_t sent = 0;
+    while (sent < conn->wlen) {
+        ssize_t n = send(conn->fd, conn->wbuf + sent, conn->wlen - sent, MSG_NOSIGNAL | (len > 0 ? MSG_MORE : 0));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            conn->wlen = 0;
+            return -1;
+        }
+        sent += n;
+    }
+    conn->wlen = 0;
+
+    while (len > 0) {
+        ssize_t n = sendfile(conn->fd, file_fd, &offset, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+void framed_cork(FramedConn *conn) {
+    conn->corked = 1;
+}
+
+int framed_uncork(FramedConn *conn) {
+    conn->corked = 0;
+    return framed_flush(conn);
+}
+
+int framed_flush(FramedConn *conn) {
+    return conn->wlen > 0 ? write_out(conn, NULL, 0, NULL, 0) : 0;
+}
+
+size_t framed_pending(FramedConn *conn) {
+    return conn->wlen;
+}
+
+// Wait for the peer: flush what a corked connection still owes it, then read
+static ssize_t read_socket(FramedConn *conn, void *buf, size_t len) {
+    if (conn->corked && framed_flush(conn) < 0) return -1;
+    ssize_t n;
+    do {
+        n = read(conn->fd, buf, len);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+// Refill the (empty) readahead buffer
+static ssize_t fill(FramedConn *conn) {
+    conn->rpos = conn->rlen = 0;
+    ssize_t n = read_socket(conn, conn->rbuf, FRAMED_READ_BUFFER);
+    if (n > 0) conn->rlen = n;
+    return n;
+}
+
+const char *framed_peek(FramedConn *conn, size_t *avail) {
+    if (conn->rpos == conn->rlen && fill(conn) <= 0) return NULL;
+    *avail = conn->rlen - conn->rpos;
+    return conn->rbuf + conn->rpos;
+}
+
+void framed_consume(FramedConn *conn, size_t len) {
+    size_t avail = conn->rlen - conn->rpos;
+    conn->rpos += len < avail ? len : avail;
+}
+
+int framed_read_full(FramedConn *conn, void *buf, size_t len) {
+    char *dst = buf;
+    size_t got = 0;
+    while (got < len) {
+        size_t avail = conn->rlen - conn->rpos;
+        if (avail > 0) {
+            size_t n = avail < len - got ? avail : len - got;
+            memcpy(dst + got, conn->rbuf + conn->rpos, n);
+            conn->rpos += n;
+            got += n;
+            continue;
+        }
+
+        // Large remainders go straight into the caller's buffer
+        ssize_t n;
+        if (len - got >= FRAMED_READ_BUFFER) {
+            n = read_socket(conn, dst + got, len - got);
+            if (n > 0) got += n;
+        } else {
+            n = fill(conn);
+        }
+        if (n <= 0) return got == 0 && n == 0 ? 0 : -1;
+    }
+    return 1;
+}
+
+int framed_read_message(FramedConn *conn, void *buf, size_t cap) {
+    uint32_t len_net;
+    if (framed_read_full(conn, &len_net, sizeof(len_net)) != 1) return -1;
+    uint32_t len = ntohl(len_net);
+    if (len > cap) return -1;
+    if (framed_read_full(conn, buf, len) != 1) return -1;
+    return (int)len;
+}
+
+ssize_t framed_fill(FramedConn *conn) {
+    if (!conn->rbuf) {
+        conn->rbuf = spare_rbuf ? spare_rbuf : malloc(FRAMED_READ_BUFFER);
+        spare_rbuf = NULL;
+        conn->rpos = conn->rlen = 0;
+        if (!conn->rbuf) return -1;
+    } else if (conn->rpos > 0) {
+        // Move the unconsumed start of a message to the front
+        memmove(conn->rbuf, conn->rbuf + conn->rpos, conn->rlen - conn->rpos);
+        conn->rlen -= conn->rpos;
+        conn->rpos = 0;
+    }
+    if (conn->rlen == FRAMED_READ_BUFFER) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    ssize_t n;
+    do {
+        n = read(conn->fd, conn->rbuf + conn->rlen, FRAMED_READ_BUFFER - conn->rlen);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) conn->rlen += n;
+    return n;
+}
+
+const char *framed_buffered(FramedConn *conn, size_t *avail) {
+    *avail = conn->rlen - conn->rpos;
+    return conn->rbuf ? conn->rbuf + conn->rpos : NULL;
+}
+
+int framed_try_read_full(FramedConn *conn, void *buf, size_t len) {
+    if (conn->rlen - conn->rpos < len) return 0;
+    memcpy(buf, conn->rbuf + conn->rpos, len);
+    conn->rpos += len;
+    return 1;
+}
+
+int framed_try_read_message(FramedConn *conn, void *buf, size_t cap, size_t *len) {
+    uint32_t len_net;
+    size_t avail = conn->rlen - conn->rpos;
+    if (avail < sizeof(len_net)) return 0;
+    memcpy(&len_net, conn->rbuf + conn->rpos, sizeof(len_net));
+    uint32_t payload = ntohl(len_net);
+    if (payload > cap) return -1;
+    if (avail - sizeof(len_net) < payload) return 0;
+    memcpy(buf, conn->rbuf + conn->rpos + sizeof(len_net), payload);
+    conn->rpos += sizeof(len_net) + payload;
+    *len = payload;
+    return 1;
+}
+
+void framed_release_buffers(FramedConn *conn) {
+    if (conn->rbuf && conn->rpos == conn->rlen) {
+        if (spare_rbuf) {
+            free(conn->rbuf);
+        } else {
+            spare_rbuf = conn->rbuf;
+        }
+        conn->rbuf = NULL;
+        conn->rpos = conn->rlen = 0;
+    }
+    if (conn->wbuf && conn->wlen == 0) {
+        free(conn->wbuf);
+        conn->wbuf = NULL;
+        conn->wcap = 0;
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef FRAMED_IO_H
+#define FRAMED_IO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Buffered, length-prefixed message I/O over a stream socket.
+//
+// Every message on the wire is a 4-byte length in network order followed by
+// the payload (binary protocol frames already carry that prefix). Reads go
+// through a readahead buffer, so a burst of small messages costs one read().
+// Writes send header and payload with a single writev-style call; a corked
+// connection (or a write flagged "more") collects messages and sends them
+// together on the next flush.
+//
+// A nonblocking connection (framed_init_nonblocking) is driven by an event
+// loop instead: framed_fill() reads what has arrived, the framed_try_read_*
+// calls take complete fields and messages from the buffer, and writes send
+// what the socket accepts and queue the rest for framed_flush() on the next
+// writable event. Such a connection only holds a read buffer while part of a
+// message is waiting in it.
+
+#define FRAMED_READ_BUFFER 8192
+#define FRAMED_COPY_LIMIT 4096   // Larger payloads are sent from the caller's memory, not copied
+
+// Sends every byte of iov, returns the byte count or -1 with errno set
+typedef ssize_t (*FramedWriter)(int fd, struct iovec *iov, int iovcnt);
+
+typedef struct {
+    int fd;
+    FramedWriter writer;
+    char *rbuf;            // Readahead, FRAMED_READ_BUFFER bytes
+    size_t rpos, rlen;     // Unconsumed bytes are rbuf[rpos..rlen)
+    char *wbuf;            // Messages waiting for a flush
+    size_t wlen, wcap;
+    int corked;
+    int nonblocking;
+} FramedConn;
+
+// writer may be NULL for plain sendmsg() with MSG_NOSIGNAL
+int framed_init(FramedConn *conn, int fd, FramedWriter writer);
+void framed_free(FramedConn *conn);
+// For an O_NONBLOCK socket; no read buffer is allocated until data arrives
+void framed_init_nonblocking(FramedConn *conn, int fd);
+
+// Reading. A read that has to wait for the peer first flushes a corked
+// connection, so a reply can never be stuck behind the request it answers.
+
+// Buffered bytes (reading once if there are none), NULL on close or error
+const char *framed_peek(FramedConn *conn, size_t *avail);
+void framed_consume(FramedConn *conn, size_t len);
+// Exactly len bytes: 1 on success, 0 on close before any byte, -1 on error or truncation
+int framed_read_full(FramedConn *conn, void *buf, size_t len);
+// One length-prefixed message: the payload length, or -1 on close, error or a payload over cap
+int framed_read_message(FramedConn *conn, void *buf, size_t cap);
+
+// Nonblocking reads. framed_fill() reads once: the byte count, 0 on close,
+// -1 on error (EAGAIN when nothing has arrived). The others never read.
+ssize_t framed_fill(FramedConn *conn);
+// Buffered bytes, possibly none
+const char *framed_buffered(FramedConn *conn, size_t *avail);
+// Exactly len bytes if that many are buffered: 1, else 0 and nothing is consumed
+int framed_try_read_full(FramedConn *conn, void *buf, size_t len);
+// One buffered message: 1 with its payload length in *len, 0 while it is
+// incomplete, -1 for a payload over cap
+int framed_try_read_message(FramedConn *conn, void *buf, size_t cap, size_t *len);
+// Let go of the buffers while they are empty; the read buffer is kept for
+// the next connection of this thread to fill
+void framed_release_buffers(FramedConn *conn);
+
+// Writing: 0 on success, -1 on error. With more set (or while corked) the
+// data is only queued; the next write without it sends everything at once.
+// On a nonblocking connection "sends" means hands to the socket what it
+// accepts; framed_pending() counts the bytes still waiting for framed_flush().
+int framed_send(FramedConn *conn, const void *data, size_t len, int more);
+int framed_send_message(FramedConn *conn, const void *data, size_t len, int more);
+// Send everything queued plus header, then len bytes of file_fd from offset
+// with sendfile(). Goes out at once even when corked: the file is not copied
+// (on a nonblocking connection, except for what the socket does not take).
+int framed_send_file(FramedConn *conn, const void *header, size_t header_len, int file_fd, off_t offset, size_t len);
+void framed_cork(FramedConn *conn);
+int framed_uncork(FramedConn *conn);
+int framed_flush(FramedConn *conn);
+size_t framed_pending(FramedConn *conn);
+
+#endif
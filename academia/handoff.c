@@ -0,0 +1,210 @@
+#define _GNU_SOURCE // struct ucred
+#include "handoff.h"
+#include "logger.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#define HANDOFF_MAGIC "AHO1"
+#define HANDOFF_ACK 'R'
+
+// Sent with the descriptors attached; the state blob follows
+typedef struct {
+    char magic[4];
+    uint32_t fd_count;
+    uint32_t state_len;
+} HandoffHeader;
+
+static int unix_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *data, size_t len) {
+    char *p = data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int handoff_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (unix_address(path, &addr) < 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || chmod(path, 0600) < 0 || listen(fd, 4) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Pass the sockets and state to one successor and wait for its acknowledgement
+static int hand_over(int conn, const int *fds, int count, const void *state, size_t len) {
+    HandoffHeader header = {.fd_count = count, .state_len = len};
+    memcpy(header.magic, HANDOFF_MAGIC, 4);
+    struct iovec iov = {.iov_base = &header, .iov_len = sizeof(header)};
+
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control,
+                         .msg_controllen = CMSG_SPACE(sizeof(int) * count)};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+    ssize_t sent;
+    while ((sent = sendmsg(conn, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR);
+    if (sent != (ssize_t)sizeof(header) || write_all(conn, state, len) < 0) return -1;
+
+    struct timeval timeout = {.tv_sec = HANDOFF_ACK_TIMEOUT};
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char ack;
+    if (read_all(conn, &ack, 1) < 0 || ack != HANDOFF_ACK) return -1;
+    return 0;
+}
+
+int handoff_serve(int listen_fd, const int *fds, int count, void *(*save_state)(size_t *len)) {
+    if (count <= 0 || count > HANDOFF_MAX_FDS) {
+        errno = EINVAL;
+        return -1;
+    }
+    while (1) {
+        int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return -1;
+        }
+
+        struct ucred cred;
+        socklen_t cred_len = sizeof(cred);
+        if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0 || cred.uid != getuid()) {
+            log_write(LOG_WARN, "Server: Refused a takeover from another user\n");
+            close(conn);
+            continue;
+        }
+
+        log_write(LOG_INFO, "Server: Handing listening sockets to process %d\n", (int)cred.pid);
+        size_t len = 0;
+        void *state = save_state(&len);
+        int ret = state && len <= HANDOFF_MAX_STATE ? hand_over(conn, fds, count, state, len) : -1;
+        free(state);
+        if (ret == 0) return conn;
+        close(conn);
+        log_write(LOG_WARN, "Server: Process %d did not take over, still serving\n", (int)cred.pid);
+    }
+}
+
+// Read the header, descriptors and state sent by hand_over
+static int receive_handoff(int conn, int *fds, int *count, void **state, size_t *len) {
+    HandoffHeader header;
+    struct iovec iov = {.iov_base = &header, .iov_len = sizeof(header)};
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    ssize_t got;
+    while ((got = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL)) < 0 && errno == EINTR);
+
+    struct cmsghdr *cmsg = got > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        *count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * *count);
+    }
+    if (got != (ssize_t)sizeof(header) || memcmp(header.magic, HANDOFF_MAGIC, 4) != 0 || *count == 0 ||
+        *count != (int)header.fd_count || (msg.msg_flags & MSG_CTRUNC) || header.state_len > HANDOFF_MAX_STATE) {
+        return -1;
+    }
+
+    *len = header.state_len;
+    *state = malloc(*len ? *len : 1);
+    if (!*state) return -1;
+    if (read_all(conn, *state, *len) < 0) {
+        free(*state);
+        return -1;
+    }
+    return 0;
+}
+
+int handoff_connect(const char *path, int *fds, int *count, void **state, size_t *len) {
+    struct sockaddr_un addr;
+    if (unix_address(path, &addr) < 0) return -1;
+    int conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (conn < 0) return -1;
+    if (connect(conn, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(conn);
+        return -1;
+    }
+
+    *count = 0;
+    if (receive_handoff(conn, fds, count, state, len) < 0) {
+        for (int i = 0; i < *count; i++) close(fds[i]);
+        *count = 0;
+        close(conn);
+        errno = EPROTO;
+        return -1;
+    }
+    return conn;
+}
+
+int handoff_complete(int conn) {
+    char ack = HANDOFF_ACK;
+    return write_all(conn, &ack, 1);
+}
+
+// Updates go as their length, then the data
+int handoff_send_update(int conn, const void *data, size_t len) {
+    if (len > HANDOFF_MAX_UPDATE) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    char frame[sizeof(uint32_t) + HANDOFF_MAX_UPDATE];
+    uint32_t frame_len = len;
+    memcpy(frame, &frame_len, sizeof(frame_len));
+    memcpy(frame + sizeof(frame_len), data, len);
+    return write_all(conn, frame, sizeof(frame_len) + len);
+}
+
+void handoff_wait_exit(int conn, void (*on_update)(const void *data, size_t len)) {
+    uint32_t len;
+    char data[HANDOFF_MAX_UPDATE];
+    while (read_all(conn, &len, sizeof(len)) == 0 && len <= HANDOFF_MAX_UPDATE && read_all(conn, data, len) == 0) {
+        if (on_update) on_update(data, len);
+    }
+    // A malformed update ends them, but not the wait
+    char byte;
+    ssize_t n;
+    while ((n = read(conn, &byte, 1)) > 0 || (n < 0 && errno == EINTR));
+    close(conn);
+}
@@ -0,0 +1,45 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stddef.h>
+
+// Listening-socket handoff between an old and a new server process.
+//
+// A running server listens on a Unix socket (HANDOFF_SOCKET, next to
+// server.log). A new server started with --takeover connects to it and
+// receives the TCP listening sockets (SCM_RIGHTS) together with a state blob.
+// Once it accepts on them it sends one acknowledgement byte, and the old
+// process stops accepting, drains and exits. Connections queued on the
+// sockets are never lost: both processes share the same kernel sockets.
+// If the new process fails before acknowledging, the old one keeps serving.
+// The old process holds the connection open until it exits, so the new one
+// knows when the data files stop changing behind its back. Meanwhile it can
+// send updates to the state over it (handoff_send_update).
+
+#define HANDOFF_SOCKET "server.handoff"
+#define HANDOFF_MAX_FDS 128
+#define HANDOFF_MAX_STATE (1024 * 1024)
+#define HANDOFF_ACK_TIMEOUT 30   // Seconds the old process waits for the new one to start
+#define HANDOFF_MAX_UPDATE 256
+
+// Old process: listen for a successor on path (replacing a stale socket file)
+int handoff_listen(const char *path);
+// Serve successors until one has taken fds and acknowledged. Returns its
+// connection, to be closed once this process no longer touches the data
+// files, or -1 on error. save_state is called for each successor and returns
+// a malloc'd blob. Peers running as another user are refused.
+int handoff_serve(int listen_fd, const int *fds, int count, void *(*save_state)(size_t *len));
+// Old process: send the successor a change to the state it was handed, up to
+// HANDOFF_MAX_UPDATE bytes. Not safe to call from two threads at once.
+int handoff_send_update(int conn, const void *data, size_t len);
+
+// New process: fetch the predecessor's sockets and state (malloc'd).
+// Returns the connection to acknowledge on, or -1 when no server is listening.
+int handoff_connect(const char *path, int *fds, int *count, void **state, size_t *len);
+// Tell the predecessor to stop accepting
+int handoff_complete(int conn);
+// Block until the predecessor has exited, then close conn. on_update is
+// called with each update it sends meanwhile, in order.
+void handoff_wait_exit(int conn, void (*on_update)(const void *data, size_t len));
+
+#endif
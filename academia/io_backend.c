@@ -0,0 +1,341 @@
+#include "io_backend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+// Per-thread submission/completion rings, mapped from the kernel
+typedef struct {
+    int ring_fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+    unsigned entries;
+} IoRing;
+
+// Per-thread state: the ring (uring backend) and the scan buffer
+typedef struct {
+    IoRing ring;
+    int has_ring;
+    char *buffer;
+    int buffer_registered;
+} IoThread;
+
+// Result of an operation the ring has not run, never a byte count or -errno
+#define IO_NO_RESULT LONG_MIN
+
+static enum IoBackend backend = IO_BACKEND_BLOCKING;
+static pthread_key_t thread_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void ring_close(IoRing *ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_size);
+    if (ring->sq_ptr) munmap(ring->sq_ptr, ring->sq_size);
+    if (ring->ring_fd >= 0) close(ring->ring_fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->ring_fd = -1;
+}
+
+static int ring_open(IoRing *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->ring_fd = sys_io_uring_setup(entries, &params);
+    if (ring->ring_fd < 0) return -1;
+
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size) ring->sq_size = ring->cq_size;
+        ring->cq_size = ring->sq_size;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        ring_close(ring);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->ring_fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring->cq_ptr = NULL;
+            ring_close(ring);
+            return -1;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        ring_close(ring);
+        return -1;
+    }
+
+    char *sq = ring->sq_ptr, *cq = ring->cq_ptr;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    ring->entries = params.sq_entries;
+    return 0;
+}
+
+static void thread_state_free(void *arg) {
+    IoThread *state = arg;
+    if (state->has_ring) ring_close(&state->ring);
+    free(state->buffer);
+    free(state);
+}
+
+static void make_key(void) {
+    pthread_key_create(&thread_key, thread_state_free);
+}
+
+// Lazily create the calling thread's ring and scan buffer
+static IoThread *thread_state(void) {
+    IoThread *state = pthread_getspecific(thread_key);
+    if (state) return state;
+
+    state = calloc(1, sizeof(IoThread));
+    if (!state) return NULL;
+    state->ring.ring_fd = -1;
+    if (backend == IO_BACKEND_URING && ring_open(&state->ring, IO_RING_ENTRIES) == 0) {
+        state->has_ring = 1;
+    }
+    pthread_setspecific(thread_key, state);
+    return state;
+}
+
+static void fill_sqe(struct io_uring_sqe *sqe, IoOp *op, unsigned long long tag) {
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = op->fd;
+    sqe->user_data = tag;
+    switch (op->opcode) {
+        case IO_OP_PREAD:
+            sqe->opcode = op->buf_index >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            sqe->addr = (unsigned long)op->buf;
+            sqe->len = op->len;
+            sqe->off = op->offset;
+            if (op->buf_index >= 0) sqe->buf_index = op->buf_index;
+            break;
+        case IO_OP_PWRITE:
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->addr = (unsigned long)op->buf;
+            sqe->len = op->len;
+            sqe->off = op->offset;
+            break;
+    }
+}
+
+// Submit up to ring->entries operations and wait for all completions. -1 if
+// the ring failed: operations the kernel never took keep IO_NO_RESULT, those
+// it took but whose completion was not seen get -EIO, since they may well
+// have run. The ring is not fit for another batch then.
+static int ring_submit(IoRing *ring, IoOp *ops, int count) {
+    unsigned tail = *ring->sq_tail;
+    unsigned mask = *ring->sq_mask;
+
+    for (int i = 0; i < count; i++) {
+        unsigned index = tail & mask;
+        fill_sqe(&ring->sqes[index], &ops[i], (unsigned long long)i);
+        ring->sq_array[index] = index;
+        tail++;
+    }
+    atomic_store_explicit((_Atomic unsigned *)ring->sq_tail, tail, memory_order_release);
+
+    int submitted = 0, completed = 0;
+    while (completed < count) {
+        unsigned to_submit = count - submitted;
+        int ret = sys_io_uring_enter(ring->ring_fd, to_submit, count - completed, IORING_ENTER_GETEVENTS);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        submitted += ret;
+
+        unsigned head = *ring->cq_head;
+        while (head != atomic_load_explicit((_Atomic unsigned *)ring->cq_tail, memory_order_acquire)) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            ops[cqe->user_data].result = cqe->res;
+            head++;
+            completed++;
+        }
+        atomic_store_explicit((_Atomic unsigned *)ring->cq_head, head, memory_order_release);
+    }
+    if (completed == count) return 0;
+    for (int i = 0; i < submitted; i++) {
+        if (ops[i].result == IO_NO_RESULT) ops[i].result = -EIO;
+    }
+    return -1;
+}
+
+static ssize_t blocking_op(IoOp *op) {
+    ssize_t ret;
+    switch (op->opcode) {
+        case IO_OP_PREAD:
+            ret = pread(op->fd, op->buf, op->len, op->offset);
+            break;
+        case IO_OP_PWRITE:
+            ret = pwrite(op->fd, op->buf, op->len, op->offset);
+            break;
+        default:
+            errno = EINVAL;
+            ret = -1;
+            break;
+    }
+    return ret < 0 ? -errno : ret;
+}
+
+int io_backend_init(const char *name) {
+    pthread_once(&key_once, make_key);
+
+    if (name && strcmp(name, "blocking") == 0) {
+        backend = IO_BACKEND_BLOCKING;
+        return 0;
+    }
+    if (name && strcmp(name, "uring") != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Probe: the kernel may lack io_uring or have it disabled by policy
+    IoRing probe;
+    if (ring_open(&probe, IO_RING_ENTRIES) == 0) {
+        ring_close(&probe);
+        backend = IO_BACKEND_URING;
+    } else {
+        backend = IO_BACKEND_BLOCKING;
+    }
+    return 0;
+}
+
+enum IoBackend io_backend_kind(void) {
+    return backend;
+}
+
+const char *io_backend_name(void) {
+    return backend == IO_BACKEND_URING ? "io_uring" : "blocking";
+}
+
+int io_submit_batch(IoOp *ops, int count) {
+    IoThread *state = backend == IO_BACKEND_URING ? thread_state() : NULL;
+
+    for (int i = 0; i < count; i++) ops[i].result = IO_NO_RESULT;
+    if (state && state->has_ring) {
+        for (int done = 0; done < count; ) {
+            int chunk = count - done;
+            if (chunk > (int)state->ring.entries) chunk = state->ring.entries;
+            if (chunk > IO_RING_ENTRIES) chunk = IO_RING_ENTRIES;
+            if (ring_submit(&state->ring, ops + done, chunk) < 0) {
+                // Completions still owed could turn up in a later batch: the thread does without the ring
+                ring_close(&state->ring);
+                state->has_ring = 0;
+                state->buffer_registered = 0;
+                break;
+            }
+            done += chunk;
+            if (done == count) {
+                // Operations the kernel does not support are retried synchronously
+                for (int i = 0; i < count; i++) {
+                    if (ops[i].result == -EINVAL || ops[i].result == -EOPNOTSUPP) ops[i].result = blocking_op(&ops[i]);
+                }
+                return 0;
+            }
+        }
+    }
+
+    // Blocking I/O for whatever the ring never took; what it took keeps its result or -EIO
+    for (int i = 0; i < count; i++) {
+        if (ops[i].result == IO_NO_RESULT) ops[i].result = blocking_op(&ops[i]);
+    }
+    return 0;
+}
+
+ssize_t io_pread_full(int fd, void *buf, size_t len, off_t offset, int buf_index) {
+    size_t total = 0;
+    while (total < len) {
+        IoOp op = {.opcode = IO_OP_PREAD, .fd = fd, .buf = (char *)buf + total, .len = len - total,
+                   .offset = offset + total, .buf_index = buf_index};
+        io_submit_batch(&op, 1);
+        if (op.result == -EINTR) continue;
+        if (op.result < 0) {
+            errno = -op.result;
+            return total > 0 ? (ssize_t)total : -1;
+        }
+        if (op.result == 0) break;
+        total += op.result;
+    }
+    return total;
+}
+
+ssize_t io_pwrite_full(int fd, const void *buf, size_t len, off_t offset) {
+    size_t total = 0;
+    while (total < len) {
+        IoOp op = {.opcode = IO_OP_PWRITE, .fd = fd, .buf = (char *)buf + total, .len = len - total,
+                   .offset = offset + total, .buf_index = -1};
+        io_submit_batch(&op, 1);
+        if (op.result == -EINTR) continue;
+        if (op.result <= 0) {
+            errno = op.result < 0 ? -op.result : EIO;
+            return -1;
+        }
+        total += op.result;
+    }
+    return total;
+}
+
+void *io_thread_buffer(size_t *size, int *buf_index) {
+    *size = IO_BUFFER_SIZE;
+    *buf_index = -1;
+
+    IoThread *state = thread_state();
+    if (!state) return NULL;
+
+    if (!state->buffer) {
+        state->buffer = malloc(IO_BUFFER_SIZE);
+        if (!state->buffer) return NULL;
+        if (state->has_ring) {
+            struct iovec iov = {state->buffer, IO_BUFFER_SIZE};
+            if (sys_io_uring_register(state->ring.ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0) {
+                state->buffer_registered = 1;
+            }
+        }
+    }
+    if (state->buffer_registered) *buf_index = 0;
+    return state->buffer;
+}
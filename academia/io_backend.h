@@ -0,0 +1,47 @@
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+#include <sys/types.h>
+
+// I/O backends, chosen once at startup
+enum IoBackend { IO_BACKEND_BLOCKING, IO_BACKEND_URING };
+
+// Operation kinds for io_submit_batch
+enum IoOpcode { IO_OP_PREAD, IO_OP_PWRITE };
+
+// One entry of a batch. result is filled in with the byte count or -errno.
+typedef struct {
+    enum IoOpcode opcode;
+    int fd;
+    void *buf;
+    size_t len;
+    off_t offset;
+    int buf_index;             // Registered buffer for IO_OP_PREAD, -1 for none
+    ssize_t result;
+} IoOp;
+
+#define IO_RING_ENTRIES 32
+#define IO_BUFFER_SIZE (64 * 1024)
+
+// Select the backend ("uring", "blocking" or NULL for the best available).
+// Falls back to blocking I/O when io_uring cannot be set up.
+int io_backend_init(const char *name);
+enum IoBackend io_backend_kind(void);
+const char *io_backend_name(void);
+
+// Submit every operation with a single kernel entry and wait for all of them.
+// If the ring fails partway, operations it may have run report -EIO and are
+// not run again; the others run with blocking I/O.
+int io_submit_batch(IoOp *ops, int count);
+
+// Single-operation helpers that retry on short transfers
+ssize_t io_pread_full(int fd, void *buf, size_t len, off_t offset, int buf_index);
+ssize_t io_pwrite_full(int fd, const void *buf, size_t len, off_t offset);
+
+// Per-thread read buffer, registered with the thread's ring when possible.
+// A thread reuses the same buffer, so it must finish one scan before the next.
+// Data files are not registered: each operation opens and closes its own
+// descriptor, and registering it would cost as many system calls as it saves.
+void *io_thread_buffer(size_t *size, int *buf_index);
+
+#endif
@@ -0,0 +1,90 @@
+#define _GNU_SOURCE // memfd_create, F_ADD_SEALS
+#include "academia.h"
+#include "listing_cache.h"
+#include "io_backend.h"
+#include <arpa/inet.h>
+#include <sys/mman.h>
+
+typedef struct {
+    char key[LISTING_KEY_MAX];
+    uint64_t generation;    // 0 when empty
+    int fd;
+    size_t len;             // Text bytes after LISTING_TEXT_OFFSET
+} ListingSlot;
+
+static ListingSlot slots[LISTING_CACHE_SLOTS];
+static pthread_mutex_t slots_lock = PTHREAD_MUTEX_INITIALIZER;
+static int enabled = 1;
+
+static ListingSlot *slot_of(const char *key) {
+    unsigned hash = 5381;
+    for (const char *p = key; *p; p++) hash = hash * 33 + (unsigned char)*p;
+    return &slots[hash % LISTING_CACHE_SLOTS];
+}
+
+// Sealed memfd holding the length prefix and text
+static int materialize(const char *text, size_t len) {
+    int fd = memfd_create("academia-listing", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return -1;
+    uint32_t len_net = htonl((uint32_t)len);
+    if (io_pwrite_full(fd, &len_net, sizeof(len_net), 0) != sizeof(len_net) ||
+        io_pwrite_full(fd, text, len, LISTING_TEXT_OFFSET) != (ssize_t)len ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void listing_cache_set_enabled(int on) {
+    pthread_mutex_lock(&slots_lock);
+    enabled = on;
+    for (int i = 0; i < LISTING_CACHE_SLOTS; i++) {
+        if (slots[i].generation) close(slots[i].fd);
+        slots[i].generation = 0;
+    }
+    pthread_mutex_unlock(&slots_lock);
+}
+
+int listing_cache_get(const char *key, uint64_t generation, size_t *len) {
+    ListingSlot *slot = slot_of(key);
+    int fd = -1;
+    pthread_mutex_lock(&slots_lock);
+    if (enabled && slot->generation == generation && strcmp(slot->key, key) == 0) {
+        fd = dup(slot->fd);
+        *len = slot->len;
+    }
+    pthread_mutex_unlock(&slots_lock);
+    return fd;
+}
+
+int listing_cache_store(const char *key, uint64_t generation, const char *text, size_t len) {
+    if (strlen(key) >= LISTING_KEY_MAX) return -1;
+    int fd = materialize(text, len);
+    if (fd < 0) return -1;
+
+    ListingSlot *slot = slot_of(key);
+    int old = -1, copy = -1;
+    pthread_mutex_lock(&slots_lock);
+    // Never replace a newer rendering of the same key with an older one
+    if (enabled && (strcmp(slot->key, key) != 0 || generation > slot->generation)) {
+        if (slot->generation) old = slot->fd;
+        strcpy(slot->key, key);
+        slot->generation = generation;
+        slot->fd = fd;
+        slot->len = len;
+        copy = dup(fd);
+        fd = -1;
+    }
+    pthread_mutex_unlock(&slots_lock);
+    if (old >= 0) close(old);
+    if (fd >= 0) close(fd);
+    return copy;
+}
+
+char *listing_read_text(int fd, size_t len, Arena *arena) {
+    char *text = arena_alloc(arena, len + 1);
+    if (!text || io_pread_full(fd, text, len, LISTING_TEXT_OFFSET, -1) != (ssize_t)len) return NULL;
+    text[len] = '\0';
+    return text;
+}
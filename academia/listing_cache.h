@@ -0,0 +1,33 @@
+#ifndef LISTING_CACHE_H
+#define LISTING_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+// Rendered listings kept in sealed memfds.
+//
+// A listing is stored pre-framed: its length as 4 bytes in network order,
+// then the text. A legacy reply is the whole file; a binary response is a
+// frame header followed by the file from LISTING_TEXT_OFFSET. Either way it
+// leaves with sendfile() (framed_send_file) without being copied through
+// user space. Each entry is tagged with the data generation it shows, and a
+// lookup for any other generation misses. Slots are direct-mapped by key.
+
+#define LISTING_CACHE_SLOTS 64
+#define LISTING_KEY_MAX 32
+#define LISTING_TEXT_OFFSET 4
+
+// Caching starts enabled; disabling also drops every entry
+void listing_cache_set_enabled(int enabled);
+
+// A dup of key's memfd (the caller closes it) and its text length if the
+// entry shows generation, else -1
+int listing_cache_get(const char *key, uint64_t generation, size_t *len);
+// Store text as key's listing at generation; returns a dup like listing_cache_get, or -1
+int listing_cache_store(const char *key, uint64_t generation, const char *text, size_t len);
+
+// The text of a listing, copied into arena
+char *listing_read_text(int fd, size_t len, Arena *arena);
+
+#endif
@@ -0,0 +1,197 @@
+#include "academia.h"
+#include "logger.h"
+#include <stdarg.h>
+#include <strings.h>
+#include <time.h>
+
+typedef struct {
+    unsigned char level;
+    unsigned char len;
+    char text[LOG_RECORD_SIZE];
+} LogRecord;
+
+// One thread's ring: the owner advances head, the flusher advances tail
+typedef struct LogRing {
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    atomic_size_t dropped;
+    atomic_int closed;           // Owner thread has exited; freed once drained
+    struct LogRing *next;
+    LogRecord records[LOG_RING_SIZE];
+} LogRing;
+
+atomic_int logger_level = LOG_INFO;
+atomic_uint logger_sample_every = 1;
+
+static int log_fd = -1;
+static LogRing *rings;           // Every ring not yet freed, guarded by rings_lock
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static pthread_t flusher;
+static atomic_int running;
+static sem_t flush_wakeup;       // Posted when a ring fills up to half
+static _Thread_local LogRing *thread_ring;
+
+static const char *level_names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+static void ring_release(void *arg) {
+    LogRing *ring = arg;
+    atomic_store_explicit(&ring->closed, 1, memory_order_release);
+}
+
+// First message of a thread: give it a ring
+static LogRing *ring_create(void) {
+    LogRing *ring = calloc(1, sizeof(LogRing));
+    if (!ring) return NULL;
+    pthread_mutex_lock(&rings_lock);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&rings_lock);
+    pthread_setspecific(ring_key, ring);
+    thread_ring = ring;
+    return ring;
+}
+
+void log_write(enum LogLevel level, const char *format, ...) {
+    if ((int)level < atomic_load_explicit(&logger_level, memory_order_relaxed)) return;
+    if (!atomic_load_explicit(&running, memory_order_relaxed)) return;
+
+    LogRing *ring = thread_ring ? thread_ring : ring_create();
+    if (!ring) return;
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    LogRecord *record = &ring->records[head & (LOG_RING_SIZE - 1)];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(record->text, sizeof(record->text), format, args);
+    va_end(args);
+    if (len < 0) len = 0;
+    if (len >= (int)sizeof(record->text)) len = sizeof(record->text) - 1;
+    record->len = len;
+    record->level = level;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    // Bursts should not have to wait for the next interval to get drained
+    if (head + 1 - tail == LOG_RING_SIZE / 2) sem_post(&flush_wakeup);
+}
+
+static void write_out(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(log_fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        buf += n;
+        len -= n;
+    }
+}
+
+// Append every published record to the log file; free rings of exited threads
+static void drain_rings(char *out) {
+    size_t used = 0;
+    pthread_mutex_lock(&rings_lock);
+    LogRing **link = &rings;
+    while (*link) {
+        LogRing *ring = *link;
+        int closed = atomic_load_explicit(&ring->closed, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; tail++) {
+            LogRecord *record = &ring->records[tail & (LOG_RING_SIZE - 1)];
+            if (LOG_FLUSH_BUFFER - used < LOG_RECORD_SIZE + 16) {
+                write_out(out, used);
+                used = 0;
+            }
+            if (record->level != LOG_INFO) {
+                used += snprintf(out + used, 16, "[%s] ", level_names[record->level]);
+            }
+            memcpy(out + used, record->text, record->len);
+            used += record->len;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+        size_t dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+        if (dropped > 0) {
+            if (LOG_FLUSH_BUFFER - used < 64) {
+                write_out(out, used);
+                used = 0;
+            }
+            used += snprintf(out + used, 64, "[WARN] Logger: dropped %zu messages\n", dropped);
+        }
+
+        if (closed && tail == atomic_load_explicit(&ring->head, memory_order_acquire)) {
+            *link = ring->next;
+            free(ring);
+        } else {
+            link = &ring->next;
+        }
+    }
+    pthread_mutex_unlock(&rings_lock);
+    write_out(out, used);
+}
+
+static void *flusher_main(void *arg) {
+    char *out = arg;
+    while (atomic_load(&running)) {
+        drain_rings(out);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_FLUSH_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        sem_timedwait(&flush_wakeup, &deadline);
+    }
+    drain_rings(out);
+    free(out);
+    return NULL;
+}
+
+int logger_init(const char *path, enum LogLevel level) {
+    log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log_fd < 0) return -1;
+    char *out = malloc(LOG_FLUSH_BUFFER);
+    if (!out || pthread_key_create(&ring_key, ring_release) != 0 || sem_init(&flush_wakeup, 0, 0) < 0) {
+        free(out);
+        close(log_fd);
+        return -1;
+    }
+    atomic_store(&logger_level, level);
+    atomic_store(&running, 1);
+    if (pthread_create(&flusher, NULL, flusher_main, out) != 0) {
+        atomic_store(&running, 0);
+        free(out);
+        close(log_fd);
+        return -1;
+    }
+    return 0;
+}
+
+void logger_shutdown(void) {
+    if (!atomic_exchange(&running, 0)) return;
+    sem_post(&flush_wakeup);
+    pthread_join(flusher, NULL);
+    close(log_fd);
+    log_fd = -1;
+}
+
+void logger_set_level(enum LogLevel level) {
+    atomic_store(&logger_level, level);
+}
+
+void logger_set_sampling(unsigned every) {
+    atomic_store(&logger_sample_every, every ? every : 1);
+}
+
+int logger_parse_level(const char *name) {
+    for (int i = LOG_DEBUG; i <= LOG_ERROR; i++) {
+        if (strcasecmp(name, level_names[i]) == 0) return i;
+    }
+    return -1;
+}
@@ -0,0 +1,49 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Asynchronous logger.
+//
+// Each thread formats its messages into its own single-producer ring; a
+// background thread drains every ring and appends the text to the log file in
+// large writes (every LOG_FLUSH_INTERVAL_MS, or sooner when a ring is half
+// full). Logging never takes a lock or touches the disk on the calling
+// thread. When a ring is full the message is dropped and counted rather than
+// blocking. Lines from one thread stay in order; lines from different threads
+// are only ordered to within one flush interval.
+
+enum LogLevel { LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR };
+
+#define LOG_RING_SIZE 256                // Records per thread, a power of two
+#define LOG_RECORD_SIZE 248              // Longer messages are truncated
+#define LOG_FLUSH_INTERVAL_MS 20
+#define LOG_FLUSH_BUFFER (64 * 1024)
+
+// Open (append) the log file and start the flusher thread
+int logger_init(const char *path, enum LogLevel level);
+// Drain everything that was logged and stop the flusher
+void logger_shutdown(void);
+
+void logger_set_level(enum LogLevel level);
+// log_sampled() sites keep one message in every n (per thread)
+void logger_set_sampling(unsigned every);
+// Parse "debug", "info", "warn" or "error", -1 if unknown
+int logger_parse_level(const char *name);
+
+extern atomic_int logger_level;
+extern atomic_uint logger_sample_every;
+
+void log_write(enum LogLevel level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// For high-volume messages: honour the sampling rate set with logger_set_sampling()
+#define log_sampled(level, ...)                                                         \
+    do {                                                                                \
+        static _Thread_local unsigned log_sample_count_;                               \
+        if ((int)(level) >= atomic_load_explicit(&logger_level, memory_order_relaxed) && \
+            log_sample_count_++ % atomic_load_explicit(&logger_sample_every, memory_order_relaxed) == 0) \
+            log_write(level, __VA_ARGS__);                                              \
+    } while (0)
+
+#endif
@@ -0,0 +1,99 @@
+#include "academia.h"
+#include "menus.h"
+
+// Login screen: sent by the server to every new connection, rendered locally by binary clients
+static const char *login_screen = "....................Welcome Back to Academia :: Course Registration....................\n"
+                                  "Login Type\n"
+                                  "Enter Your Choice { 1.Admin , 2.Professor, 3. Student } : ";
+
+// Role menus: sent by the server in interactive sessions, rendered locally by binary clients
+static const char *admin_menu = "....... Welcome to Admin Menu .......\n"
+                         "1. Add Student\n"
+                         "2. View Student Details\n"
+                         "3. Add Faculty\n"
+                         "4. View Faculty Details\n"
+                         "5. Activate Student\n"
+                         "6. Block Student\n"
+                         "7. Modify Student Details\n"
+                         "8. Modify Faculty Details\n"
+                         "9. Logout and Exit\n"
+                         "10. View Server Metrics\n"
+                         "Enter Your Choice: ";
+
+#define STUDENT_MENU_ENTRIES "....... Welcome to Student Menu .......\n" \
+                             "1. View All Courses\n" \
+                             "2. Enroll New Course\n" \
+                             "3. Drop Course\n" \
+                             "4. View Enrolled Course Details\n" \
+                             "5. Change Password\n" \
+                             "6. Logout and Exit\n"
+
+static const char *student_menu = STUDENT_MENU_ENTRIES "Enter Your Choice: ";
+
+// Seat events are pushed over the binary protocol only
+static const char *student_command_menu = STUDENT_MENU_ENTRIES
+                                          "7. Watch Course for Free Seats\n"
+                                          "8. Stop Watching Course\n"
+                                          "Enter Your Choice: ";
+
+static const char *faculty_menu = "....... Welcome to Faculty Menu .......\n"
+                           "1. View Offering Courses\n"
+                           "2. Add New Course\n"
+                           "3. Remove Course from Catalog\n"
+                           "4. Update Course Details\n"
+                           "5. Change Password\n"
+                           "6. Logout and Exit\n"
+                           "Enter Your Choice: ";
+
+const char *login_menu(void) {
+    return login_screen;
+}
+
+const char *role_menu(enum Role role) {
+    return role == ADMIN ? admin_menu : role == FACULTY ? faculty_menu : student_menu;
+}
+
+const char *command_menu(enum Role role) {
+    return role == STUDENT ? student_command_menu : role_menu(role);
+}
+
+// Client-facing message for the outcome of an operation
+const char *result_message(int op, int status) {
+    int ok = status == 0;
+    if (status == ERR_LOCK_TIMEOUT) return "Server is busy, please try again\n";
+    if (status == ERR_NOT_MODIFIED) return "Course listing unchanged\n";
+    switch (op) {
+        case OP_AUTHENTICATE: return ok ? "Login successful\n" : "Login failed\n";
+        case OP_LOGOUT: return "Logout successful\n";
+        case OP_ADD_STUDENT: return ok ? "Student added successfully\n" : "Failed to add student\n";
+        case OP_VIEW_ALL_STUDENTS: return "No students found or error occurred\n";
+        case OP_ADD_FACULTY: return ok ? "Faculty added successfully\n" : "Failed to add faculty\n";
+        case OP_VIEW_ALL_FACULTY: return "No faculty found or error occurred\n";
+        case OP_ACTIVATE_STUDENT: return ok ? "Student activated successfully\n" : "Failed to activate student\n";
+        case OP_BLOCK_STUDENT: return ok ? "Student blocked successfully\n" : "Failed to block student\n";
+        case OP_UPDATE_STUDENT: return ok ? "Student details updated successfully\n" : "Failed to update student details\n";
+        case OP_UPDATE_FACULTY: return ok ? "Faculty details updated successfully\n" : "Failed to update faculty details\n";
+        case OP_VIEW_ALL_COURSES:
+        case OP_VIEW_FACULTY_COURSES: return "No courses found or error occurred\n";
+        case OP_ENROLL_COURSE:
+            if (ok) return "Enrolled successfully\n";
+            if (status == ERR_FULL) return "Course is full\n";
+            if (status == ERR_ALREADY_ENROLLED) return "Already enrolled in this course\n";
+            if (status == ERR_COURSE_NOT_FOUND) return "Course not found\n";
+            if (status == ERR_INVALID_INPUT) return "Student is blocked\n";
+            return "Failed to enroll\n";
+        case OP_DROP_COURSE:
+            if (ok) return "Dropped successfully\n";
+            if (status == ERR_NOT_ENROLLED) return "Not enrolled in this course\n";
+            return "Failed to drop course\n";
+        case OP_VIEW_ENROLLED_COURSES: return "No courses enrolled or error occurred\n";
+        case OP_CHANGE_PASSWORD: return ok ? "Password changed successfully\n" : "Failed to change password\n";
+        case OP_ADD_COURSE: return ok ? "Course added successfully\n" : "Failed to add course\n";
+        case OP_REMOVE_COURSE: return ok ? "Course removed successfully\n" : "Failed to remove course\n";
+        case OP_UPDATE_COURSE: return ok ? "Course updated successfully\n" : "Failed to update course\n";
+        case OP_VIEW_METRICS: return "No metrics available\n";
+        case OP_SUBSCRIBE: return ok ? "Subscribed to seat availability\n" : "Failed to subscribe\n";
+        case OP_UNSUBSCRIBE: return ok ? "Unsubscribed from seat availability\n" : "Not subscribed to this course\n";
+        default: return "Invalid choice\n";
+    }
+}
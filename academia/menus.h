@@ -0,0 +1,17 @@
+#ifndef MENUS_H
+#define MENUS_H
+
+#include "academia.h"
+
+// Login screen, ending with the role choice prompt
+const char *login_menu(void);
+
+// Menu text of a role, ending with the "Enter Your Choice" prompt
+const char *role_menu(enum Role role);
+// Menu of a binary-protocol client: role_menu plus the entries that need it
+const char *command_menu(enum Role role);
+
+// Message shown for an operation's status when the reply carries no text
+const char *result_message(int op, int status);
+
+#endif
@@ -0,0 +1,439 @@
+#include "academia.h"
+#include "metrics.h"
+#include <stdarg.h>
+#include <time.h>
+
+static Histogram request_latency[METRICS_OPS];
+static atomic_uint_fast64_t request_results[METRICS_OPS][METRICS_RESULT_CODES];
+static Histogram lock_wait[METRICS_LOCKS];
+static atomic_uint_fast64_t cache_lookups[METRICS_CACHES][2];   // [cache][hit]
+static atomic_uint_fast64_t compressed_responses, compression_in, compression_out, compression_cpu_ns;
+static atomic_long active_sessions;
+static atomic_uint_fast64_t sessions_total;
+static atomic_uint_fast64_t seat_events, seat_event_frames;
+
+// file_sem holders, one slot per operation name, claimed on first use
+typedef struct {
+    _Atomic(const char *) name;
+    atomic_uint_fast64_t holds;
+    atomic_uint_fast64_t hold_ns;
+    atomic_uint_fast64_t max_hold_ns;
+    atomic_uint_fast64_t waiters;      // Summed over the holds
+    atomic_uint_fast64_t blocked_ns;   // Hold times weighted by the waiters behind them
+    atomic_uint_fast64_t timeouts;     // Waiters that gave up during its holds
+} LockHolder;
+
+static LockHolder lock_holders[METRICS_LOCK_HOLDERS];
+
+static const char *op_names[METRICS_OPS] = {
+    [OP_AUTHENTICATE] = "authenticate",
+    [OP_ADD_STUDENT] = "add_student",
+    [OP_VIEW_ALL_STUDENTS] = "view_all_students",
+    [OP_ADD_FACULTY] = "add_faculty",
+    [OP_VIEW_ALL_FACULTY] = "view_all_faculty",
+    [OP_ACTIVATE_STUDENT] = "activate_student",
+    [OP_BLOCK_STUDENT] = "block_student",
+    [OP_UPDATE_STUDENT] = "update_student",
+    [OP_UPDATE_FACULTY] = "update_faculty",
+    [OP_VIEW_ALL_COURSES] = "view_all_courses",
+    [OP_ENROLL_COURSE] = "enroll_course",
+    [OP_DROP_COURSE] = "drop_course",
+    [OP_VIEW_ENROLLED_COURSES] = "view_enrolled_courses",
+    [OP_CHANGE_PASSWORD] = "change_password",
+    [OP_VIEW_FACULTY_COURSES] = "view_faculty_courses",
+    [OP_ADD_COURSE] = "add_course",
+    [OP_REMOVE_COURSE] = "remove_course",
+    [OP_UPDATE_COURSE] = "update_course",
+    [OP_VIEW_METRICS] = "view_metrics",
+    [OP_RESUME] = "resume",
+    [OP_SUBSCRIBE] = "subscribe",
+    [OP_UNSUBSCRIBE] = "unsubscribe",
+};
+
+static const char *lock_names[METRICS_LOCKS] = {"file_sem", "fcntl_read", "fcntl_write"};
+static const char *cache_names[METRICS_CACHES] = {"catalog"};
+
+// Result code labels: index i is ERR code -i, the last one collects the rest
+static const char *result_names[METRICS_RESULT_CODES] = {
+    "ok", "not_found", "full", "already_enrolled", "not_enrolled", "invalid_input", "course_not_found",
+    "lock_timeout", "not_modified", "other"
+};
+
+uint64_t metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bucket_index(uint64_t value) {
+    if (value < METRICS_SUB_BUCKETS) return (int)value;
+    int exponent = 63 - __builtin_clzll(value);
+    int index = (exponent - 3) * METRICS_SUB_BUCKETS + (int)((value >> (exponent - 4)) & (METRICS_SUB_BUCKETS - 1));
+    return index < METRICS_BUCKETS ? index : METRICS_BUCKETS - 1;
+}
+
+// Largest value that lands in bucket index
+static uint64_t bucket_upper(int index) {
+    if (index < METRICS_SUB_BUCKETS) return index;
+    int exponent = index / METRICS_SUB_BUCKETS + 3;
+    uint64_t sub = index % METRICS_SUB_BUCKETS;
+    return ((METRICS_SUB_BUCKETS + sub + 1) << (exponent - 4)) - 1;
+}
+
+void histogram_record(Histogram *h, uint64_t value) {
+    atomic_fetch_add_explicit(&h->buckets[bucket_index(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+    uint_fast64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&h->max, &max, value, memory_order_relaxed,
+                                                                 memory_order_relaxed));
+}
+
+uint64_t histogram_percentile(const Histogram *h, double q) {
+    uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    if (count == 0) return 0;
+    uint64_t target = (uint64_t)(q * count + 0.5), seen = 0;
+    if (target == 0) target = 1;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if (seen >= target) {
+            uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+            return bucket_upper(i) < max ? bucket_upper(i) : max;
+        }
+    }
+    return atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+void metrics_record_request(int op, int ret, uint64_t ns) {
+    if (op <= 0 || op >= METRICS_OPS) return;
+    histogram_record(&request_latency[op], ns);
+    // check_credentials() answers 1 for a match and 0 for a mismatch
+    if (op == OP_AUTHENTICATE && ret >= 0) ret = ret ? ERR_NONE : ERR_NOT_FOUND;
+    int code = ret <= 0 && ret > -(METRICS_RESULT_CODES - 1) ? -ret : METRICS_RESULT_CODES - 1;
+    atomic_fetch_add_explicit(&request_results[op][code], 1, memory_order_relaxed);
+}
+
+void metrics_record_lock_wait(enum MetricsLock lock, uint64_t ns) {
+    histogram_record(&lock_wait[lock], ns);
+}
+
+// Slot of holder, claimed if it has none; NULL once the table is full
+static LockHolder *lock_holder(const char *holder) {
+    if (!holder) return NULL;
+    for (int i = 0; i < METRICS_LOCK_HOLDERS; i++) {
+        const char *name = atomic_load_explicit(&lock_holders[i].name, memory_order_acquire);
+        if (!name && atomic_compare_exchange_strong(&lock_holders[i].name, &name, holder)) return &lock_holders[i];
+        if (name == holder || strcmp(name, holder) == 0) return &lock_holders[i];
+    }
+    return NULL;
+}
+
+void metrics_record_lock_hold(const char *holder, uint64_t ns, int waiters) {
+    LockHolder *h = lock_holder(holder);
+    if (!h) return;
+    atomic_fetch_add_explicit(&h->holds, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->hold_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->waiters, waiters, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->blocked_ns, ns * waiters, memory_order_relaxed);
+    uint_fast64_t max = atomic_load_explicit(&h->max_hold_ns, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&h->max_hold_ns, &max, ns, memory_order_relaxed,
+                                                              memory_order_relaxed));
+}
+
+void metrics_record_lock_timeout(const char *holder) {
+    LockHolder *h = lock_holder(holder);
+    if (h) atomic_fetch_add_explicit(&h->timeouts, 1, memory_order_relaxed);
+}
+
+void metrics_record_cache(enum MetricsCache cache, int hit) {
+    atomic_fetch_add_explicit(&cache_lookups[cache][hit != 0], 1, memory_order_relaxed);
+}
+
+void metrics_record_compression(size_t in, size_t out, uint64_t cpu_ns) {
+    atomic_fetch_add_explicit(&compressed_responses, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&compression_in, in, memory_order_relaxed);
+    atomic_fetch_add_explicit(&compression_out, out, memory_order_relaxed);
+    atomic_fetch_add_explicit(&compression_cpu_ns, cpu_ns, memory_order_relaxed);
+}
+
+void metrics_record_seat_event(void) {
+    atomic_fetch_add_explicit(&seat_events, 1, memory_order_relaxed);
+}
+
+void metrics_record_seat_pushes(int sessions) {
+    atomic_fetch_add_explicit(&seat_event_frames, sessions, memory_order_relaxed);
+}
+
+void metrics_session_opened(void) {
+    atomic_fetch_add_explicit(&active_sessions, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sessions_total, 1, memory_order_relaxed);
+}
+
+void metrics_session_closed(void) {
+    atomic_fetch_sub_explicit(&active_sessions, 1, memory_order_relaxed);
+}
+
+// Growable text buffer for the reports
+typedef struct {
+    char *data;
+    size_t len, cap;
+} Text;
+
+static void text_printf(Text *text, const char *format, ...) {
+    if (!text->data) return;
+    while (1) {
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(text->data + text->len, text->cap - text->len, format, args);
+        va_end(args);
+        if (n < 0) return;
+        if ((size_t)n < text->cap - text->len) {
+            text->len += n;
+            return;
+        }
+        char *data = realloc(text->data, text->cap * 2 + n);
+        if (!data) {
+            free(text->data);
+            text->data = NULL;
+            return;
+        }
+        text->data = data;
+        text->cap = text->cap * 2 + n;
+    }
+}
+
+static void text_init(Text *text) {
+    text->len = 0;
+    text->cap = 4096;
+    text->data = malloc(text->cap);
+    if (text->data) text->data[0] = '\0';
+}
+
+// Bucket bounds (seconds) of the exported Prometheus histograms
+static const double export_bounds[] = {1e-6, 5e-6, 1e-5, 5e-5, 1e-4, 5e-4, 1e-3, 5e-3, 1e-2, 5e-2, 0.1, 0.5, 1, 5};
+
+static void render_histogram(Text *text, const char *name, const char *label, const char *value, const Histogram *h) {
+    uint64_t cumulative = 0;
+    int bucket = 0;
+    for (size_t b = 0; b < sizeof(export_bounds) / sizeof(export_bounds[0]); b++) {
+        uint64_t bound = (uint64_t)(export_bounds[b] * 1e9);
+        for (; bucket < METRICS_BUCKETS && bucket_upper(bucket) <= bound; bucket++) {
+            cumulative += atomic_load_explicit(&h->buckets[bucket], memory_order_relaxed);
+        }
+        text_printf(text, "%s_bucket{%s=\"%s\",le=\"%g\"} %llu\n", name, label, value, export_bounds[b],
+                    (unsigned long long)cumulative);
+    }
+    uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    text_printf(text, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label, value, (unsigned long long)count);
+    text_printf(text, "%s_sum{%s=\"%s\"} %.9f\n", name, label, value,
+                atomic_load_explicit(&h->sum, memory_order_relaxed) / 1e9);
+    text_printf(text, "%s_count{%s=\"%s\"} %llu\n", name, label, value, (unsigned long long)count);
+}
+
+char *metrics_render_prometheus(void) {
+    Text text;
+    text_init(&text);
+
+    text_printf(&text, "# HELP academia_request_duration_seconds Time from submission to completion of a request.\n");
+    text_printf(&text, "# TYPE academia_request_duration_seconds histogram\n");
+    for (int op = 1; op < METRICS_OPS; op++) {
+        if (op_names[op] && atomic_load_explicit(&request_latency[op].count, memory_order_relaxed) > 0) {
+            render_histogram(&text, "academia_request_duration_seconds", "op", op_names[op], &request_latency[op]);
+        }
+    }
+
+    text_printf(&text, "# HELP academia_request_results_total Completed requests by return code.\n");
+    text_printf(&text, "# TYPE academia_request_results_total counter\n");
+    for (int op = 1; op < METRICS_OPS; op++) {
+        for (int code = 0; code < METRICS_RESULT_CODES; code++) {
+            uint64_t n = atomic_load_explicit(&request_results[op][code], memory_order_relaxed);
+            if (op_names[op] && n > 0) {
+                text_printf(&text, "academia_request_results_total{op=\"%s\",result=\"%s\"} %llu\n", op_names[op],
+                            result_names[code], (unsigned long long)n);
+            }
+        }
+    }
+
+    text_printf(&text, "# HELP academia_lock_wait_seconds Time spent waiting for a lock.\n");
+    text_printf(&text, "# TYPE academia_lock_wait_seconds histogram\n");
+    for (int lock = 0; lock < METRICS_LOCKS; lock++) {
+        render_histogram(&text, "academia_lock_wait_seconds", "lock", lock_names[lock], &lock_wait[lock]);
+    }
+
+    text_printf(&text, "# HELP academia_lock_hold_seconds_total Time file_sem was held, by holding operation.\n");
+    text_printf(&text, "# TYPE academia_lock_hold_seconds_total counter\n");
+    for (int i = 0; i < METRICS_LOCK_HOLDERS; i++) {
+        const char *name = atomic_load(&lock_holders[i].name);
+        if (name) text_printf(&text, "academia_lock_hold_seconds_total{holder=\"%s\"} %.9f\n", name,
+                              atomic_load(&lock_holders[i].hold_ns) / 1e9);
+    }
+    text_printf(&text, "# HELP academia_lock_holds_total Times file_sem was taken, by holding operation.\n");
+    text_printf(&text, "# TYPE academia_lock_holds_total counter\n");
+    for (int i = 0; i < METRICS_LOCK_HOLDERS; i++) {
+        const char *name = atomic_load(&lock_holders[i].name);
+        if (name) text_printf(&text, "academia_lock_holds_total{holder=\"%s\"} %llu\n", name,
+                              (unsigned long long)atomic_load(&lock_holders[i].holds));
+    }
+    text_printf(&text, "# HELP academia_lock_blocked_seconds_total Hold time of file_sem times the operations waiting behind it.\n");
+    text_printf(&text, "# TYPE academia_lock_blocked_seconds_total counter\n");
+    for (int i = 0; i < METRICS_LOCK_HOLDERS; i++) {
+        const char *name = atomic_load(&lock_holders[i].name);
+        if (name) text_printf(&text, "academia_lock_blocked_seconds_total{holder=\"%s\"} %.9f\n", name,
+                              atomic_load(&lock_holders[i].blocked_ns) / 1e9);
+    }
+    text_printf(&text, "# HELP academia_lock_timeouts_total Lock waits given up, by the operation holding file_sem.\n");
+    text_printf(&text, "# TYPE academia_lock_timeouts_total counter\n");
+    for (int i = 0; i < METRICS_LOCK_HOLDERS; i++) {
+        const char *name = atomic_load(&lock_holders[i].name);
+        if (name) text_printf(&text, "academia_lock_timeouts_total{holder=\"%s\"} %llu\n", name,
+                              (unsigned long long)atomic_load(&lock_holders[i].timeouts));
+    }
+
+    text_printf(&text, "# HELP academia_cache_lookups_total Response cache lookups by outcome.\n");
+    text_printf(&text, "# TYPE academia_cache_lookups_total counter\n");
+    for (int cache = 0; cache < METRICS_CACHES; cache++) {
+        for (int hit = 1; hit >= 0; hit--) {
+            text_printf(&text, "academia_cache_lookups_total{cache=\"%s\",result=\"%s\"} %llu\n", cache_names[cache],
+                        hit ? "hit" : "miss", (unsigned long long)atomic_load(&cache_lookups[cache][hit]));
+        }
+    }
+
+    text_printf(&text, "# HELP academia_compressed_responses_total Responses compressed for the client.\n");
+    text_printf(&text, "# TYPE academia_compressed_responses_total counter\n");
+    text_printf(&text, "academia_compressed_responses_total %llu\n", (unsigned long long)atomic_load(&compressed_responses));
+    text_printf(&text, "# HELP academia_compression_bytes_total Text bytes of compressed responses, before and after.\n");
+    text_printf(&text, "# TYPE academia_compression_bytes_total counter\n");
+    text_printf(&text, "academia_compression_bytes_total{stage=\"in\"} %llu\n", (unsigned long long)atomic_load(&compression_in));
+    text_printf(&text, "academia_compression_bytes_total{stage=\"out\"} %llu\n", (unsigned long long)atomic_load(&compression_out));
+    text_printf(&text, "# HELP academia_compression_cpu_seconds_total Thread CPU time spent compressing responses.\n");
+    text_printf(&text, "# TYPE academia_compression_cpu_seconds_total counter\n");
+    text_printf(&text, "academia_compression_cpu_seconds_total %.6f\n", atomic_load(&compression_cpu_ns) / 1e9);
+    text_printf(&text, "# HELP academia_seat_events_total Seat-availability changes with subscribers.\n");
+    text_printf(&text, "# TYPE academia_seat_events_total counter\n");
+    text_printf(&text, "academia_seat_events_total %llu\n", (unsigned long long)atomic_load(&seat_events));
+    text_printf(&text, "# HELP academia_seat_event_pushes_total Seat-availability events pushed to sessions.\n");
+    text_printf(&text, "# TYPE academia_seat_event_pushes_total counter\n");
+    text_printf(&text, "academia_seat_event_pushes_total %llu\n", (unsigned long long)atomic_load(&seat_event_frames));
+
+    text_printf(&text, "# HELP academia_active_sessions Client connections currently open.\n");
+    text_printf(&text, "# TYPE academia_active_sessions gauge\n");
+    text_printf(&text, "academia_active_sessions %ld\n", atomic_load(&active_sessions));
+    text_printf(&text, "# HELP academia_sessions_total Client connections accepted.\n");
+    text_printf(&text, "# TYPE academia_sessions_total counter\n");
+    text_printf(&text, "academia_sessions_total %llu\n", (unsigned long long)atomic_load(&sessions_total));
+    return text.data;
+}
+
+static void summary_line(Text *text, const char *name, const Histogram *h) {
+    uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    text_printf(text, "%s: n=%llu p50=%lluus p99=%lluus max=%lluus\n", name, (unsigned long long)count,
+                (unsigned long long)histogram_percentile(h, 0.5) / 1000,
+                (unsigned long long)histogram_percentile(h, 0.99) / 1000,
+                (unsigned long long)atomic_load_explicit(&h->max, memory_order_relaxed) / 1000);
+}
+
+// The holders that kept the most operations waiting, worst first
+static void render_top_holders(Text *text) {
+    int top[METRICS_TOP_HOLDERS], count = 0;
+    uint64_t blocked[METRICS_TOP_HOLDERS];
+    for (int i = 0; i < METRICS_LOCK_HOLDERS; i++) {
+        if (!atomic_load(&lock_holders[i].name)) continue;
+        uint64_t b = atomic_load(&lock_holders[i].blocked_ns);
+        if (b == 0 && atomic_load(&lock_holders[i].timeouts) == 0) continue;
+        int at = count < METRICS_TOP_HOLDERS ? count++ : METRICS_TOP_HOLDERS;
+        while (at > 0 && blocked[at - 1] < b) {
+            if (at < METRICS_TOP_HOLDERS) {
+                top[at] = top[at - 1];
+                blocked[at] = blocked[at - 1];
+            }
+            at--;
+        }
+        if (at < METRICS_TOP_HOLDERS) {
+            top[at] = i;
+            blocked[at] = b;
+        }
+    }
+    if (count > 0) text_printf(text, "Lock contention (file_sem holders):\n");
+    for (int k = 0; k < count; k++) {
+        LockHolder *h = &lock_holders[top[k]];
+        uint64_t holds = atomic_load(&h->holds);
+        text_printf(text, "  %s: blocked %.1f ms, %llu holds avg=%lluus max=%lluus, %.1f waiters avg, %llu timeouts\n",
+                    atomic_load(&h->name), blocked[k] / 1e6, (unsigned long long)holds,
+                    (unsigned long long)(holds ? atomic_load(&h->hold_ns) / holds / 1000 : 0),
+                    (unsigned long long)atomic_load(&h->max_hold_ns) / 1000,
+                    holds ? (double)atomic_load(&h->waiters) / holds : 0.0,
+                    (unsigned long long)atomic_load(&h->timeouts));
+    }
+}
+
+char *metrics_render_summary(void) {
+    Text text;
+    text_init(&text);
+    text_printf(&text, "Server Metrics:\nSessions: %ld active, %llu total\n", atomic_load(&active_sessions),
+                (unsigned long long)atomic_load(&sessions_total));
+    for (int op = 1; op < METRICS_OPS; op++) {
+        if (op_names[op] && atomic_load_explicit(&request_latency[op].count, memory_order_relaxed) > 0) {
+            summary_line(&text, op_names[op], &request_latency[op]);
+            for (int code = 1; code < METRICS_RESULT_CODES; code++) {
+                uint64_t n = atomic_load_explicit(&request_results[op][code], memory_order_relaxed);
+                if (n > 0) text_printf(&text, "  %s: %llu\n", result_names[code], (unsigned long long)n);
+            }
+        }
+    }
+    for (int lock = 0; lock < METRICS_LOCKS; lock++) {
+        summary_line(&text, lock_names[lock], &lock_wait[lock]);
+    }
+    render_top_holders(&text);
+    for (int cache = 0; cache < METRICS_CACHES; cache++) {
+        uint64_t hits = atomic_load(&cache_lookups[cache][1]), misses = atomic_load(&cache_lookups[cache][0]);
+        text_printf(&text, "%s cache: %llu hits, %llu misses (%.1f%% hit rate)\n", cache_names[cache],
+                    (unsigned long long)hits, (unsigned long long)misses,
+                    hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+    }
+    uint64_t in = atomic_load(&compression_in), out = atomic_load(&compression_out);
+    text_printf(&text, "compression: %llu responses, %llu -> %llu bytes (%.1f%% saved), %.1f ms CPU\n",
+                (unsigned long long)atomic_load(&compressed_responses), (unsigned long long)in, (unsigned long long)out,
+                in ? 100.0 * (in - out) / in : 0.0, atomic_load(&compression_cpu_ns) / 1e6);
+    text_printf(&text, "seat events: %llu, pushed to %llu sessions\n", (unsigned long long)atomic_load(&seat_events),
+                (unsigned long long)atomic_load(&seat_event_frames));
+    return text.data;
+}
+
+typedef struct {
+    char *path;
+    int interval;
+} DumpConfig;
+
+// Write to a temporary file and rename it, so readers never see a partial dump
+static void *dump_thread(void *arg) {
+    DumpConfig *config = arg;
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", config->path);
+    while (1) {
+        sleep(config->interval);
+        char *text = metrics_render_prometheus();
+        if (!text) continue;
+        FILE *file = fopen(tmp, "w");
+        if (file) {
+            fputs(text, file);
+            if (fclose(file) == 0) rename(tmp, config->path);
+        }
+        free(text);
+    }
+    return NULL;
+}
+
+int metrics_start_dump(const char *path, int interval) {
+    DumpConfig *config = malloc(sizeof(DumpConfig));
+    if (!config) return -1;
+    config->path = strdup(path);
+    config->interval = interval;
+    pthread_t thread;
+    if (!config->path || pthread_create(&thread, NULL, dump_thread, config) != 0) {
+        free(config->path);
+        free(config);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
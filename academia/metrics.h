@@ -0,0 +1,66 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Server metrics: latency histograms, result counters and gauges.
+//
+// Histograms are HDR-style: values (nanoseconds) fall into log-linear buckets
+// with 16 sub-buckets per power of two, so every recorded value keeps about
+// 6% precision from 1 ns to over a day. Recording is a few relaxed atomic
+// adds and never takes a lock.
+
+#define METRICS_SUB_BUCKETS 16
+#define METRICS_BUCKETS 720
+#define METRICS_OPS 32                  // Opcodes below this are tracked
+#define METRICS_RESULT_CODES 10         // ERR_NONE .. ERR_NOT_MODIFIED, then "other"
+#define METRICS_DUMP_INTERVAL 10        // Seconds between dumps of the metrics file
+#define METRICS_LOCK_HOLDERS 32         // Operations tracked as holders of file_sem
+#define METRICS_TOP_HOLDERS 5           // Holders listed in the summary
+
+typedef struct {
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t max;
+    atomic_uint_fast64_t buckets[METRICS_BUCKETS];
+} Histogram;
+
+enum MetricsLock { METRICS_LOCK_FILE_SEM, METRICS_LOCK_FCNTL_READ, METRICS_LOCK_FCNTL_WRITE, METRICS_LOCKS };
+
+enum MetricsCache { METRICS_CACHE_CATALOG, METRICS_CACHES };
+
+// Monotonic clock in nanoseconds
+uint64_t metrics_now(void);
+
+void histogram_record(Histogram *h, uint64_t value);
+// Smallest recorded-value bound below which a fraction q of the samples fall
+uint64_t histogram_percentile(const Histogram *h, double q);
+
+// Request latency (queueing plus execution) and its return code
+void metrics_record_request(int op, int ret, uint64_t ns);
+void metrics_record_lock_wait(enum MetricsLock lock, uint64_t ns);
+// Contention by holder, a static string naming the operation: a hold of
+// file_sem for ns with waiters operations queued behind it at release, and
+// a waiter that gave up while holder had it
+void metrics_record_lock_hold(const char *holder, uint64_t ns, int waiters);
+void metrics_record_lock_timeout(const char *holder);
+void metrics_record_cache(enum MetricsCache cache, int hit);
+// A response text of in bytes sent as out bytes, compressed in cpu_ns of thread CPU time
+void metrics_record_compression(size_t in, size_t out, uint64_t cpu_ns);
+// A seat-availability change with subscribers, and the sessions it was pushed to
+void metrics_record_seat_event(void);
+void metrics_record_seat_pushes(int sessions);
+void metrics_session_opened(void);
+void metrics_session_closed(void);
+
+// Prometheus text exposition format, malloc'd
+char *metrics_render_prometheus(void);
+// Short human-readable report for the admin menu, malloc'd
+char *metrics_render_summary(void);
+
+// Rewrite path with the Prometheus text every interval seconds
+int metrics_start_dump(const char *path, int interval);
+
+#endif
@@ -0,0 +1,165 @@
+#include "academia.h"
+#include "protocol.h"
+#include <arpa/inet.h>
+
+static int reserve(ProtoBuffer *buf, size_t extra) {
+    if (buf->len + extra <= buf->cap) return 0;
+    size_t cap = buf->cap ? buf->cap : 256;
+    while (cap < buf->len + extra) cap *= 2;
+    char *data = realloc(buf->data, cap);
+    if (!data) return -1;
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+static void put_u32(char *p, uint32_t value) {
+    uint32_t net = htonl(value);
+    memcpy(p, &net, sizeof(net));
+}
+
+static uint32_t get_u32(const char *p) {
+    uint32_t net;
+    memcpy(&net, p, sizeof(net));
+    return ntohl(net);
+}
+
+void proto_buffer_init(ProtoBuffer *buf) {
+    buf->data = NULL;
+    buf->len = buf->cap = 0;
+}
+
+void proto_buffer_free(ProtoBuffer *buf) {
+    free(buf->data);
+    proto_buffer_init(buf);
+}
+
+int proto_begin(ProtoBuffer *buf, uint8_t opcode, uint8_t flags, uint32_t request_id) {
+    buf->len = 0;
+    if (reserve(buf, PROTO_HEADER_SIZE) < 0) return -1;
+    put_u32(buf->data, 0);
+    buf->data[4] = opcode;
+    buf->data[5] = flags;
+    buf->data[6] = buf->data[7] = 0;
+    put_u32(buf->data + 8, request_id);
+    buf->len = PROTO_HEADER_SIZE;
+    return 0;
+}
+
+int proto_add_int(ProtoBuffer *buf, int32_t value) {
+    if (reserve(buf, 9) < 0) return -1;
+    char *p = buf->data + buf->len;
+    p[0] = PROTO_FIELD_INT;
+    put_u32(p + 1, 4);
+    put_u32(p + 5, (uint32_t)value);
+    buf->len += 9;
+    return 0;
+}
+
+int proto_add_bytes(ProtoBuffer *buf, const char *data, size_t len) {
+    if (reserve(buf, 5 + len) < 0) return -1;
+    char *p = buf->data + buf->len;
+    p[0] = PROTO_FIELD_STR;
+    put_u32(p + 1, (uint32_t)len);
+    memcpy(p + 5, data, len);
+    buf->len += 5 + len;
+    return 0;
+}
+
+int proto_add_str(ProtoBuffer *buf, const char *str) {
+    return proto_add_bytes(buf, str, strlen(str));
+}
+
+void proto_finish(ProtoBuffer *buf) {
+    put_u32(buf->data, (uint32_t)(buf->len - 4));
+}
+
+int proto_add_str_header(ProtoBuffer *buf, size_t len) {
+    if (reserve(buf, 5) < 0) return -1;
+    char *p = buf->data + buf->len;
+    p[0] = PROTO_FIELD_STR;
+    put_u32(p + 1, (uint32_t)len);
+    buf->len += 5;
+    return 0;
+}
+
+void proto_finish_external(ProtoBuffer *buf, size_t external) {
+    put_u32(buf->data, (uint32_t)(buf->len - 4 + external));
+}
+
+int proto_build_response(ProtoBuffer *buf, uint8_t opcode, uint32_t request_id, int32_t status, const char *text) {
+    if (proto_begin(buf, opcode, PROTO_FLAG_RESPONSE, request_id) < 0) return -1;
+    if (proto_add_int(buf, status) < 0) return -1;
+    if (proto_add_str(buf, text ? text : "") < 0) return -1;
+    proto_finish(buf);
+    return 0;
+}
+
+int proto_parse(const char *body, size_t len, ProtoMessage *msg) {
+    if (len < PROTO_HEADER_SIZE - 4) return -1;
+    msg->opcode = (uint8_t)body[0];
+    msg->flags = (uint8_t)body[1];
+    msg->request_id = get_u32(body + 4);
+    msg->field_count = 0;
+
+    size_t pos = PROTO_HEADER_SIZE - 4;
+    while (pos < len) {
+        if (msg->field_count == PROTO_MAX_FIELDS || len - pos < 5) return -1;
+        ProtoField *field = &msg->fields[msg->field_count];
+        field->type = (uint8_t)body[pos];
+        field->len = get_u32(body + pos + 1);
+        pos += 5;
+        if (field->len > len - pos) return -1;
+        if (field->type == PROTO_FIELD_INT) {
+            if (field->len != 4) return -1;
+            field->num = (int32_t)get_u32(body + pos);
+            field->str = NULL;
+        } else if (field->type == PROTO_FIELD_STR) {
+            field->str = body + pos;
+            field->num = 0;
+        } else {
+            return -1;
+        }
+        pos += field->len;
+        msg->field_count++;
+    }
+    return 0;
+}
+
+int proto_get_str(const ProtoMessage *msg, int i, char *dst, size_t size) {
+    dst[0] = '\0';
+    if (i >= msg->field_count || msg->fields[i].type != PROTO_FIELD_STR) return -1;
+    size_t len = msg->fields[i].len < size - 1 ? msg->fields[i].len : size - 1;
+    memcpy(dst, msg->fields[i].str, len);
+    dst[len] = '\0';
+    // An embedded NUL would cut the string short just the same
+    return len == msg->fields[i].len && memchr(dst, '\0', len) == NULL ? 0 : -1;
+}
+
+int32_t proto_get_int(const ProtoMessage *msg, int i) {
+    if (i >= msg->field_count || msg->fields[i].type != PROTO_FIELD_INT) return 0;
+    return msg->fields[i].num;
+}
+
+const char *proto_op_fields(int opcode) {
+    switch (opcode) {
+        case OP_AUTHENTICATE: return "rip";
+        case OP_ADD_STUDENT:
+        case OP_ADD_FACULTY: return "inp";
+        case OP_ACTIVATE_STUDENT:
+        case OP_BLOCK_STUDENT:
+        case OP_ENROLL_COURSE:
+        case OP_DROP_COURSE:
+        case OP_REMOVE_COURSE:
+        case OP_SUBSCRIBE:
+        case OP_UNSUBSCRIBE: return "i";
+        case OP_UPDATE_STUDENT:
+        case OP_UPDATE_FACULTY: return "in";
+        case OP_CHANGE_PASSWORD: return "p";
+        case OP_RESUME: return "t";
+        case OP_HELLO: return "c";
+        case OP_ADD_COURSE:
+        case OP_UPDATE_COURSE: return "ins";
+        default: return "";
+    }
+}
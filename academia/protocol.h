@@ -0,0 +1,122 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary request/response protocol.
+//
+// A client selects it by sending PROTO_MAGIC instead of a login choice; the
+// server answers with an OP_HELLO response. After that every message is a
+// frame:
+//
+//   uint32 length      bytes after this field, network order
+//   uint8  opcode      enum Opcode
+//   uint8  flags       PROTO_FLAG_*
+//   uint16 reserved
+//   uint32 request_id  chosen by the client, echoed in the response
+//   fields             uint8 type, uint32 length, data (ints are 4 bytes, network order)
+//
+// Requests carry the fields listed by proto_op_fields(). Responses carry an
+// int status (ERR_* code) followed by a string with the message or listing.
+// A response may add a third string field with a new session token
+// (session_token.h); OP_RESUME presents it on a new connection instead of
+// logging in again.
+//
+// Catalog revalidation: course listing responses (OP_VIEW_ALL_COURSES,
+// OP_VIEW_FACULTY_COURSES) add a third string field with the catalog
+// version they show. A client that keeps the listing may send that version
+// as an extra string field of its next request for it; while the catalog
+// has not changed the server answers ERR_NOT_MODIFIED with an empty text
+// instead of the listing. Servers that predate this ignore the extra field.
+//
+// Seat availability: a student's OP_SUBSCRIBE to a course asks for an
+// OP_SEAT_EVENT frame (PROTO_FLAG_PUSH, request id 0) whenever seats free up
+// in it or its total seats change, until OP_UNSUBSCRIBE or the end of the
+// connection. The event carries status 0, a message, the course id, and
+// ints with the free and total seats.
+// Several requests may be in flight; responses can arrive in any order.
+// Frames are read and written with framed_io.h (the length prefix is its
+// message header).
+//
+// Command mode: clients that render menus and result messages themselves
+// (menus.h) set PROTO_FLAG_TERSE, and the server then leaves the text empty
+// for everything except listings.
+//
+// Capabilities: right after the server's OP_HELLO a client may send an
+// OP_HELLO request with an int of the PROTO_CAP_* bits it supports. The
+// response adds a third field, an int with the bits the server enabled.
+// Servers that predate this answer ERR_INVALID_INPUT and nothing changes.
+// With PROTO_CAP_DEFLATE, responses whose text reaches the server's
+// threshold may come with PROTO_FLAG_DEFLATE and a compressed text field
+// (compress.h).
+
+#define PROTO_MAGIC "ACB1"
+#define PROTO_MAGIC_LEN 4
+#define PROTO_HEADER_SIZE 12
+#define PROTO_MAX_FRAME (1024 * 1024)
+#define PROTO_MAX_REQUEST 4096
+#define PROTO_MAX_FIELDS 8
+#define PROTO_MAX_INFLIGHT 32
+
+#define PROTO_FLAG_RESPONSE 0x01
+#define PROTO_FLAG_TERSE 0x02    // Request: reply with the status only unless there is a listing
+#define PROTO_FLAG_DEFLATE 0x04  // Response: the text field is compressed
+#define PROTO_FLAG_PUSH 0x08     // Response: an event the server sent on its own, request id 0
+
+#define PROTO_CAP_DEFLATE 0x01
+
+enum ProtoFieldType { PROTO_FIELD_INT = 1, PROTO_FIELD_STR = 2 };
+
+typedef struct {
+    uint8_t type;
+    uint32_t len;
+    const char *str;   // Points into the frame buffer, not NUL-terminated
+    int32_t num;
+} ProtoField;
+
+typedef struct {
+    uint8_t opcode;
+    uint8_t flags;
+    uint32_t request_id;
+    int field_count;
+    ProtoField fields[PROTO_MAX_FIELDS];
+} ProtoMessage;
+
+// Growable buffer a frame is encoded into
+typedef struct {
+    char *data;
+    size_t len, cap;
+} ProtoBuffer;
+
+void proto_buffer_init(ProtoBuffer *buf);
+void proto_buffer_free(ProtoBuffer *buf);
+
+// Encoding: begin, add fields, finish (patches the length prefix)
+int proto_begin(ProtoBuffer *buf, uint8_t opcode, uint8_t flags, uint32_t request_id);
+int proto_add_int(ProtoBuffer *buf, int32_t value);
+int proto_add_str(ProtoBuffer *buf, const char *str);
+int proto_add_bytes(ProtoBuffer *buf, const char *data, size_t len);
+void proto_finish(ProtoBuffer *buf);
+
+// A last string field whose len data bytes are sent separately, after the
+// encoded frame (for listings sent with framed_send_file)
+int proto_add_str_header(ProtoBuffer *buf, size_t len);
+void proto_finish_external(ProtoBuffer *buf, size_t external);
+
+// Encode a response frame with a status and a text field in one call
+int proto_build_response(ProtoBuffer *buf, uint8_t opcode, uint32_t request_id, int32_t status, const char *text);
+
+// Decode a frame body (everything after the length prefix)
+int proto_parse(const char *body, size_t len, ProtoMessage *msg);
+
+// Copy string field i into dst as a NUL-terminated string ("" if missing).
+// -1 if it is missing or did not fit whole (dst then has what fit).
+int proto_get_str(const ProtoMessage *msg, int i, char *dst, size_t size);
+int32_t proto_get_int(const ProtoMessage *msg, int i);
+
+// Request fields per opcode: 'r' role, 'i' id, 'n' name, 'p' password, 's' seats, 't' token,
+// 'c' capabilities
+const char *proto_op_fields(int opcode);
+
+#endif
@@ -0,0 +1,191 @@
+#include "academia.h"
+#include "session_token.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/random.h>
+
+static uint8_t token_key[16];
+
+// Per-user generation counters; users without an entry are at generation 0
+typedef struct Generation {
+    char user_id[MAX_ID];
+    uint32_t value;
+    struct Generation *next;
+} Generation;
+
+static Generation *generations[SESSION_REVOKE_BUCKETS];
+static pthread_mutex_t generations_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Atomic(RevokeListener) revoke_listener;
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND                                                          \
+    do {                                                                  \
+        v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32);         \
+        v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2;                            \
+        v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0;                            \
+        v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32);         \
+    } while (0)
+
+static uint64_t load_le64(const uint8_t *p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+// SipHash-2-4 of data under token_key
+static uint64_t siphash(const char *data, size_t len) {
+    const uint8_t *in = (const uint8_t *)data;
+    uint64_t k0 = load_le64(token_key), k1 = load_le64(token_key + 8);
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0, v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0, v3 = 0x7465646279746573ULL ^ k1;
+    uint64_t b = (uint64_t)len << 56;
+
+    size_t blocks = len & ~(size_t)7;
+    for (size_t i = 0; i < blocks; i += 8) {
+        uint64_t m = load_le64(in + i);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+    for (size_t i = blocks; i < len; i++) b |= (uint64_t)in[i] << (8 * (i - blocks));
+
+    v3 ^= b;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= b;
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static unsigned bucket_of(const char *user_id) {
+    unsigned hash = 5381;
+    for (const char *p = user_id; *p; p++) hash = hash * 33 + (unsigned char)*p;
+    return hash % SESSION_REVOKE_BUCKETS;
+}
+
+// Find (or with create set, add) the generation entry of a user. Caller holds generations_lock.
+static Generation *find_generation(const char *user_id, int create) {
+    unsigned bucket = bucket_of(user_id);
+    for (Generation *g = generations[bucket]; g; g = g->next) {
+        if (strcmp(g->user_id, user_id) == 0) return g;
+    }
+    if (!create) return NULL;
+    Generation *g = calloc(1, sizeof(Generation));
+    if (!g) return NULL;
+    strncpy(g->user_id, user_id, MAX_ID - 1);
+    g->next = generations[bucket];
+    generations[bucket] = g;
+    return g;
+}
+
+static uint32_t current_generation(const char *user_id) {
+    pthread_mutex_lock(&generations_lock);
+    Generation *g = find_generation(user_id, 0);
+    uint32_t value = g ? g->value : 0;
+    pthread_mutex_unlock(&generations_lock);
+    return value;
+}
+
+int session_tokens_init(void) {
+    size_t got = 0;
+    while (got < sizeof(token_key)) {
+        ssize_t n = getrandom(token_key + got, sizeof(token_key) - got, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        got += n;
+    }
+    return 0;
+}
+
+int session_token_issue(const char *user_id, enum Role role, char *token, size_t size) {
+    uint32_t expiry = (uint32_t)time(NULL) + SESSION_TOKEN_TTL;
+    int len = snprintf(token, size, "%s:%d:%u:%u", user_id, (int)role, expiry, current_generation(user_id));
+    if (len < 0 || (size_t)len + 17 >= size) return -1;
+    snprintf(token + len, size - len, ":%016llx", (unsigned long long)siphash(token, len));
+    return 0;
+}
+
+int session_token_verify(const char *token, char *user_id, enum Role *role) {
+    const char *tag_start = strrchr(token, ':');
+    if (!tag_start || strlen(tag_start + 1) != 16) return -1;
+    char *end;
+    unsigned long long tag = strtoull(tag_start + 1, &end, 16);
+    if (*end != '\0' || tag != siphash(token, tag_start - token)) return -1;
+
+    // The MAC covers everything parsed below
+    char id[MAX_ID];
+    int role_value;
+    unsigned expiry, generation;
+    if (sscanf(token, "%9[^:]:%d:%u:%u:", id, &role_value, &expiry, &generation) != 4) return -1;
+    if ((uint32_t)time(NULL) > expiry || generation != current_generation(id)) return -1;
+
+    strcpy(user_id, id);
+    *role = (enum Role)role_value;
+    return 0;
+}
+
+void session_token_revoke(const char *user_id) {
+    pthread_mutex_lock(&generations_lock);
+    Generation *g = find_generation(user_id, 1);
+    if (g) g->value++;
+    pthread_mutex_unlock(&generations_lock);
+    RevokeListener listener = atomic_load(&revoke_listener);
+    if (listener) listener(user_id);
+}
+
+void session_token_set_revoke_listener(RevokeListener listener) {
+    atomic_store(&revoke_listener, listener);
+}
+
+// Saved state: the key, then one (user_id, generation) record per revoked user
+typedef struct {
+    char user_id[MAX_ID];
+    uint32_t value;
+} SavedGeneration;
+
+void *session_tokens_save(size_t *len) {
+    pthread_mutex_lock(&generations_lock);
+    size_t count = 0;
+    for (int b = 0; b < SESSION_REVOKE_BUCKETS; b++) {
+        for (Generation *g = generations[b]; g; g = g->next) count++;
+    }
+    char *data = malloc(sizeof(token_key) + count * sizeof(SavedGeneration));
+    if (data) {
+        memcpy(data, token_key, sizeof(token_key));
+        SavedGeneration *out = (SavedGeneration *)(data + sizeof(token_key));
+        for (int b = 0; b < SESSION_REVOKE_BUCKETS; b++) {
+            for (Generation *g = generations[b]; g; g = g->next, out++) {
+                memcpy(out->user_id, g->user_id, MAX_ID);
+                out->value = g->value;
+            }
+        }
+        *len = sizeof(token_key) + count * sizeof(SavedGeneration);
+    }
+    pthread_mutex_unlock(&generations_lock);
+    return data;
+}
+
+int session_tokens_load(const void *data, size_t len) {
+    if (len < sizeof(token_key) || (len - sizeof(token_key)) % sizeof(SavedGeneration) != 0) return -1;
+    memcpy(token_key, data, sizeof(token_key));
+    size_t count = (len - sizeof(token_key)) / sizeof(SavedGeneration);
+    const SavedGeneration *in = (const SavedGeneration *)((const char *)data + sizeof(token_key));
+
+    pthread_mutex_lock(&generations_lock);
+    for (size_t i = 0; i < count; i++) {
+        char user_id[MAX_ID];
+        memcpy(user_id, in[i].user_id, MAX_ID);
+        user_id[MAX_ID - 1] = '\0';
+        Generation *g = find_generation(user_id, 1);
+        if (g) g->value = in[i].value;
+    }
+    pthread_mutex_unlock(&generations_lock);
+    return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef SESSION_TOKEN_H
+#define SESSION_TOKEN_H
+
+#include <stddef.h>
+#include "academia.h"
+
+// Signed session tokens for resuming a binary session after a reconnect.
+//
+// A token is "user:role:expiry:generation:tag" where tag is a SipHash-2-4 MAC
+// of the rest under a key generated at startup. Verifying one needs no file
+// access: the MAC and expiry are checked directly, and the generation must
+// match the user's current one in memory. Bumping the generation (password
+// change, blocked account) revokes every token issued before.
+
+#define SESSION_TOKEN_TTL (30 * 60)   // Seconds a token stays valid
+#define SESSION_TOKEN_MAX 96          // Buffer size for an encoded token
+#define SESSION_REVOKE_BUCKETS 256
+
+// Generate the signing key. Tokens from a previous run stop verifying.
+int session_tokens_init(void);
+
+// Encode a fresh token for user_id into token (SESSION_TOKEN_MAX bytes)
+int session_token_issue(const char *user_id, enum Role role, char *token, size_t size);
+// 0 and the token's user and role if it is authentic, unexpired and not revoked, else -1
+int session_token_verify(const char *token, char *user_id, enum Role *role);
+// Invalidate every token issued to user_id so far
+void session_token_revoke(const char *user_id);
+// Called after each revocation, from the revoking thread
+typedef void (*RevokeListener)(const char *user_id);
+void session_token_set_revoke_listener(RevokeListener listener);
+
+// Signing key and generations as one malloc'd blob, so a restarted server
+// keeps accepting (and keeps rejecting) the tokens its predecessor issued
+void *session_tokens_save(size_t *len);
+int session_tokens_load(const void *data, size_t len);
+
+#endif
@@ -0,0 +1,169 @@
+#include "work_queue.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <errno.h>
+
+// Number of sem_trywait attempts before a thread really goes to sleep
+#define WQ_SPIN_TRIES 64
+
+static void wait_token(sem_t *sem) {
+    for (int i = 0; i < WQ_SPIN_TRIES; i++) {
+        if (sem_trywait(sem) == 0) return;
+    }
+    while (sem_wait(sem) < 0 && errno == EINTR);
+}
+
+// Claim the next enqueue slot. A free slot is already reserved through
+// free_slots, so this only spins while a consumer finishes with the slot.
+static void ring_enqueue(WorkQueue *q, void *item) {
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    WorkSlot *slot;
+    while (1) {
+        slot = &q->slots[pos & q->mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            sched_yield();
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+    slot->item = item;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+// Take the oldest published item, or return 0 if none is visible yet
+static int ring_dequeue(WorkQueue *q, void **item) {
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    WorkSlot *slot;
+    while (1) {
+        slot = &q->slots[pos & q->mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+    *item = slot->item;
+    atomic_store_explicit(&slot->seq, pos + q->mask + 1, memory_order_release);
+    return 1;
+}
+
+int work_queue_init(WorkQueue *q, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    q->slots = malloc(sizeof(WorkSlot) * size);
+    if (!q->slots) return -1;
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&q->slots[i].seq, i);
+        q->slots[i].item = NULL;
+    }
+    q->mask = size - 1;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    atomic_init(&q->closed, 0);
+
+    if (sem_init(&q->items, 0, 0) < 0) {
+        free(q->slots);
+        return -1;
+    }
+    if (sem_init(&q->free_slots, 0, (unsigned int)size) < 0) {
+        sem_destroy(&q->items);
+        free(q->slots);
+        return -1;
+    }
+    return 0;
+}
+
+void work_queue_destroy(WorkQueue *q) {
+    sem_destroy(&q->items);
+    sem_destroy(&q->free_slots);
+    free(q->slots);
+    q->slots = NULL;
+}
+
+int work_queue_push(WorkQueue *q, void *item) {
+    return work_queue_push_batch(q, &item, 1);
+}
+
+int work_queue_push_batch(WorkQueue *q, void **items, int count) {
+    if (atomic_load_explicit(&q->closed, memory_order_acquire)) return -1;
+
+    for (int i = 0; i < count; i++) {
+        wait_token(&q->free_slots);
+        ring_enqueue(q, items[i]);
+    }
+    // One post per item: each wakes at most one sleeping consumer
+    for (int i = 0; i < count; i++) {
+        sem_post(&q->items);
+    }
+    return 0;
+}
+
+void *work_queue_pop(WorkQueue *q) {
+    void *item;
+    return work_queue_pop_batch(q, &item, 1) == 1 ? item : NULL;
+}
+
+int work_queue_pop_batch(WorkQueue *q, void **items, int max) {
+    int count = 0;
+
+    // Block for the first item only, then take whatever else is already there
+    wait_token(&q->items);
+    while (!ring_dequeue(q, &items[0])) {
+        if (atomic_load_explicit(&q->closed, memory_order_acquire)) {
+            // This was the close token: hand it on so the next consumer exits too
+            sem_post(&q->items);
+            return 0;
+        }
+        sched_yield(); // Producer claimed the slot but has not published it yet
+    }
+    count = 1;
+
+    while (count < max && sem_trywait(&q->items) == 0) {
+        if (!ring_dequeue(q, &items[count])) {
+            // Token without a visible item: give it back and stop batching
+            sem_post(&q->items);
+            break;
+        }
+        count++;
+    }
+
+    for (int i = 0; i < count; i++) {
+        sem_post(&q->free_slots);
+    }
+    return count;
+}
+
+int work_queue_try_pop(WorkQueue *q, void **item) {
+    if (sem_trywait(&q->items) < 0) return 0;
+    while (!ring_dequeue(q, item)) {
+        if (atomic_load_explicit(&q->closed, memory_order_acquire)) {
+            sem_post(&q->items);
+            return 0;
+        }
+        sched_yield();
+    }
+    sem_post(&q->free_slots);
+    return 1;
+}
+
+void work_queue_close(WorkQueue *q) {
+    atomic_store_explicit(&q->closed, 1, memory_order_release);
+    sem_post(&q->items);
+}
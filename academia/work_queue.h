@@ -0,0 +1,47 @@
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+#define WQ_CACHE_LINE 64
+
+// Ring slot: seq says whose turn the slot is (producer at pos, consumer at pos + 1)
+typedef struct {
+    atomic_size_t seq;
+    void *item;
+} WorkSlot;
+
+// Bounded multi-producer/multi-consumer queue of pointers.
+// The ring itself is lock-free; the two counting semaphores are only used to
+// sleep when the ring is full/empty, and every post wakes exactly one waiter.
+typedef struct {
+    WorkSlot *slots;
+    size_t mask;
+    _Alignas(WQ_CACHE_LINE) atomic_size_t enqueue_pos;
+    _Alignas(WQ_CACHE_LINE) atomic_size_t dequeue_pos;
+    _Alignas(WQ_CACHE_LINE) sem_t items;  // published items
+    sem_t free_slots;                     // slots producers may still claim
+    atomic_int closed;
+} WorkQueue;
+
+// Capacity is rounded up to a power of two
+int work_queue_init(WorkQueue *q, size_t capacity);
+void work_queue_destroy(WorkQueue *q);
+
+// Block while the queue is full. Return 0, or -1 once the queue is closed.
+int work_queue_push(WorkQueue *q, void *item);
+int work_queue_push_batch(WorkQueue *q, void **items, int count);
+
+// Block while the queue is empty. Return NULL / 0 once closed and drained.
+void *work_queue_pop(WorkQueue *q);
+int work_queue_pop_batch(WorkQueue *q, void **items, int max);
+// Take one item without blocking: 1, or 0 if none is queued
+int work_queue_try_pop(WorkQueue *q, void **item);
+
+// Stop accepting items and release every consumer after the queue drains.
+// Producers must have stopped pushing before this is called.
+void work_queue_close(WorkQueue *q);
+
+#endif
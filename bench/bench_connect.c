@@ -0,0 +1,91 @@
+// Connection-rate benchmark: how many new sessions per second the server accepts.
+//
+//   gcc -O2 -I../academia -o bench_connect bench_connect.c -pthread
+//   ./bench_connect [threads] [seconds]
+//
+// Each thread connects to the server on PORT, waits for the login screen and
+// disconnects, in a loop. Run it against `server --acceptors 1` and against
+// the default to compare a single accept loop with SO_REUSEPORT acceptors.
+#include "academia.h"
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <stdatomic.h>
+#include <time.h>
+
+static int threads = 8;
+static int seconds = 5;
+static atomic_int stop;
+static atomic_long connections, failures;
+static atomic_long latency_ns_max;
+static atomic_llong latency_ns_total;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Connect and read the length-prefixed login screen
+static int one_session(void) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(PORT), .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    int ok = connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+
+    char buf[512];
+    uint32_t len_net;
+    size_t got = 0;
+    while (ok && got < sizeof(len_net)) {
+        ssize_t n = read(sock, (char *)&len_net + got, sizeof(len_net) - got);
+        ok = n > 0;
+        if (ok) got += n;
+    }
+    size_t len = ok ? ntohl(len_net) : 0;
+    while (ok && len > 0) {
+        ssize_t n = read(sock, buf, len < sizeof(buf) ? len : sizeof(buf));
+        ok = n > 0;
+        if (ok) len -= n;
+    }
+    close(sock);
+    return ok ? 0 : -1;
+}
+
+static void *client_main(void *arg) {
+    (void)arg;
+    while (!atomic_load(&stop)) {
+        double start = now();
+        if (one_session() < 0) {
+            atomic_fetch_add(&failures, 1);
+            continue;
+        }
+        long ns = (long)((now() - start) * 1e9);
+        atomic_fetch_add(&connections, 1);
+        atomic_fetch_add(&latency_ns_total, ns);
+        long max = atomic_load(&latency_ns_max);
+        while (ns > max && !atomic_compare_exchange_weak(&latency_ns_max, &max, ns));
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) threads = atoi(argv[1]);
+    if (argc > 2) seconds = atoi(argv[2]);
+    if (threads <= 0 || seconds <= 0) {
+        fprintf(stderr, "Usage: %s [threads] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    pthread_t ids[threads];
+    double start = now();
+    for (int i = 0; i < threads; i++) pthread_create(&ids[i], NULL, client_main, NULL);
+    sleep(seconds);
+    atomic_store(&stop, 1);
+    for (int i = 0; i < threads; i++) pthread_join(ids[i], NULL);
+    double elapsed = now() - start;
+
+    long count = atomic_load(&connections);
+    printf("%d threads, %.1f s: %ld sessions (%.0f/s), %ld failed, avg %.0f us, max %.0f us\n", threads, elapsed,
+           count, count / elapsed, atomic_load(&failures), count ? atomic_load(&latency_ns_total) / 1e3 / count : 0.0,
+           atomic_load(&latency_ns_max) / 1e3);
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Enrollment-rush benchmark: many students enrolling in and dropping one course.
+//
+//   gcc -O2 -I../academia -o bench_enroll bench_enroll.c ../academia/client_lib.c ../academia/protocol.c ../academia/framed_io.c ../academia/compress.c -pthread -lz
+//   ./bench_enroll [students] [seconds]
+//
+// Needs a running server with the accounts from initial_setup. The setup adds
+// students b0..b<N-1> (as admin1) and the course "rush" (as f1); each student
+// then alternately enrolls in and drops "rush" through a client library pool
+// (client_lib.h), one request at a time. Run the server with --log-level debug
+// to see how many changes each write of the Course record carried.
+#include "academia.h"
+#include "client_lib.h"
+#include <stdatomic.h>
+#include <time.h>
+
+#define RUSH_COURSE "rush"
+
+static int students = 32;
+static int seconds = 5;
+static atomic_int stop;
+static atomic_long completed, succeeded, failures;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static ClientPool *session_open(enum Role role, const char *user_id, const char *password) {
+    ClientConfig config = {.size = 1};
+    int status;
+    return client_pool_open(&config, role, user_id, password, &status);
+}
+
+// Id of student i; -1 if it does not fit in MAX_ID (main() checks the last one)
+static int student_id(int i, char *id) {
+    char full[16];
+    int len = snprintf(full, sizeof(full), "b%d", i);
+    if (len < 0 || len >= MAX_ID) return -1;
+    memcpy(id, full, len + 1);
+    return 0;
+}
+
+// Create the students and the course; both may exist from an earlier run
+static int setup(void) {
+    ClientPool *pool = session_open(ADMIN, "admin1", "adminpass");
+    if (!pool) {
+        fprintf(stderr, "Admin login failed\n");
+        return -1;
+    }
+    for (int i = 0; i < students; i++) {
+        char id[MAX_ID];
+        student_id(i, id);
+        const char *fields[] = {id, "Bench", "pw"};
+        client_call(pool, OP_ADD_STUDENT, fields, NULL);
+    }
+    client_pool_close(pool);
+
+    if (!(pool = session_open(FACULTY, "f1", "pass2"))) {
+        fprintf(stderr, "Faculty login failed\n");
+        return -1;
+    }
+    char seats[16];
+    snprintf(seats, sizeof(seats), "%d", MAX_USERS);
+    const char *fields[] = {RUSH_COURSE, "Rush", seats};
+    client_call(pool, OP_ADD_COURSE, fields, NULL);
+    client_pool_close(pool);
+    return 0;
+}
+
+static void *student_main(void *arg) {
+    char id[MAX_ID];
+    student_id((int)(intptr_t)arg, id);
+    ClientPool *pool = session_open(STUDENT, id, "pw");
+    if (!pool) {
+        fprintf(stderr, "Login failed for %s\n", id);
+        atomic_fetch_add(&failures, 1);
+        return NULL;
+    }
+
+    // Start from a known state; the result of this drop does not matter
+    client_drop(pool, RUSH_COURSE, NULL);
+    for (int enroll = 1; !atomic_load(&stop); enroll = !enroll) {
+        int status = enroll ? client_enroll(pool, RUSH_COURSE, NULL) : client_drop(pool, RUSH_COURSE, NULL);
+        if (status == CLIENT_ERR_CONNECTION) {
+            atomic_fetch_add(&failures, 1);
+            break;
+        }
+        atomic_fetch_add(&completed, 1);
+        if (status == 0) atomic_fetch_add(&succeeded, 1);
+    }
+    client_pool_close(pool);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) students = atoi(argv[1]);
+    if (argc > 2) seconds = atoi(argv[2]);
+    char last[MAX_ID];
+    if (students <= 0 || students > MAX_USERS - 3 || student_id(students - 1, last) < 0 || seconds <= 0) {
+        fprintf(stderr, "Usage: %s [students (1-%d)] [seconds]\n", argv[0], MAX_USERS - 3);
+        return 1;
+    }
+    if (setup() < 0) return 1;
+
+    pthread_t ids[students];
+    double start = now();
+    for (int i = 0; i < students; i++) pthread_create(&ids[i], NULL, student_main, (void *)(intptr_t)i);
+    sleep(seconds);
+    atomic_store(&stop, 1);
+    for (int i = 0; i < students; i++) pthread_join(ids[i], NULL);
+    double elapsed = now() - start;
+
+    long count = atomic_load(&completed);
+    printf("%d students, %.1f s: %ld enroll/drop requests (%.0f/s), %ld succeeded, %ld failed\n", students, elapsed,
+           count, count / elapsed, atomic_load(&succeeded), atomic_load(&failures));
+    return 0;
+}
@@ -0,0 +1,168 @@
+// Framing microbenchmark: messages/sec of length-prefixed echo over loopback.
+//
+//   gcc -O2 -I../academia -o bench_framing bench_framing.c ../academia/framed_io.c -pthread
+//   ./bench_framing [messages] [payload_bytes] [window]
+//
+// Modes:
+//   naive      header and payload in two write() calls, unbuffered reads
+//   framed     framed_io.h, one request/response at a time
+//   pipelined  framed_io.h, window requests corked into one send
+#include "academia.h"
+#include "framed_io.h"
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <time.h>
+
+enum Mode { MODE_NAIVE, MODE_FRAMED, MODE_PIPELINED };
+
+static const char *mode_names[] = {"naive", "framed", "pipelined"};
+
+static int messages = 100000;
+static size_t payload_size = 64;
+static int window = 16;
+
+static int read_exact(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int naive_send(int fd, const char *data, uint32_t len) {
+    uint32_t len_net = htonl(len);
+    if (write(fd, &len_net, sizeof(len_net)) != sizeof(len_net)) return -1;
+    return write(fd, data, len) == (ssize_t)len ? 0 : -1;
+}
+
+static int naive_read(int fd, char *buf, size_t cap) {
+    uint32_t len_net;
+    if (read_exact(fd, &len_net, sizeof(len_net)) < 0) return -1;
+    uint32_t len = ntohl(len_net);
+    if (len > cap || read_exact(fd, buf, len) < 0) return -1;
+    return (int)len;
+}
+
+typedef struct {
+    int fd;
+    enum Mode mode;
+} EchoArgs;
+
+// Peer side: echo every message back until the connection closes
+static void *echo_thread(void *arg) {
+    EchoArgs *args = arg;
+    char *buf = malloc(payload_size);
+    if (args->mode == MODE_NAIVE) {
+        int len;
+        while ((len = naive_read(args->fd, buf, payload_size)) >= 0) {
+            if (naive_send(args->fd, buf, len) < 0) break;
+        }
+    } else {
+        FramedConn conn;
+        framed_init(&conn, args->fd, NULL);
+        int len;
+        while ((len = framed_read_message(&conn, buf, payload_size)) >= 0) {
+            // Keep echoing into the cork buffer while more requests are already buffered
+            int more = conn.rpos < conn.rlen;
+            if (framed_send_message(&conn, buf, len, more) < 0) break;
+        }
+        framed_free(&conn);
+    }
+    free(buf);
+    close(args->fd);
+    return NULL;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connect_pair(int *client, int *server) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listener, 1) < 0 || getsockname(listener, (struct sockaddr *)&addr, &addr_len) < 0) {
+        perror("listen");
+        return -1;
+    }
+    *client = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(*client, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        return -1;
+    }
+    *server = accept(listener, NULL, NULL);
+    close(listener);
+
+    int flag = 1;
+    setsockopt(*client, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    setsockopt(*server, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    return *server < 0 ? -1 : 0;
+}
+
+static int run(enum Mode mode) {
+    int client, server;
+    if (connect_pair(&client, &server) < 0) return -1;
+    EchoArgs args = {server, mode};
+    pthread_t echo;
+    pthread_create(&echo, NULL, echo_thread, &args);
+
+    char *out = malloc(payload_size), *in = malloc(payload_size);
+    memset(out, 'x', payload_size);
+    FramedConn conn;
+    framed_init(&conn, client, NULL);
+
+    int failed = 0;
+    double start = now();
+    for (int done = 0; done < messages && !failed;) {
+        if (mode == MODE_NAIVE) {
+            failed = naive_send(client, out, payload_size) < 0 || naive_read(client, in, payload_size) < 0;
+            done++;
+        } else {
+            int batch = mode == MODE_PIPELINED ? window : 1;
+            if (batch > messages - done) batch = messages - done;
+            for (int i = 0; i < batch && !failed; i++) {
+                failed = framed_send_message(&conn, out, payload_size, i + 1 < batch) < 0;
+            }
+            for (int i = 0; i < batch && !failed; i++) {
+                failed = framed_read_message(&conn, in, payload_size) < 0;
+            }
+            done += batch;
+        }
+    }
+    double elapsed = now() - start;
+
+    if (failed) {
+        fprintf(stderr, "%s: connection failed\n", mode_names[mode]);
+    } else {
+        printf("%-10s %9d msgs  %8.3f s  %10.0f msgs/s\n", mode_names[mode], messages, elapsed, messages / elapsed);
+    }
+    shutdown(client, SHUT_WR);
+    pthread_join(echo, NULL);
+    framed_free(&conn);
+    close(client);
+    free(out);
+    free(in);
+    return failed ? -1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) messages = atoi(argv[1]);
+    if (argc > 2) payload_size = atoi(argv[2]);
+    if (argc > 3) window = atoi(argv[3]);
+    if (messages <= 0 || payload_size == 0 || window <= 0) {
+        fprintf(stderr, "Usage: %s [messages] [payload_bytes] [window]\n", argv[0]);
+        return 1;
+    }
+    printf("payload %zu bytes, pipeline window %d\n", payload_size, window);
+    for (int mode = MODE_NAIVE; mode <= MODE_PIPELINED; mode++) {
+        if (run(mode) < 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Logger microbenchmark: cost of one logging call on the calling thread.
+//
+//   gcc -O2 -I../academia -o bench_logger bench_logger.c ../academia/logger.c -pthread
+//   ./bench_logger [threads] [messages_per_thread] [log_file]
+//
+// Cases:
+//   filtered   message below the configured level
+//   sampled    log_sampled() with one message kept in 100
+//   async      log_write() into the per-thread ring
+//   stdio      the old vfprintf + fflush on a shared FILE* (a tenth of the messages)
+#include "academia.h"
+#include "logger.h"
+#include <stdarg.h>
+#include <time.h>
+
+enum Case { CASE_FILTERED, CASE_SAMPLED, CASE_ASYNC, CASE_STDIO };
+
+static const char *case_names[] = {"filtered", "sampled", "async", "stdio"};
+
+static int threads = 4;
+static long messages = 1000000;
+static FILE *stdio_file;
+
+static void stdio_log(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(stdio_file, format, args);
+    va_end(args);
+    fflush(stdio_file);
+}
+
+typedef struct {
+    enum Case which;
+    long count;
+    double elapsed;
+} Worker;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    double start = now();
+    for (long i = 0; i < worker->count; i++) {
+        switch (worker->which) {
+            case CASE_FILTERED: log_write(LOG_DEBUG, "Server: Sent message (%ld bytes)\n", i); break;
+            case CASE_SAMPLED: log_sampled(LOG_INFO, "Server: Received student menu choice: %ld\n", i); break;
+            case CASE_ASYNC: log_write(LOG_INFO, "Server: Received student menu choice: %ld\n", i); break;
+            case CASE_STDIO: stdio_log("Server: Received student menu choice: %ld\n", i); break;
+        }
+    }
+    worker->elapsed = now() - start;
+    return NULL;
+}
+
+static void run(enum Case which) {
+    logger_set_sampling(which == CASE_SAMPLED ? 100 : 1);
+    long count = which == CASE_STDIO ? messages / 10 : messages;
+
+    Worker workers[threads];
+    pthread_t ids[threads];
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (Worker){which, count, 0};
+        pthread_create(&ids[i], NULL, worker_main, &workers[i]);
+    }
+    double total = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+        total += workers[i].elapsed;
+    }
+    printf("%-9s %3d threads x %8ld  %8.1f ns/call\n", case_names[which], threads, count, total / threads / count * 1e9);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) threads = atoi(argv[1]);
+    if (argc > 2) messages = atol(argv[2]);
+    const char *path = argc > 3 ? argv[3] : "bench_logger.log";
+    if (threads <= 0 || messages <= 0) {
+        fprintf(stderr, "Usage: %s [threads] [messages_per_thread] [log_file]\n", argv[0]);
+        return 1;
+    }
+
+    if (logger_init(path, LOG_INFO) < 0 || !(stdio_file = fopen(path, "a"))) {
+        perror(path);
+        return 1;
+    }
+    for (int which = CASE_FILTERED; which <= CASE_STDIO; which++) run(which);
+    logger_shutdown();
+    fclose(stdio_file);
+
+    // Messages the async case could not fit into its ring are reported in the log itself
+    printf("log written to %s\n", path);
+    return 0;
+}
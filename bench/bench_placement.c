@@ -0,0 +1,111 @@
+// Placement benchmark: latency percentiles of requests served by the storage
+// workers, for comparing thread placements of the server.
+//
+//   gcc -O2 -I../academia -o bench_placement bench_placement.c ../academia/client_lib.c ../academia/protocol.c ../academia/framed_io.c ../academia/compress.c -pthread -lz
+//   ./bench_placement [threads] [seconds]
+//
+// Needs a running server with the student s1 from initial_setup. Each thread
+// opens a client library pool (client_lib.h) as s1 and then alternates
+// OP_VIEW_ALL_COURSES (revalidated by catalog version after the first) and
+// OP_VIEW_ENROLLED_COURSES, one request at a time, so every request crosses
+// from an acceptor to a storage worker and back. Run it against the same data
+// with the server started unpinned and with --acceptor-cpus / --worker-cpus
+// (on a multi-socket host, e.g. both lists on one node, or each node's
+// acceptors with workers of their own) and compare the tails.
+#include "academia.h"
+#include "client_lib.h"
+#include <stdatomic.h>
+#include <time.h>
+
+#define MAX_SAMPLES 1000000   // Latencies kept per thread
+
+static int threads = 8;
+static int seconds = 10;
+static atomic_int stop;
+static atomic_long failures;
+
+typedef struct {
+    pthread_t thread;
+    long count;
+    uint32_t *samples;    // Round-trip times in ns, the first MAX_SAMPLES
+} Worker;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    ClientConfig config = {.size = 1};
+    int status;
+    ClientPool *pool = client_pool_open(&config, STUDENT, "s1", "pass1", &status);
+    if (!pool) {
+        fprintf(stderr, status == CLIENT_ERR_CONNECTION ? "Could not connect to the server\n" : "Student login failed\n");
+        atomic_fetch_add(&failures, 1);
+        return NULL;
+    }
+
+    for (long i = 0; !atomic_load(&stop); i++) {
+        uint64_t start = now_ns();
+        status = i % 2 ? client_list_courses(pool, NULL) : client_enrolled_courses(pool, NULL);
+        if (status == CLIENT_ERR_CONNECTION) {
+            atomic_fetch_add(&failures, 1);
+            break;
+        }
+        if (worker->count < MAX_SAMPLES) worker->samples[worker->count] = (uint32_t)(now_ns() - start);
+        worker->count++;
+    }
+    client_pool_close(pool);
+    return NULL;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) threads = atoi(argv[1]);
+    if (argc > 2) seconds = atoi(argv[2]);
+    if (threads <= 0 || seconds <= 0) {
+        fprintf(stderr, "Usage: %s [threads] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    Worker workers[threads];
+    for (int i = 0; i < threads; i++) {
+        workers[i].count = 0;
+        workers[i].samples = malloc(sizeof(uint32_t) * MAX_SAMPLES);
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+    }
+    uint64_t start = now_ns();
+    sleep(seconds);
+    atomic_store(&stop, 1);
+    long count = 0, kept = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        count += workers[i].count;
+        kept += workers[i].count < MAX_SAMPLES ? workers[i].count : MAX_SAMPLES;
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    uint32_t *all = malloc(sizeof(uint32_t) * (kept ? kept : 1));
+    long n = 0;
+    for (int i = 0; i < threads; i++) {
+        long k = workers[i].count < MAX_SAMPLES ? workers[i].count : MAX_SAMPLES;
+        memcpy(all + n, workers[i].samples, sizeof(uint32_t) * k);
+        n += k;
+        free(workers[i].samples);
+    }
+    qsort(all, n, sizeof(uint32_t), compare_u32);
+    printf("%d threads, %.1f s: %ld requests (%.0f/s)\n", threads, elapsed, count, count / elapsed);
+    if (n > 0) {
+        printf("p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", all[n / 2] / 1e3,
+               all[(long)(n * 0.9)] / 1e3, all[(long)(n * 0.99)] / 1e3, all[(long)(n * 0.999)] / 1e3, all[n - 1] / 1e3);
+    }
+    free(all);
+    if (atomic_load(&failures) > 0) printf("%ld connection failures\n", atomic_load(&failures));
+    return 0;
+}
@@ -0,0 +1,124 @@
+// Transport benchmark: binary-protocol round trips over TCP loopback and over
+// the server's Unix domain socket.
+//
+//   gcc -O2 -I../academia -o bench_transport bench_transport.c ../academia/client_lib.c ../academia/protocol.c ../academia/framed_io.c ../academia/compress.c -pthread -lz
+//   ./bench_transport unix_path [threads] [seconds]
+//
+// Needs a server started with --unix unix_path and the admin account from
+// initial_setup. Each thread opens a client library pool (client_lib.h) once
+// per transport and then sends OP_GET_MENU, one request at a time; the server
+// answers it on the session's event loop without touching the data files, so
+// the numbers are mostly the cost of the transport. Both transports run back
+// to back with the same settings.
+#include "academia.h"
+#include "client_lib.h"
+#include <stdatomic.h>
+#include <time.h>
+
+#define MAX_SAMPLES 1000000   // Latencies kept per thread
+
+static const char *unix_path;
+static int threads = 4;
+static int seconds = 5;
+static atomic_int stop;
+static atomic_long failures;
+
+typedef struct {
+    int local;            // Connect to unix_path instead of PORT
+    pthread_t thread;
+    long count;
+    uint32_t *samples;    // Round-trip times in ns, the first MAX_SAMPLES
+} Worker;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    ClientConfig config = {.unix_path = worker->local ? unix_path : NULL, .size = 1};
+    int status;
+    ClientPool *pool = client_pool_open(&config, ADMIN, "admin1", "adminpass", &status);
+    if (!pool) {
+        if (status == CLIENT_ERR_CONNECTION) {
+            fprintf(stderr, "Could not connect over %s\n", worker->local ? unix_path : "TCP");
+        } else {
+            fprintf(stderr, "Admin login failed\n");
+        }
+        atomic_fetch_add(&failures, 1);
+        return NULL;
+    }
+
+    while (!atomic_load(&stop)) {
+        uint64_t start = now_ns();
+        if (client_call(pool, OP_GET_MENU, NULL, NULL) == CLIENT_ERR_CONNECTION) {
+            atomic_fetch_add(&failures, 1);
+            break;
+        }
+        if (worker->count < MAX_SAMPLES) worker->samples[worker->count] = (uint32_t)(now_ns() - start);
+        worker->count++;
+    }
+    client_pool_close(pool);
+    return NULL;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run(int local) {
+    Worker workers[threads];
+    atomic_store(&stop, 0);
+    for (int i = 0; i < threads; i++) {
+        workers[i].local = local;
+        workers[i].count = 0;
+        workers[i].samples = malloc(sizeof(uint32_t) * MAX_SAMPLES);
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+    }
+    uint64_t start = now_ns();
+    sleep(seconds);
+    atomic_store(&stop, 1);
+    long count = 0, kept = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        count += workers[i].count;
+        kept += workers[i].count < MAX_SAMPLES ? workers[i].count : MAX_SAMPLES;
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    uint32_t *all = malloc(sizeof(uint32_t) * (kept ? kept : 1));
+    long n = 0;
+    for (int i = 0; i < threads; i++) {
+        long k = workers[i].count < MAX_SAMPLES ? workers[i].count : MAX_SAMPLES;
+        memcpy(all + n, workers[i].samples, sizeof(uint32_t) * k);
+        n += k;
+        free(workers[i].samples);
+    }
+    qsort(all, n, sizeof(uint32_t), compare_u32);
+    printf("%-5s %d threads, %.1f s: %ld requests (%.0f/s), p50 %.1f us, p99 %.1f us\n", local ? "unix" : "tcp",
+           threads, elapsed, count, count / elapsed, n ? all[n / 2] / 1e3 : 0.0,
+           n ? all[(long)(n * 0.99)] / 1e3 : 0.0);
+    free(all);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s unix_path [threads] [seconds]\n", argv[0]);
+        return 1;
+    }
+    unix_path = argv[1];
+    if (argc > 2) threads = atoi(argv[2]);
+    if (argc > 3) seconds = atoi(argv[3]);
+    if (threads <= 0 || seconds <= 0) {
+        fprintf(stderr, "Usage: %s unix_path [threads] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    run(0);
+    run(1);
+    if (atomic_load(&failures) > 0) printf("%ld connection failures\n", atomic_load(&failures));
+    return 0;
+}
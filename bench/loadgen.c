@@ -0,0 +1,466 @@
+// Load generator: registration-day traffic from many simulated users, with
+// throughput and latency percentiles per operation.
+//
+//   gcc -O2 -I../academia -o loadgen loadgen.c ../academia/client_lib.c ../academia/protocol.c ../academia/framed_io.c ../academia/compress.c ../academia/metrics.c ../academia/work_queue.c -pthread -lm -lz
+//   ./loadgen --setup --students 2000            # once, to create the accounts and courses
+//   ./loadgen --students 2000 --rate 5000 --duration 30 --out runs.csv --label "$(git rev-parse --short HEAD)"
+//
+// Every simulated user is a thread with its own client library pool
+// (client_lib.h) of one logged-in connection, so the run measures the client
+// code that ships, listing cache and all: students lg0..lg<N-1>, faculty
+// lgf0..lgf<F-1> and admin1 for the admins. Operations are drawn from the mix
+// (--mix NAME=WEIGHT,...):
+//
+//   login    a student reconnects and logs in again (login storm)
+//   browse   a student views the course catalog (answered from the pool's
+//            cache while the catalog is unchanged), or now and then their own courses
+//   enroll   a student enrolls in one of the hot courses, or drops the one they are in
+//   faculty  a faculty member views their courses
+//   admin    an admin views every student
+//
+// With --rate the load is open loop: requests arrive as a Poisson process at
+// that many per second, whatever the server's speed, and are taken by an idle
+// user of the right role. Latency runs from the moment a request was due, so
+// a server that falls behind shows up in the tail instead of slowing the
+// arrivals down. Without --rate every user sends its next request as soon as
+// the previous one is answered (closed loop).
+//
+// --out appends one CSV row per operation (and one for all of them) to a
+// file, so runs of different builds can be compared side by side.
+#include "academia.h"
+#include "client_lib.h"
+#include "metrics.h"
+#include "work_queue.h"
+#include <math.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define LOAD_PASSWORD "loadpw"
+#define ARRIVAL_QUEUE_SIZE 65536    // Requests due but not yet taken, per role
+#define USER_STACK_SIZE (256 * 1024)
+
+enum LoadOp { LOAD_LOGIN, LOAD_BROWSE, LOAD_ENROLL, LOAD_FACULTY, LOAD_ADMIN, LOAD_OPS };
+
+static const char *load_op_names[LOAD_OPS] = {"login", "browse", "enroll", "faculty", "admin"};
+static const enum Role load_op_roles[LOAD_OPS] = {STUDENT, STUDENT, STUDENT, FACULTY, ADMIN};
+
+static int students = 1000;
+static int faculty = 10;
+static int admins = 2;
+static double rate = 0;             // Arrivals per second, 0 for closed loop
+static int seconds = 10;
+static int hot_courses = 1;
+static int seats = 50;
+static int mix[LOAD_OPS] = {5, 60, 30, 4, 1};
+static const char *out_path;
+static const char *label = "";
+static ClientConfig client_config = {.size = 1, .compress = 1};
+
+static atomic_int stop;
+static WorkQueue arrivals[FACULTY + 1];   // Per role: requests due, oldest first
+static atomic_int backlog[FACULTY + 1];    // Their lengths; the generator never waits for room
+
+typedef struct {
+    Histogram latency;      // Due to answered, in ns
+    atomic_long completed;
+    atomic_long failed;     // Answered with a nonzero status
+    atomic_long errors;     // Connection lost or refused (CLIENT_ERR_CONNECTION)
+    atomic_long unserved;   // Still queued when the run ended, or arrived to a full queue
+} OpStats;
+
+static OpStats stats[LOAD_OPS];
+
+typedef struct {
+    enum LoadOp op;
+    uint64_t due;
+} Arrival;
+
+typedef struct {
+    pthread_t thread;
+    enum Role role;
+    char id[MAX_ID];
+    const char *password;
+    ClientPool *pool;       // NULL while logged out
+    char enrolled[MAX_ID];  // Hot course the student is in, empty if none
+    unsigned seed;
+} SimUser;
+
+static pthread_barrier_t started;
+
+// Id prefix<i> of the i-th user or course of a kind (lg, lgf, lgc); -1 if it
+// does not fit in MAX_ID. main() checks the last of each kind, so that no two
+// ids are cut down to the same one.
+static int load_id(const char *prefix, int i, char *id) {
+    char full[32];
+    int len = snprintf(full, sizeof(full), "%s%d", prefix, i);
+    if (len < 0 || len >= MAX_ID) return -1;
+    memcpy(id, full, len + 1);
+    return 0;
+}
+
+static void course_id(int i, char *id) {
+    load_id("lgc", i, id);
+}
+
+static void user_disconnect(SimUser *u) {
+    if (!u->pool) return;
+    client_pool_close(u->pool);
+    u->pool = NULL;
+}
+
+// Open a fresh pool, which connects and logs in: the login status
+static int user_login(SimUser *u) {
+    user_disconnect(u);
+    int status;
+    u->pool = client_pool_open(&client_config, u->role, u->id, u->password, &status);
+    return status;
+}
+
+// One operation of the mix: its status, or CLIENT_ERR_CONNECTION
+static int run_op(SimUser *u, enum LoadOp op) {
+    if (op == LOAD_LOGIN) return user_login(u);
+    if (!u->pool) {
+        int status = user_login(u);
+        if (status != 0) return status;
+    }
+    switch (op) {
+        case LOAD_BROWSE:
+            return rand_r(&u->seed) % 4 ? client_list_courses(u->pool, NULL) : client_enrolled_courses(u->pool, NULL);
+        case LOAD_ENROLL: {
+            if (u->enrolled[0]) {
+                int status = client_drop(u->pool, u->enrolled, NULL);
+                if (status == 0 || status == ERR_NOT_ENROLLED) u->enrolled[0] = '\0';
+                return status;
+            }
+            char id[MAX_ID];
+            course_id(rand_r(&u->seed) % hot_courses, id);
+            int status = client_enroll(u->pool, id, NULL);
+            // Already enrolled: left over from an earlier run, drop it next time
+            if (status == 0 || status == ERR_ALREADY_ENROLLED) strcpy(u->enrolled, id);
+            return status;
+        }
+        case LOAD_FACULTY:
+            return client_faculty_courses(u->pool, NULL);
+        case LOAD_ADMIN:
+            return client_call(u->pool, OP_VIEW_ALL_STUDENTS, NULL, NULL);
+        default:
+            return ERR_INVALID_INPUT;
+    }
+}
+
+// Draw an operation from the mix, among those of role (or any role if role < 0)
+static enum LoadOp pick_op(unsigned *seed, int role) {
+    int total = 0;
+    for (int op = 0; op < LOAD_OPS; op++) {
+        if (role < 0 || (int)load_op_roles[op] == role) total += mix[op];
+    }
+    int pick = rand_r(seed) % total;
+    for (int op = 0; op < LOAD_OPS; op++) {
+        if (role >= 0 && (int)load_op_roles[op] != role) continue;
+        if (pick < mix[op]) return op;
+        pick -= mix[op];
+    }
+    return LOAD_BROWSE;
+}
+
+static void record(enum LoadOp op, int status, uint64_t ns) {
+    if (status == CLIENT_ERR_CONNECTION) {
+        atomic_fetch_add(&stats[op].errors, 1);
+        return;
+    }
+    histogram_record(&stats[op].latency, ns);
+    atomic_fetch_add(&stats[op].completed, 1);
+    if (status != 0) atomic_fetch_add(&stats[op].failed, 1);
+}
+
+static void *user_main(void *arg) {
+    SimUser *u = arg;
+    if (user_login(u) != 0) fprintf(stderr, "Login failed for %s\n", u->id);
+    pthread_barrier_wait(&started);
+
+    int has_ops = 0;
+    for (int op = 0; op < LOAD_OPS; op++) has_ops |= load_op_roles[op] == u->role && mix[op] > 0;
+    while (rate > 0 || (has_ops && !atomic_load(&stop))) {
+        Arrival local, *arrival = &local;
+        if (rate > 0) {
+            arrival = work_queue_pop(&arrivals[u->role]);
+            if (!arrival) break;
+            atomic_fetch_sub(&backlog[u->role], 1);
+            if (atomic_load(&stop)) {
+                atomic_fetch_add(&stats[arrival->op].unserved, 1);
+                free(arrival);
+                continue;
+            }
+        } else {
+            local.op = pick_op(&u->seed, u->role);
+            local.due = metrics_now();
+        }
+        int status = run_op(u, arrival->op);
+        record(arrival->op, status, metrics_now() - arrival->due);
+        if (arrival != &local) free(arrival);
+    }
+    user_disconnect(u);
+    return NULL;
+}
+
+// Open loop: Poisson arrivals at rate per second until end. Returns how many
+// were generated, fewer than asked for if this thread could not keep up.
+static long generate_arrivals(uint64_t end) {
+    unsigned seed = (unsigned)metrics_now();
+    uint64_t due = metrics_now();
+    long generated = 0;
+    while (1) {
+        double u = (rand_r(&seed) + 1.0) / (RAND_MAX + 2.0);
+        due += (uint64_t)(-log(u) / rate * 1e9);
+        if (due >= end || metrics_now() >= end) break;
+        generated++;
+        struct timespec until = {due / 1000000000, due % 1000000000};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+        Arrival *arrival = malloc(sizeof(Arrival));
+        if (!arrival) break;
+        arrival->op = pick_op(&seed, -1);
+        arrival->due = due;
+        enum Role role = load_op_roles[arrival->op];
+        if (atomic_fetch_add(&backlog[role], 1) >= ARRIVAL_QUEUE_SIZE) {
+            // Waiting for room would slow the arrivals down to the server's pace
+            atomic_fetch_sub(&backlog[role], 1);
+            atomic_fetch_add(&stats[arrival->op].unserved, 1);
+            free(arrival);
+            continue;
+        }
+        work_queue_push(&arrivals[role], arrival);
+    }
+    return generated;
+}
+
+// A pool for setup, or NULL if the login failed
+static ClientPool *setup_login(enum Role role, const char *id, const char *password) {
+    int status;
+    ClientPool *pool = client_pool_open(&client_config, role, id, password, &status);
+    if (!pool) fprintf(stderr, "Setup: login failed for %s (status %d)\n", id, status);
+    return pool;
+}
+
+// Create the accounts and courses the run uses; existing ones are left alone
+static int setup(void) {
+    ClientPool *admin = setup_login(ADMIN, "admin1", "adminpass");
+    if (!admin) return -1;
+    int added = 0;
+    for (int i = 0; i < students + faculty; i++) {
+        char id[MAX_ID];
+        int is_student = i < students;
+        load_id(is_student ? "lg" : "lgf", is_student ? i : i - students, id);
+        const char *fields[] = {id, is_student ? "Load Student" : "Load Faculty", LOAD_PASSWORD};
+        added += client_call(admin, is_student ? OP_ADD_STUDENT : OP_ADD_FACULTY, fields, NULL) == 0;
+    }
+    client_pool_close(admin);
+    printf("Setup: added %d of %d accounts\n", added, students + faculty);
+
+    // Course lgc<i> belongs to faculty lgf<i % faculty>; the first --hot-courses are the hot ones
+    int courses = hot_courses > faculty ? hot_courses : faculty;
+    added = 0;
+    for (int f = 0; f < faculty; f++) {
+        char id[MAX_ID];
+        load_id("lgf", f, id);
+        ClientPool *pool = setup_login(FACULTY, id, LOAD_PASSWORD);
+        if (!pool) return -1;
+        char seats_text[16];
+        snprintf(seats_text, sizeof(seats_text), "%d", seats);
+        for (int c = f; c < courses; c += faculty) {
+            course_id(c, id);
+            const char *fields[] = {id, "Load Course", seats_text};
+            added += client_call(pool, OP_ADD_COURSE, fields, NULL) == 0;
+        }
+        client_pool_close(pool);
+    }
+    printf("Setup: added %d of %d courses\n", added, courses);
+    return 0;
+}
+
+// --mix browse=60,enroll=30,...: operations left out get weight 0
+static int parse_mix(const char *arg) {
+    int weights[LOAD_OPS] = {0}, total = 0;
+    const char *p = arg;
+    while (*p) {
+        const char *eq = strchr(p, '=');
+        if (!eq) return -1;
+        int op = 0;
+        while (op < LOAD_OPS && (strlen(load_op_names[op]) != (size_t)(eq - p) || strncmp(p, load_op_names[op], eq - p) != 0)) op++;
+        char *end;
+        long weight = strtol(eq + 1, &end, 10);
+        if (op == LOAD_OPS || end == eq + 1 || weight < 0 || (*end && *end != ',')) return -1;
+        weights[op] = (int)weight;
+        total += weight;
+        p = *end ? end + 1 : end;
+    }
+    if (total == 0) return -1;
+    memcpy(mix, weights, sizeof(mix));
+    return 0;
+}
+
+static void print_row(FILE *file, time_t when, double elapsed, const char *name, const Histogram *h, long completed,
+                      long failed, long errors, long unserved) {
+    fprintf(file, "%s,%ld,%s,%.0f,%d,%d,%d,%.1f,%s,%ld,%ld,%ld,%ld,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", label, (long)when,
+            rate > 0 ? "open" : "closed", rate, students, faculty, admins, elapsed, name, completed, failed, errors,
+            unserved, completed / elapsed, histogram_percentile(h, 0.5) / 1e3, histogram_percentile(h, 0.9) / 1e3,
+            histogram_percentile(h, 0.99) / 1e3, histogram_percentile(h, 0.999) / 1e3,
+            atomic_load(&h->max) / 1e3);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [--students N] [--faculty N] [--admins N] [--rate PER_SECOND] [--duration SECONDS]\n"
+                    "       [--mix login=W,browse=W,enroll=W,faculty=W,admin=W] [--hot-courses N] [--seats N]\n"
+                    "       [--unix PATH] [--no-compress] [--setup] [--out FILE] [--label NAME]\n", name);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int do_setup = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--students") == 0 && i + 1 < argc && (students = atoi(argv[i + 1])) >= 0) {
+            i++;
+        } else if (strcmp(argv[i], "--faculty") == 0 && i + 1 < argc && (faculty = atoi(argv[i + 1])) > 0) {
+            i++;
+        } else if (strcmp(argv[i], "--admins") == 0 && i + 1 < argc && (admins = atoi(argv[i + 1])) >= 0) {
+            i++;
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc && (rate = atof(argv[i + 1])) >= 0) {
+            i++;
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc && (seconds = atoi(argv[i + 1])) > 0) {
+            i++;
+        } else if (strcmp(argv[i], "--mix") == 0 && i + 1 < argc && parse_mix(argv[i + 1]) == 0) {
+            i++;
+        } else if (strcmp(argv[i], "--hot-courses") == 0 && i + 1 < argc && (hot_courses = atoi(argv[i + 1])) > 0) {
+            i++;
+        } else if (strcmp(argv[i], "--seats") == 0 && i + 1 < argc && (seats = atoi(argv[i + 1])) > 0 && seats <= MAX_USERS) {
+            i++;
+        } else if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc) {
+            client_config.unix_path = argv[++i];
+        } else if (strcmp(argv[i], "--no-compress") == 0) {
+            client_config.compress = 0;
+        } else if (strcmp(argv[i], "--setup") == 0) {
+            do_setup = 1;
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+            label = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    char id[MAX_ID];
+    int courses = hot_courses > faculty ? hot_courses : faculty;
+    if (load_id("lg", students - 1, id) < 0 || load_id("lgf", faculty - 1, id) < 0 || load_id("lgc", courses - 1, id) < 0) {
+        fprintf(stderr, "Too many users or courses to name within %d characters\n", MAX_ID - 1);
+        return 1;
+    }
+    int role_users[FACULTY + 1] = {[ADMIN] = admins, [STUDENT] = students, [FACULTY] = faculty};
+    for (int op = 0; op < LOAD_OPS; op++) {
+        if (mix[op] > 0 && role_users[load_op_roles[op]] == 0) {
+            fprintf(stderr, "The mix has %s requests but no user to send them\n", load_op_names[op]);
+            return 1;
+        }
+    }
+
+    // One socket per user
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+    if (do_setup && setup() < 0) return 1;
+
+    int users = students + faculty + admins;
+    SimUser *all = calloc(users, sizeof(SimUser));
+    if (!all) return 1;
+    for (int role = 0; role <= FACULTY; role++) work_queue_init(&arrivals[role], ARRIVAL_QUEUE_SIZE);
+    pthread_barrier_init(&started, NULL, users + 1);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, USER_STACK_SIZE);
+    for (int i = 0; i < users; i++) {
+        SimUser *u = &all[i];
+        if (i < students) {
+            u->role = STUDENT;
+            load_id("lg", i, u->id);
+            u->password = LOAD_PASSWORD;
+        } else if (i < students + faculty) {
+            u->role = FACULTY;
+            load_id("lgf", i - students, u->id);
+            u->password = LOAD_PASSWORD;
+        } else {
+            u->role = ADMIN;
+            strcpy(u->id, "admin1");
+            u->password = "adminpass";
+        }
+        u->seed = (unsigned)i * 2654435761u;
+        if (pthread_create(&u->thread, &attr, user_main, u) != 0) {
+            fprintf(stderr, "Could not start user %d\n", i);
+            return 1;
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    // Every user is logged in before the clock starts
+    pthread_barrier_wait(&started);
+    uint64_t start = metrics_now(), end = start + (uint64_t)seconds * 1000000000ULL;
+    long generated = 0;
+    if (rate > 0) {
+        generated = generate_arrivals(end);
+    } else {
+        struct timespec until = {end / 1000000000, end % 1000000000};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+    }
+    atomic_store(&stop, 1);
+    double elapsed = (metrics_now() - start) / 1e9;
+    for (int role = 0; role <= FACULTY; role++) work_queue_close(&arrivals[role]);
+    for (int i = 0; i < users; i++) pthread_join(all[i].thread, NULL);
+    free(all);
+
+    // Per operation, then everything together
+    static Histogram total;
+    long completed = 0, failed = 0, errors = 0, unserved = 0;
+    printf("%d students, %d faculty, %d admins, %s, %.1f s\n", students, faculty, admins,
+           rate > 0 ? "open loop" : "closed loop", elapsed);
+    if (rate > 0) printf("Offered %.0f requests/s (%.0f/s generated)\n", rate, generated / elapsed);
+    for (int op = 0; op < LOAD_OPS; op++) {
+        OpStats *s = &stats[op];
+        for (int b = 0; b < METRICS_BUCKETS; b++) atomic_fetch_add(&total.buckets[b], atomic_load(&s->latency.buckets[b]));
+        atomic_fetch_add(&total.count, atomic_load(&s->latency.count));
+        if (atomic_load(&s->latency.max) > atomic_load(&total.max)) atomic_store(&total.max, atomic_load(&s->latency.max));
+        completed += s->completed;
+        failed += s->failed;
+        errors += s->errors;
+        unserved += s->unserved;
+        if (s->completed + s->errors + s->unserved == 0) continue;
+        printf("%-8s %8ld done (%.0f/s), %ld failed, %ld errors, %ld unserved; p50 %.1f us, p90 %.1f us, p99 %.1f us, "
+               "p99.9 %.1f us, max %.1f us\n", load_op_names[op], (long)s->completed, s->completed / elapsed,
+               (long)s->failed, (long)s->errors, (long)s->unserved, histogram_percentile(&s->latency, 0.5) / 1e3,
+               histogram_percentile(&s->latency, 0.9) / 1e3, histogram_percentile(&s->latency, 0.99) / 1e3,
+               histogram_percentile(&s->latency, 0.999) / 1e3, atomic_load(&s->latency.max) / 1e3);
+    }
+    printf("%-8s %8ld done (%.0f/s), %ld failed, %ld errors, %ld unserved; p50 %.1f us, p99 %.1f us, p99.9 %.1f us\n",
+           "all", completed, completed / elapsed, failed, errors, unserved, histogram_percentile(&total, 0.5) / 1e3,
+           histogram_percentile(&total, 0.99) / 1e3, histogram_percentile(&total, 0.999) / 1e3);
+
+    if (out_path) {
+        FILE *file = fopen(out_path, "a");
+        if (!file) {
+            perror("Failed to open the results file");
+            return 1;
+        }
+        time_t when = time(NULL);
+        fseek(file, 0, SEEK_END);
+        if (ftell(file) == 0) {
+            fprintf(file, "label,time,mode,rate,students,faculty,admins,seconds,op,completed,failed,errors,unserved,"
+                          "throughput,p50_us,p90_us,p99_us,p999_us,max_us\n");
+        }
+        for (int op = 0; op < LOAD_OPS; op++) {
+            OpStats *s = &stats[op];
+            if (s->completed + s->errors + s->unserved == 0) continue;
+            print_row(file, when, elapsed, load_op_names[op], &s->latency, s->completed, s->failed, s->errors, s->unserved);
+        }
+        print_row(file, when, elapsed, "all", &total, completed, failed, errors, unserved);
+        fclose(file);
+    }
+    return 0;
+}
@@ -1,7 +1,10 @@
 #include "academia.h"
-#include <fcntl.h>
-#include <netinet/tcp.h>
+#include "protocol.h"
+#include "menus.h"
+#include "client_lib.h"
+#include <sys/un.h>
 #include <signal.h>
+#include <time.h>
 
 // Function to clear input buffer
 void clear_input_buffer() {
@@ -14,488 +17,387 @@ void ignore_sigpipe() {
     signal(SIGPIPE, SIG_IGN);
 }
 
-// Debug function to print raw bytes of a string
-void print_raw_bytes(const char *str, int len) {
-    printf("Client: Raw bytes of response: ");
-    for (int i = 0; i < len; i++) {
-        printf("%02x ", (unsigned char)str[i]);
-    }
-    printf("\n");
+// Ask the server to compress long replies (off with --no-compress)
+static int want_compression = 1;
+
+// Server's Unix domain socket (--unix), NULL to connect over TCP
+static const char *unix_path;
+
+// Text to show for a result: the listing or message sent by the server, or
+// the locally rendered message for a terse reply
+const char *result_text(int op, const ClientResult *result) {
+    if (result->text && result->text[0]) return result->text;
+    return result_message(op, result->status);
 }
 
-// Strip trailing \r and \n
-void strip_newlines(char *str, int len) {
-    for (int i = len - 1; i >= 0; i--) {
-        if (str[i] == '\r' || str[i] == '\n') {
-            str[i] = '\0';
+// A menu entry: its opcode and one prompt per field in proto_op_fields() order
+typedef struct {
+    int choice;
+    enum Opcode op;
+    const char *prompts[3];
+} MenuAction;
+
+static const MenuAction admin_actions[] = {
+    {1, OP_ADD_STUDENT, {"Enter Student ID: ", "Enter Student Name: ", "Enter Password: "}},
+    {2, OP_VIEW_ALL_STUDENTS, {NULL}},
+    {3, OP_ADD_FACULTY, {"Enter Faculty ID: ", "Enter Faculty Name: ", "Enter Password: "}},
+    {4, OP_VIEW_ALL_FACULTY, {NULL}},
+    {5, OP_ACTIVATE_STUDENT, {"Enter Student ID to Activate: "}},
+    {6, OP_BLOCK_STUDENT, {"Enter Student ID to Block: "}},
+    {7, OP_UPDATE_STUDENT, {"Enter Student ID: ", "Enter New Name: "}},
+    {8, OP_UPDATE_FACULTY, {"Enter Faculty ID: ", "Enter New Name: "}},
+    {9, OP_LOGOUT, {NULL}},
+    {10, OP_VIEW_METRICS, {NULL}},
+    {0}
+};
+
+static const MenuAction student_actions[] = {
+    {1, OP_VIEW_ALL_COURSES, {NULL}},
+    {2, OP_ENROLL_COURSE, {"Enter Course ID to Enroll: "}},
+    {3, OP_DROP_COURSE, {"Enter Course ID to Drop: "}},
+    {4, OP_VIEW_ENROLLED_COURSES, {NULL}},
+    {5, OP_CHANGE_PASSWORD, {"Enter New Password: "}},
+    {6, OP_LOGOUT, {NULL}},
+    {7, OP_SUBSCRIBE, {"Enter Course ID to Watch: "}},
+    {8, OP_UNSUBSCRIBE, {"Enter Course ID to Stop Watching: "}},
+    {0}
+};
+
+static const MenuAction faculty_actions[] = {
+    {1, OP_VIEW_FACULTY_COURSES, {NULL}},
+    {2, OP_ADD_COURSE, {"Enter Course ID: ", "Enter Course Name: ", "Enter Total Seats: "}},
+    {3, OP_REMOVE_COURSE, {"Enter Course ID to Remove: "}},
+    {4, OP_UPDATE_COURSE, {"Enter Course ID to Update: ", "Enter New Course Name: ", "Enter New Total Seats: "}},
+    {5, OP_CHANGE_PASSWORD, {"Enter New Password: "}},
+    {6, OP_LOGOUT, {NULL}},
+    {0}
+};
+
+// Prompt for the fields of an action, as strings in proto_op_fields() order
+void read_fields(const MenuAction *action, char values[][MAX_NAME]) {
+    const char *fields = proto_op_fields(action->op);
+    for (int i = 0; fields[i]; i++) {
+        printf("%s", action->prompts[i]);
+        if (fields[i] == 's') {
+            int value = 0;
+            scanf("%d", &value);
+            clear_input_buffer();
+            snprintf(values[i], MAX_NAME, "%d", value);
         } else {
-            break;
+            scanf("%49s", values[i]);
+            clear_input_buffer();
         }
     }
 }
 
-// Read a message with a length prefix
-int read_with_length(int sock, char *buffer, size_t max_size) {
-    uint32_t len_net;
-    int bytes = read(sock, &len_net, sizeof(len_net));
-    if (bytes <= 0) {
-        printf("Client: Failed to read length prefix, bytes=%d, errno=%d\n", bytes, errno);
-        return -1;
-    }
-    uint32_t len = ntohl(len_net); // Convert from network byte order
-    if (len >= max_size) {
-        printf("Client: Message too large (%u bytes), max allowed=%zu\n", len, max_size);
-        return -1;
+// Requests that can be sent again after a reconnect without repeating a change
+int is_read_only(int op) {
+    switch (op) {
+        case OP_VIEW_ALL_STUDENTS:
+        case OP_VIEW_ALL_FACULTY:
+        case OP_VIEW_ALL_COURSES:
+        case OP_VIEW_ENROLLED_COURSES:
+        case OP_VIEW_FACULTY_COURSES:
+        case OP_VIEW_METRICS:
+            return 1;
+        default:
+            return 0;
     }
-    bytes = read(sock, buffer, len);
-    if (bytes <= 0) {
-        printf("Client: Failed to read message, bytes=%d, errno=%d\n", bytes, errno);
-        return -1;
-    }
-    buffer[bytes] = '\0';
-    // Remove or comment out the debug print to avoid double printing
-    // printf("Client: Received message (%d bytes): %s\n", bytes, buffer);
-    return bytes;
 }
 
-void handle_admin(int sock) {
-    char buffer[2048], response[2048];
+// Seat event for a watched course, shown whenever it arrives
+void show_seat_event(const ClientSeatEvent *event, void *arg) {
+    (void)arg;
+    printf("\n*** %s", event->text);
+    fflush(stdout);
+}
+
+// Role session in command mode: the menu is rendered locally and only the
+// operation and its result cross the network
+void handle_role(ClientPool *pool, enum Role role, const MenuAction *actions, const char *label) {
+    client_set_seat_handler(pool, show_seat_event, NULL);
     while (1) {
-        // Receive menu
-        int bytes = read_with_length(sock, buffer, sizeof(buffer));
-        if (bytes < 0) {
-            printf("Client: Failed to read Admin Menu\n");
-            return;
-        }
-        // Print the menu
-        printf("%s", buffer);
+        printf("%s", command_menu(role));
 
-        // Send choice
         char choice[10] = {0};
         printf("Client: Waiting for user input...\n");
-        if (scanf("%s", choice) != 1) {
+        if (scanf("%9s", choice) != 1) {
             printf("Client: Failed to read user choice with scanf\n");
             clear_input_buffer();
-            return;
+            break;
         }
         clear_input_buffer();
-        printf("Client: Sending choice: %s\n", choice);
-        int bytes_written = write(sock, choice, strlen(choice));
-        if (bytes_written < 0) {
-            printf("Client: Failed to send choice, errno=%d\n", errno);
-            return;
+
+        const MenuAction *action = NULL;
+        for (int i = 0; actions[i].choice; i++) {
+            if (actions[i].choice == atoi(choice)) action = &actions[i];
         }
-        fsync(sock);
-        printf("Client: Sent choice (%d bytes)\n", bytes_written);
-
-        if (atoi(choice) == 9) {
-            bytes = read_with_length(sock, response, sizeof(response));
-            if (bytes < 0) {
-                printf("Client: Server disconnected during logout\n");
-                return;
-            }
-            printf("%s", response);
-            printf("Client: Admin logged out\n");
-            break;
+        if (!action) {
+            printf("Invalid choice\n");
+            continue;
         }
 
-        // Handle admin inputs
-        switch (atoi(choice)) {
-            case 1: { // Add Student
-                char id[MAX_ID], name[MAX_NAME], password[MAX_PASS];
-                printf("Enter Student ID: ");
-                scanf("%s", id);
-                clear_input_buffer();
-                printf("Enter Student Name: ");
-                scanf("%s", name);
-                clear_input_buffer();
-                printf("Enter Password: ");
-                scanf("%s", password);
-                clear_input_buffer();
-                write(sock, id, sizeof(id));
-                write(sock, name, sizeof(name));
-                write(sock, password, sizeof(password));
-                break;
-            }
-            case 2: { // View Student Details
-                break; // Response will be handled below
-            }
-            case 3: { // Add Faculty
-                char id[MAX_ID], name[MAX_NAME], password[MAX_PASS];
-                printf("Enter Faculty ID: ");
-                scanf("%s", id);
-                clear_input_buffer();
-                printf("Enter Faculty Name: ");
-                scanf("%s", name);
-                clear_input_buffer();
-                printf("Enter Password: ");
-                scanf("%s", password);
-                clear_input_buffer();
-                write(sock, id, sizeof(id));
-                write(sock, name, sizeof(name));
-                write(sock, password, sizeof(password));
-                break;
-            }
-            case 4: { // View Faculty Details
-                break; // Response will be handled below
-            }
-            case 5: { // Activate Student
-                char id[MAX_ID];
-                printf("Enter Student ID to Activate: ");
-                scanf("%s", id);
-                clear_input_buffer();
-                write(sock, id, sizeof(id));
-                break;
-            }
-            case 6: { // Block Student
-                char id[MAX_ID];
-                printf("Enter Student ID to Block: ");
-                scanf("%s", id);
-                clear_input_buffer();
-                write(sock, id, sizeof(id));
-                break;
-            }
-            case 7: { // Modify Student Details
-                char id[MAX_ID], new_name[MAX_NAME];
-                printf("Enter Student ID: ");
-                scanf("%s", id);
-                clear_input_buffer();
-                printf("Enter New Name: ");
-                scanf("%s", new_name);
-                clear_input_buffer();
-                write(sock, id, sizeof(id));
-                write(sock, new_name, sizeof(new_name));
-                break;
-            }
-            case 8: { // Modify Faculty Details
-                char id[MAX_ID], new_name[MAX_NAME];
-                printf("Enter Faculty ID: ");
-                scanf("%s", id);
-                clear_input_buffer();
-                printf("Enter New Name: ");
-                scanf("%s", new_name);
-                clear_input_buffer();
-                write(sock, id, sizeof(id));
-                write(sock, new_name, sizeof(new_name));
-                break;
-            }
-            default:
-                break;
+        ClientResult result;
+        if (action->op == OP_LOGOUT) {
+            if (client_logout(pool, &result) == 0) printf("%s", result_text(OP_LOGOUT, &result));
+            printf("Client: %s logged out\n", label);
+            client_result_free(&result);
+            break;
         }
 
-        // Receive response
+        char values[3][MAX_NAME] = {{0}};
+        const char *fields[3] = {values[0], values[1], values[2]};
+        read_fields(action, values);
+
         printf("Client: Waiting for server response...\n");
-        bytes = read_with_length(sock, response, sizeof(response));
-        if (bytes < 0) {
-            printf("Client: Server disconnected while reading response\n");
-            return;
+        // A dropped connection is reopened (and the session resumed) by the next call
+        int status = client_call(pool, action->op, fields, &result);
+        if (status == CLIENT_ERR_CONNECTION && is_read_only(action->op)) {
+            client_result_free(&result);
+            status = client_call(pool, action->op, fields, &result);
         }
-        // Print the response (e.g., student or faculty details)
-        printf("%s", response);
+        if (status == CLIENT_ERR_CONNECTION && !is_read_only(action->op)) {
+            printf("Client: The connection dropped during the request; check its result before retrying\n");
+        } else if (status == CLIENT_ERR_CONNECTION) {
+            printf("Client: Lost the connection to the server\n");
+            client_result_free(&result);
+            break;
+        } else {
+            printf("%s", result_text(action->op, &result));
+            if (action->op == OP_ENROLL_COURSE && status == ERR_FULL) {
+                printf("Client: Choose \"Watch Course for Free Seats\" to be told when a seat frees up\n");
+            }
+        }
+        client_result_free(&result);
     }
 }
 
-void handle_student(int sock) {
-    char buffer[2048], response[2048];
+// Batch mode (--batch): commands read from a script, one per line, each
+// run to completion before the next. Every command prints one
+// tab-separated result line; listings keep their line breaks as \n.
+typedef struct {
+    const char *name;
+    enum Opcode op;
+} BatchCommand;
+
+// Arguments follow proto_op_fields() order; login takes admin|faculty|student first
+static const BatchCommand batch_commands[] = {
+    {"login", OP_AUTHENTICATE},
+    {"logout", OP_LOGOUT},
+    {"add-student", OP_ADD_STUDENT},
+    {"view-students", OP_VIEW_ALL_STUDENTS},
+    {"add-faculty", OP_ADD_FACULTY},
+    {"view-faculty", OP_VIEW_ALL_FACULTY},
+    {"activate", OP_ACTIVATE_STUDENT},
+    {"block", OP_BLOCK_STUDENT},
+    {"update-student", OP_UPDATE_STUDENT},
+    {"update-faculty", OP_UPDATE_FACULTY},
+    {"view-courses", OP_VIEW_ALL_COURSES},
+    {"enroll", OP_ENROLL_COURSE},
+    {"drop", OP_DROP_COURSE},
+    {"view-enrolled", OP_VIEW_ENROLLED_COURSES},
+    {"password", OP_CHANGE_PASSWORD},
+    {"my-courses", OP_VIEW_FACULTY_COURSES},
+    {"add-course", OP_ADD_COURSE},
+    {"remove-course", OP_REMOVE_COURSE},
+    {"update-course", OP_UPDATE_COURSE},
+    {"metrics", OP_VIEW_METRICS},
+    {NULL}
+};
+
+#define BATCH_MAX_WORDS 8
+
+// Split line into words at blanks, in place; "double quotes" keep a name
+// with spaces together. Returns the word count, -1 on an unterminated quote.
+int split_words(char *line, char **words, int max) {
+    int count = 0;
+    char *p = line;
     while (1) {
-        int bytes = read_with_length(sock, buffer, sizeof(buffer));
-        if (bytes < 0) {
-            printf("Client: Server disconnected while reading menu\n");
-            return;
-        }
-        printf("%s", buffer);
-
-        char choice[10] = {0};
-        printf("Client: Waiting for user input...\n");
-        if (scanf("%s", choice) != 1) {
-            printf("Client: Failed to read user choice with scanf\n");
-            clear_input_buffer();
-            return;
-        }
-        clear_input_buffer();
-        printf("Client: Sending choice: %s\n", choice);
-        int bytes_written = write(sock, choice, strlen(choice));
-        if (bytes_written < 0) {
-            printf("Client: Failed to send choice, errno=%d\n", errno);
-            return;
-        }
-        fsync(sock);
-        printf("Client: Sent choice (%d bytes)\n", bytes_written);
-
-        if (atoi(choice) == 6) {
-            bytes = read_with_length(sock, response, sizeof(response));
-            if (bytes < 0) {
-                printf("Client: Server disconnected during logout\n");
-                return;
-            }
-            printf("%s", response);
-            printf("Client: Student logged out\n");
-            break;
-        }
-
-        switch (atoi(choice)) {
-            case 1: { // View All Courses
-                break;
-            }
-            case 2: { // Enroll New Course
-                char course_id[MAX_ID];
-                printf("Enter Course ID to Enroll: ");
-                scanf("%s", course_id);
-                clear_input_buffer();
-                write(sock, course_id, sizeof(course_id));
-                break;
-            }
-            case 3: { // Drop Course
-                char course_id[MAX_ID];
-                printf("Enter Course ID to Drop: ");
-                scanf("%s", course_id);
-                clear_input_buffer();
-                write(sock, course_id, sizeof(course_id));
-                break;
-            }
-            case 4: { // View Enrolled Course Details
-                break;
-            }
-            case 5: { // Change Password
-                char new_password[MAX_PASS];
-                printf("Enter New Password: ");
-                scanf("%s", new_password);
-                clear_input_buffer();
-                write(sock, new_password, sizeof(new_password));
-                break;
-            }
-            default:
-                break;
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+        if (!*p) return count;
+        if (count == max) return -1;
+        if (*p == '"') {
+            words[count++] = ++p;
+            p = strchr(p, '"');
+            if (!p) return -1;
+        } else {
+            words[count++] = p;
+            while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') p++;
+            if (!*p) return count;
         }
+        *p++ = '\0';
+    }
+}
 
-        printf("Client: Waiting for server response...\n");
-        bytes = read_with_length(sock, response, sizeof(response));
-        if (bytes < 0) {
-            printf("Client: Server disconnected while reading response\n");
-            return;
+// Check the arguments of a script command against the fields of its request
+int check_batch_fields(int op, char **args, int count) {
+    const char *fields = proto_op_fields(op);
+    if ((int)strlen(fields) != count) return -1;
+    for (int i = 0; i < count; i++) {
+        if (fields[i] == 'r' && strcmp(args[i], "admin") != 0 && strcmp(args[i], "faculty") != 0 &&
+            strcmp(args[i], "student") != 0) {
+            return -1;
+        } else if (fields[i] == 's') {
+            char *end;
+            strtol(args[i], &end, 10);
+            if (end == args[i] || *end) return -1;
         }
-        printf("%s", response);
     }
+    return 0;
 }
 
-void handle_faculty(int sock) {
-    char buffer[2048], response[2048];
-    while (1) {
-        int bytes = read_with_length(sock, buffer, sizeof(buffer));
-        if (bytes < 0) {
-            printf("Client: Server disconnected while reading menu\n");
-            return;
-        }
-        printf("%s", buffer);
+// Result text on one line: tabs, newlines and backslashes escaped, the final newline dropped
+void print_escaped(const char *text) {
+    size_t len = strlen(text);
+    if (len > 0 && text[len - 1] == '\n') len--;
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\n') fputs("\\n", stdout);
+        else if (text[i] == '\t') fputs("\\t", stdout);
+        else if (text[i] == '\\') fputs("\\\\", stdout);
+        else putchar(text[i]);
+    }
+}
 
-        char choice[10] = {0};
-        printf("Client: Waiting for user input...\n");
-        if (scanf("%s", choice) != 1) {
-            printf("Client: Failed to read user choice with scanf\n");
-            clear_input_buffer();
-            return;
+// Run a command script on a client pool opened by each login and closed
+// by the logout that follows. Prints "line, command, status, microseconds,
+// result" for each command. Returns 0 if every command succeeded, 1 if any
+// failed or could not be parsed, 2 if the connection was lost.
+int run_batch(FILE *script, const ClientConfig *config) {
+    ClientPool *pool = NULL;
+    int failed = 0, line_no = 0;
+    char line[1024];
+    printf("line\tcommand\tstatus\tusec\tresult\n");
+    while (fgets(line, sizeof(line), script)) {
+        line_no++;
+        char *words[BATCH_MAX_WORDS];
+        int count = split_words(line, words, BATCH_MAX_WORDS);
+        if (count == 0 || words[0][0] == '#') continue;
+        const BatchCommand *command = NULL;
+        for (int i = 0; count > 0 && batch_commands[i].name; i++) {
+            if (strcmp(batch_commands[i].name, words[0]) == 0) command = &batch_commands[i];
         }
-        clear_input_buffer();
-        printf("Client: Sending choice: %s\n", choice);
-        int bytes_written = write(sock, choice, strlen(choice));
-        if (bytes_written < 0) {
-            printf("Client: Failed to send choice, errno=%d\n", errno);
-            return;
+        if (!command) {
+            fprintf(stderr, "Client: line %d: unknown command\n", line_no);
+            failed++;
+            continue;
         }
-        fsync(sock);
-        printf("Client: Sent choice (%d bytes)\n", bytes_written);
-
-        if (atoi(choice) == 6) {
-            bytes = read_with_length(sock, response, sizeof(response));
-            if (bytes < 0) {
-                printf("Client: Server disconnected during logout\n");
-                return;
-            }
-            printf("%s", response);
-            printf("Client: Faculty logged out\n");
-            break;
+        if (check_batch_fields(command->op, words + 1, count - 1) < 0) {
+            fprintf(stderr, "Client: line %d: %s takes %zu arguments (%s)\n", line_no, command->name,
+                    strlen(proto_op_fields(command->op)), proto_op_fields(command->op));
+            failed++;
+            continue;
         }
 
-        switch (atoi(choice)) {
-            case 1: { // View Offering Courses
-                break;
-            }
-            case 2: { // Add New Course
-                char id[MAX_ID], name[MAX_NAME];
-                int seats;
-                printf("Enter Course ID: ");
-                scanf("%s", id);
-                clear_input_buffer();
-                printf("Enter Course Name: ");
-                scanf("%s", name);
-                clear_input_buffer();
-                printf("Enter Total Seats: ");
-                scanf("%d", &seats);
-                clear_input_buffer();
-                write(sock, id, sizeof(id));
-                write(sock, name, sizeof(name));
-                write(sock, &seats, sizeof(seats));
-                break;
-            }
-            case 3: { // Remove Course from Catalog
-                char id[MAX_ID];
-                printf("Enter Course ID to Remove: ");
-                scanf("%s", id);
-                clear_input_buffer();
-                write(sock, id, sizeof(id));
-                break;
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ClientResult result = {0, NULL};
+        if (command->op == OP_AUTHENTICATE) {
+            if (pool) {
+                client_logout(pool, NULL);
+                client_pool_close(pool);
             }
-            case 4: { // Update Course Details
-                char id[MAX_ID], new_name[MAX_NAME];
-                int new_seats;
-                printf("Enter Course ID to Update: ");
-                scanf("%s", id);
-                clear_input_buffer();
-                printf("Enter New Course Name: ");
-                scanf("%s", new_name);
-                clear_input_buffer();
-                printf("Enter New Total Seats: ");
-                scanf("%d", &new_seats);
-                clear_input_buffer();
-                write(sock, id, sizeof(id));
-                write(sock, new_name, sizeof(new_name));
-                write(sock, &new_seats, sizeof(new_seats));
-                break;
-            }
-            case 5: { // Change Password
-                char new_password[MAX_PASS];
-                printf("Enter New Password: ");
-                scanf("%s", new_password);
-                clear_input_buffer();
-                write(sock, new_password, sizeof(new_password));
-                break;
-            }
-            default:
-                break;
+            enum Role role = strcmp(words[1], "admin") == 0 ? ADMIN : strcmp(words[1], "faculty") == 0 ? FACULTY : STUDENT;
+            pool = client_pool_open(config, role, words[2], words[3], &result.status);
+        } else if (!pool) {
+            result.status = ERR_NOT_FOUND;
+            result.text = strdup("Not logged in\n");
+        } else if (command->op == OP_LOGOUT) {
+            client_logout(pool, &result);
+            client_pool_close(pool);
+            pool = NULL;
+        } else {
+            client_call(pool, command->op, (const char *const *)(words + 1), &result);
         }
-
-        printf("Client: Waiting for server response...\n");
-        bytes = read_with_length(sock, response, sizeof(response));
-        if (bytes < 0) {
-            printf("Client: Server disconnected while reading response\n");
-            return;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (result.status == CLIENT_ERR_CONNECTION) {
+            fprintf(stderr, "Client: line %d: connection lost\n", line_no);
+            client_result_free(&result);
+            if (pool) client_pool_close(pool);
+            return 2;
         }
-        printf("%s", response);
+        long usec = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000;
+        printf("%d\t%s\t%d\t%ld\t", line_no, command->name, result.status, usec);
+        print_escaped(result_text(command->op, &result));
+        putchar('\n');
+        if (result.status != 0) failed++;
+        client_result_free(&result);
     }
+    if (pool) client_pool_close(pool);
+    return failed ? 1 : 0;
 }
 
-int main() {
-    char buffer[2048], response[2048], login_choice[10], user_id[MAX_ID], password[MAX_PASS];
-    int bytes;
-
-    ignore_sigpipe();
-
-    while (1) {
-        int sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock < 0) {
-            perror("Socket creation failed");
+int main(int argc, char *argv[]) {
+    char login_choice[10], user_id[MAX_ID], password[MAX_PASS];
+    const char *batch_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-compress") == 0) {
+            want_compression = 0;
+        } else if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc &&
+                   strlen(argv[i + 1]) < sizeof(((struct sockaddr_un *)0)->sun_path)) {
+            unix_path = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_path = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--no-compress] [--unix PATH] [--batch FILE|-]\n", argv[0]);
             exit(1);
         }
+    }
 
-        int flags = fcntl(sock, F_GETFL, 0);
-        fcntl(sock, F_SETFL, flags & ~O_NONBLOCK);
-
-        int flag = 1;
-        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
-
-        struct sockaddr_in server_addr;
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_port = htons(PORT);
-        server_addr.sin_addr.s_addr = INADDR_ANY;
+    ignore_sigpipe();
+    ClientConfig config = {.unix_path = unix_path, .size = 1, .compress = want_compression};
 
-        if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-            perror("Connection failed");
-            close(sock);
-            sleep(1);
-            continue;
+    if (batch_path) {
+        FILE *script = strcmp(batch_path, "-") == 0 ? stdin : fopen(batch_path, "r");
+        if (!script) {
+            perror("Failed to open batch script");
+            exit(2);
         }
+        int ret = run_batch(script, &config);
+        if (script != stdin) fclose(script);
+        return ret;
+    }
 
-        bytes = read_with_length(sock, buffer, sizeof(buffer));
-        if (bytes < 0) {
-            printf("Client: Server disconnected while reading login screen\n");
-            close(sock);
-            continue;
-        }
-        printf("%s", buffer);
+    while (1) {
+        printf("%s", login_menu());
 
-        scanf("%s", login_choice);
+        scanf("%9s", login_choice);
         clear_input_buffer();
-        printf("Client: Sending login choice: %s\n", login_choice);
-        int bytes_written = write(sock, login_choice, strlen(login_choice));
-        if (bytes_written < 0) {
-            printf("Client: Failed to send login choice, errno=%d\n", errno);
-            close(sock);
+        int choice = atoi(login_choice);
+        if (choice < 1 || choice > 3) {
+            printf("Invalid choice\n");
             continue;
         }
-        fsync(sock);
 
-        bytes = read_with_length(sock, response, sizeof(response));
-        if (bytes < 0) {
-            printf("Client: Server disconnected while reading user ID prompt\n");
-            close(sock);
-            continue;
-        }
-        printf("%s", response);
-        scanf("%s", user_id);
+        printf("Enter User ID: ");
+        scanf("%9s", user_id);
+        clear_input_buffer();
+        printf("Enter Password: ");
+        scanf("%49s", password);
         clear_input_buffer();
-        printf("Client: Sending user ID: %s\n", user_id);
-        bytes_written = write(sock, user_id, sizeof(user_id));
-        if (bytes_written < 0) {
-            printf("Client: Failed to send user ID, errno=%d\n", errno);
-            close(sock);
-            continue;
-        }
-        fsync(sock);
 
-        bytes = read_with_length(sock, response, sizeof(response));
-        if (bytes < 0) {
-            printf("Client: Server disconnected while reading password prompt\n");
-            close(sock);
+        enum Role role = choice == 1 ? ADMIN : choice == 2 ? FACULTY : STUDENT;
+        int status;
+        ClientPool *pool = client_pool_open(&config, role, user_id, password, &status);
+        if (!pool && status == CLIENT_ERR_CONNECTION) {
+            printf("Client: Could not connect to the server\n");
+            sleep(1);
             continue;
         }
-        printf("%s", response);
-        scanf("%s", password);
-        clear_input_buffer();
-        printf("Client: Sending password: %s\n", password);
-        bytes_written = write(sock, password, sizeof(password));
-        if (bytes_written < 0) {
-            printf("Client: Failed to send password, errno=%d\n", errno);
-            close(sock);
+        printf("%s", result_message(OP_AUTHENTICATE, status));
+        if (!pool) {
+            printf("Please try again.\n");
             continue;
         }
-        fsync(sock);
 
-        bytes = read_with_length(sock, response, sizeof(response));
-        if (bytes < 0) {
-            printf("Client: Server disconnected while reading auth response\n");
-            close(sock);
-            continue;
-        }
-        printf("%s", response);
-
-        print_raw_bytes(response, bytes);
-        strip_newlines(response, bytes);
-
-        if (strcmp(response, "Login successful") == 0) {
-            printf("Client: Login successful, proceeding to handle role\n");
-            int choice = atoi(login_choice);
-            switch (choice) {
-                case 1: handle_admin(sock); break;
-                case 2: handle_faculty(sock); break;
-                case 3: handle_student(sock); break;
-            }
-            close(sock);
-            break;
-        } else {
-            printf("Client: Login response mismatch, expected 'Login successful'\n");
-            printf("Please try again.\n");
-            close(sock);
+        printf("Client: Login successful, proceeding to handle role\n");
+        switch (choice) {
+            case 1: handle_role(pool, ADMIN, admin_actions, "Admin"); break;
+            case 2: handle_role(pool, FACULTY, faculty_actions, "Faculty"); break;
+            case 3: handle_role(pool, STUDENT, student_actions, "Student"); break;
         }
+        client_pool_close(pool);
+        break;
     }
 
     return 0;
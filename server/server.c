@@ -1,463 +1,1397 @@
+#define _GNU_SOURCE // cpu_set_t, accept4
 #include "academia.h"
+#include "class_queue.h"
+#include "io_backend.h"
+#include "protocol.h"
+#include "framed_io.h"
+#include "event_loop.h"
+#include "logger.h"
+#include "metrics.h"
+#include "session_token.h"
+#include "handoff.h"
+#include "listing_cache.h"
+#include "compress.h"
+#include "menus.h"
+#include "cpu_topology.h"
 #include <pthread.h>
 #include <signal.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/un.h>
 #include <fcntl.h>
-#include <stdarg.h> // Added for va_start, va_end
+#include <stdatomic.h>
+#include <time.h>
 
 // Semaphore for file operations
 sem_t file_sem;
 
-// File pointer for logging
-FILE *log_file;
+// Requests waiting for a storage worker. Workers placed with --worker-cpus
+// get one queue per NUMA node they run on, and a session submits to the
+// queue of its acceptor's node; otherwise there is a single queue.
+ClassQueue request_queues[CPU_MAX_NODES];
+int request_queue_count;
+
+// Priority classes of storage requests, each queued separately. Workers
+// serve them in weighted round robin (--class-weights), so a backlog of
+// admin scans gets a fixed share of the workers instead of holding up the
+// students queued behind it.
+enum RequestClass {
+    CLASS_INTERACTIVE,   // Logins and single-record operations
+    CLASS_BULK,          // Operations that walk a whole data file
+    CLASS_MAINTENANCE,   // Work the server starts itself, such as warming caches
+    REQUEST_CLASSES
+};
+static int class_weights[REQUEST_CLASSES] = {8, 2, 1};
+
+// Maximum number of requests a storage worker takes from the queue at once
+#define STORAGE_BATCH 16
+
+// Listening sockets: one per acceptor thread, bound to PORT with SO_REUSEPORT
+// so the kernel spreads new connections across them
+#define DEFAULT_ACCEPTORS 4
+#define MAX_ACCEPTORS 64
+#define MAX_LISTENERS (MAX_ACCEPTORS + 1)   // The TCP sockets and the optional Unix domain one
+#define LISTEN_BACKLOG 1024
+#define ACCEPT_BATCH 64      // Connections an acceptor takes per readiness event
+
+// An acceptor thread runs an event loop over its listening socket and every
+// session accepted on it
+typedef struct {
+    int index;
+    int listen_fd;
+    int cpu;                 // Core the acceptor is pinned to, -1 for none
+    int local;               // Unix domain socket (--unix) rather than TCP
+    ClassQueue *queue;       // Where its sessions' requests go
+    pthread_t thread;
+    EventLoop loop;
+    EventWatch listen_watch;
+    EventTask stop_task;     // Posted by stop_acceptors() and stop_submissions()
+    sem_t stopped;
+} Acceptor;
+
+// A session stops reading requests while this much output waits for the client
+#define SESSION_OUTPUT_LIMIT (64 * 1024)
+
+// Seconds a replaced server waits for its sessions to end before exiting
+#define DEFAULT_DRAIN_TIMEOUT 30
+
+// Binary responses with at least this much text are compressed for clients
+// that accept PROTO_CAP_DEFLATE; -1 when compression is off (--no-compress)
+static int compress_threshold = COMPRESS_DEFAULT_THRESHOLD;
+
+static atomic_int live_sessions;
+
+// A parsed client request, executed by a storage worker
+typedef struct StorageRequest {
+    enum Opcode op;
+    char user_id[MAX_ID];   // Logged-in user the request runs on behalf of
+    char id[MAX_ID];
+    char name[MAX_NAME];
+    char password[MAX_PASS];
+    int seats;
+    enum Role role;
+    int ret;                // Return code of the file operation
+    char *text;             // Output of view_* operations, in the worker's arena
+    int listing_fd;         // Or a cached listing (listing_cache.h) to send and close, -1 if none
+    size_t listing_len;
+    char known_version[CATALOG_VERSION_MAX]; // Course listing version the client holds, "" if none
+    char version[CATALOG_VERSION_MAX];       // Catalog version of the listing sent
+    char *reply;            // Encoded by the worker for the session to send (malloc'd)
+    size_t reply_len;
+    size_t reply_tail;      // Bytes at the end of reply that follow the listing text of listing_fd
+    enum RequestClass request_class;
+    uint64_t submitted_ns;  // metrics_now() when the request was queued
+    uint32_t request_id;    // Binary protocol id the response is matched by
+    int terse;              // Client renders result messages itself (PROTO_FLAG_TERSE)
+    int deflate;            // Reply may be compressed (the session accepted PROTO_CAP_DEFLATE)
+    void *context;
+    int batched;            // Another completion for the same context follows in this batch
+    void (*on_complete)(struct StorageRequest *req); // Called on the worker when the request is done
+    struct StorageRequest *next;                     // Link in an enrollment group's pending list
+    EventTask returned;     // Hands the request back to its session's loop
+} StorageRequest;
+
+// Enroll and drop requests are coalesced per course. A worker that gets one
+// appends it to its course's group; if no other worker is combining that
+// group, it becomes the combiner and applies everything pending, course by
+// course, with apply_enrollments(). Requests that arrive while the combiner
+// waits for the file lock join the next round instead of taking it again.
+// After ENROLL_COMBINE_ROUNDS rounds the combiner steps down, so the rest of
+// its own batch is not held up behind a steady stream of arrivals; the next
+// arrival takes over, and the worker itself comes back to whatever is left
+// once its batch is done.
+#define ENROLL_GROUPS 64
+#define ENROLL_COMBINE_ROUNDS 2
+
+typedef struct {
+    pthread_mutex_t lock;
+    StorageRequest *head, *tail;   // Pending requests in arrival order
+    int combining;
+} EnrollGroup;
+
+static EnrollGroup enroll_groups[ENROLL_GROUPS];
 
 // Ignore SIGPIPE to prevent server from terminating on broken pipe
 void ignore_sigpipe() {
     signal(SIGPIPE, SIG_IGN);
 }
 
-// Custom logging function to write to log file
-void log_message(const char *format, ...) {
-    va_list args;
-    va_start(args, format);
-    vfprintf(log_file, format, args);
-    va_end(args);
-    fflush(log_file); // Ensure logs are written immediately
-}
-
-// Send a message with a length prefix
-void send_with_length(int sock, const char *message) {
+// Send a message with a length prefix (queued until the next read while corked)
+void send_with_length(FramedConn *conn, const char *message) {
     uint32_t len = strlen(message);
-    uint32_t len_net = htonl(len); // Convert to network byte order
-    int bytes_written = write(sock, &len_net, sizeof(len_net));
-    if (bytes_written < 0) {
-        log_message("Server: Failed to send length prefix, errno=%d\n", errno);
+    if (framed_send_message(conn, message, len, 0) < 0) {
+        log_write(LOG_ERROR, "Server: Failed to send message, errno=%d\n", errno);
         return;
     }
-    bytes_written = write(sock, message, len);
-    if (bytes_written < 0) {
-        log_message("Server: Failed to send message, errno=%d\n", errno);
-        return;
-    }
-    log_message("Server: Sent message (%d bytes): %s\n", len, message);
-}
-
-void handle_admin(int sock, char *user_id) {
-    char buffer[1024], response[1024];
-    const char *menu = "....... Welcome to Admin Menu .......\n"
-                       "1. Add Student\n"
-                       "2. View Student Details\n"
-                       "3. Add Faculty\n"
-                       "4. View Faculty Details\n"
-                       "5. Activate Student\n"
-                       "6. Block Student\n"
-                       "7. Modify Student Details\n"
-                       "8. Modify Faculty Details\n"
-                       "9. Logout and Exit\n"
-                       "Enter Your Choice: ";
-
-    while (1) {
-        // Send menu with length prefix
-        send_with_length(sock, menu);
-
-        // Receive choice
-        int bytes = read(sock, buffer, sizeof(buffer) - 1);
-        if (bytes <= 0) {
-            log_message("Server: Client disconnected while reading choice, bytes=%d\n", bytes);
-            break;
-        }
-        buffer[bytes] = '\0';
-        int choice = atoi(buffer);
-        log_message("Server: Received admin menu choice: %d\n", choice);
+    log_sampled(LOG_DEBUG, "Server: Sent message (%u bytes)\n", len);
+}
+
+// A course listing the client already holds: answer ERR_NOT_MODIFIED
+// instead of sending it again
+int listing_unchanged(StorageRequest *req) {
+    if (!req->known_version[0] || !catalog_unchanged(req->known_version)) return 0;
+    req->ret = ERR_NOT_MODIFIED;
+    strcpy(req->version, req->known_version);
+    return 1;
+}
 
-        if (choice == 9) {
-            send_with_length(sock, "Logout successful\n");
+// Run one request against the data files (storage worker side). Enroll
+// and drop requests are applied by coalesce_enrollment() instead.
+void execute_request(StorageRequest *req) {
+    req->ret = 0;
+    req->text = NULL;
+    req->listing_fd = -1;
+    Arena *arena = arena_thread();
+    switch (req->op) {
+        case OP_AUTHENTICATE:
+            req->ret = check_credentials(req->id, req->password, req->role);
+            break;
+        case OP_ADD_STUDENT:
+            req->ret = add_user(req->id, req->password, STUDENT);
+            if (req->ret == 0) req->ret = add_student(req->id, req->name);
+            break;
+        case OP_VIEW_ALL_STUDENTS:
+            req->text = view_all_students(arena, &req->ret);
+            break;
+        case OP_ADD_FACULTY:
+            req->ret = add_user(req->id, req->password, FACULTY);
+            if (req->ret == 0) req->ret = add_faculty(req->id, req->name);
+            break;
+        case OP_VIEW_ALL_FACULTY:
+            req->text = view_all_faculty(arena, &req->ret);
+            break;
+        case OP_ACTIVATE_STUDENT:
+            req->ret = activate_deactivate_student(req->id, 1);
+            break;
+        case OP_BLOCK_STUDENT:
+            req->ret = activate_deactivate_student(req->id, 0);
+            if (req->ret == 0) session_token_revoke(req->id);
+            break;
+        case OP_UPDATE_STUDENT:
+            req->ret = update_student(req->id, req->name);
+            break;
+        case OP_UPDATE_FACULTY:
+            req->ret = update_faculty(req->id, req->name);
+            break;
+        case OP_VIEW_ALL_COURSES:
+            if (listing_unchanged(req)) break;
+            req->listing_fd = view_all_courses_listing(&req->listing_len, &req->text, req->version, arena, &req->ret);
+            break;
+        case OP_VIEW_ENROLLED_COURSES:
+            req->text = view_enrolled_courses(req->user_id, arena, &req->ret);
+            break;
+        case OP_CHANGE_PASSWORD:
+            req->ret = change_password(req->user_id, req->password);
+            if (req->ret == 0) session_token_revoke(req->user_id);
+            break;
+        case OP_VIEW_FACULTY_COURSES:
+            if (listing_unchanged(req)) break;
+            req->listing_fd = view_faculty_courses_listing(req->user_id, &req->listing_len, &req->text, req->version,
+                                                           arena, &req->ret);
+            break;
+        case OP_ADD_COURSE:
+            req->ret = add_course(req->id, req->name, req->user_id, req->seats);
+            break;
+        case OP_REMOVE_COURSE:
+            req->ret = remove_course(req->id);
+            break;
+        case OP_UPDATE_COURSE:
+            req->ret = update_course(req->id, req->name, req->seats);
+            break;
+        case OP_VIEW_METRICS: {
+            char *summary = metrics_render_summary();
+            if (summary) req->text = arena_strndup(arena, summary, strlen(summary));
+            free(summary);
             break;
         }
+        default:
+            req->ret = ERR_INVALID_INPUT;
+            break;
+    }
+    if (req->ret == 0 && req->text == NULL && req->listing_fd < 0 && (req->op == OP_VIEW_ALL_STUDENTS || req->op == OP_VIEW_ALL_FACULTY ||
+                              req->op == OP_VIEW_ALL_COURSES || req->op == OP_VIEW_ENROLLED_COURSES ||
+                              req->op == OP_VIEW_FACULTY_COURSES || req->op == OP_VIEW_METRICS)) {
+        req->ret = -1;
+    }
+}
 
-        char temp_response[1024] = {0};
-        switch (choice) {
-            case 1: { // Add Student
-                char id[MAX_ID], name[MAX_NAME], password[MAX_PASS];
-                read(sock, id, sizeof(id));
-                read(sock, name, sizeof(name));
-                read(sock, password, sizeof(password));
-                int ret = add_user(id, password, STUDENT);
-                if (ret == 0) ret = add_student(id, name);
-                snprintf(temp_response, sizeof(temp_response), ret == 0 ? "Student added successfully\n" : "Failed to add student\n");
-                break;
-            }
-            case 2: { // View Student Details
-                char *students = view_all_students();
-                snprintf(temp_response, sizeof(temp_response), "%s", students ? students : "No students found or error occurred\n");
-                if (students) free(students);
-                log_message("Server: Sending response for View Student Details: %s", temp_response);
-                break;
-            }
-            case 3: { // Add Faculty
-                char id[MAX_ID], name[MAX_NAME], password[MAX_PASS];
-                read(sock, id, sizeof(id));
-                read(sock, name, sizeof(name));
-                read(sock, password, sizeof(password));
-                int ret = add_user(id, password, FACULTY);
-                if (ret == 0) ret = add_faculty(id, name);
-                snprintf(temp_response, sizeof(temp_response), ret == 0 ? "Faculty added successfully\n" : "Failed to add faculty\n");
-                break;
-            }
-            case 4: { // View Faculty Details
-                char *faculty = view_all_faculty();
-                snprintf(temp_response, sizeof(temp_response), "%s", faculty ? faculty : "No faculty found or error occurred\n");
-                if (faculty) free(faculty);
-                log_message("Server: Sending response for View Faculty Details: %s", temp_response);
-                break;
-            }
-            case 5: { // Activate Student
-                char id[MAX_ID];
-                read(sock, id, sizeof(id));
-                int ret = activate_deactivate_student(id, 1);
-                snprintf(temp_response, sizeof(temp_response), ret == 0 ? "Student activated successfully\n" : "Failed to activate student\n");
-                break;
-            }
-            case 6: { // Block Student
-                char id[MAX_ID];
-                read(sock, id, sizeof(id));
-                int ret = activate_deactivate_student(id, 0);
-                snprintf(temp_response, sizeof(temp_response), ret == 0 ? "Student blocked successfully\n" : "Failed to block student\n");
-                break;
-            }
-            case 7: { // Modify Student Details
-                char id[MAX_ID], new_name[MAX_NAME];
-                read(sock, id, sizeof(id));
-                read(sock, new_name, sizeof(new_name));
-                int ret = update_student(id, new_name);
-                snprintf(temp_response, sizeof(temp_response), ret == 0 ? "Student details updated successfully\n" : "Failed to update student details\n");
-                break;
-            }
-            case 8: { // Modify Faculty Details
-                char id[MAX_ID], new_name[MAX_NAME];
-                read(sock, id, sizeof(id));
-                read(sock, new_name, sizeof(new_name));
-                int ret = update_faculty(id, new_name);
-                snprintf(temp_response, sizeof(temp_response), ret == 0 ? "Faculty details updated successfully\n" : "Failed to update faculty details\n");
-                break;
+// Record a finished request and hand it to its completion callback
+void finish_request(StorageRequest *req, StorageRequest *following) {
+    metrics_record_request(req->op, req->ret, metrics_now() - req->submitted_ns);
+    // Pipelined requests of one connection sit next to each other;
+    // their replies are corked and leave together
+    req->batched = following && req->context && following->context == req->context;
+    req->on_complete(req);
+}
+
+unsigned course_hash(const char *course_id) {
+    unsigned hash = 5381;
+    for (const char *p = course_id; *p; p++) hash = hash * 33 + (unsigned char)*p;
+    return hash;
+}
+
+unsigned enroll_group_of(const char *course_id) {
+    return course_hash(course_id) % ENROLL_GROUPS;
+}
+
+// Apply a list of pending enroll/drop requests: each pass takes the first
+// request's course and up to ENROLL_BATCH_MAX requests for it, in order
+void apply_enrollment_list(StorageRequest *list) {
+    while (list) {
+        StorageRequest *picked[ENROLL_BATCH_MAX];
+        EnrollmentChange changes[ENROLL_BATCH_MAX];
+        int count = 0;
+        StorageRequest **link = &list;
+        char course_id[MAX_ID];
+        strcpy(course_id, list->id);
+        while (*link && count < ENROLL_BATCH_MAX) {
+            StorageRequest *req = *link;
+            if (strcmp(req->id, course_id) != 0) {
+                link = &req->next;
+                continue;
             }
-            default:
-                snprintf(temp_response, sizeof(temp_response), "Invalid choice\n");
-                break;
+            *link = req->next;
+            picked[count] = req;
+            strcpy(changes[count].student_id, req->user_id);
+            changes[count].enroll = req->op == OP_ENROLL_COURSE;
+            count++;
         }
 
-        // Send response with length prefix
-        send_with_length(sock, temp_response);
+        int ret = apply_enrollments(course_id, changes, count);
+        log_sampled(LOG_DEBUG, "Server: Applied %d enrollment changes to course %s\n", count, course_id);
+        for (int i = 0; i < count; i++) {
+            picked[i]->ret = ret == ERR_LOCK_TIMEOUT ? ERR_LOCK_TIMEOUT : ret < 0 ? -1 : changes[i].result;
+            picked[i]->text = NULL;
+            picked[i]->listing_fd = -1;
+            finish_request(picked[i], i + 1 < count ? picked[i + 1] : NULL);
+        }
     }
 }
 
-void handle_student(int sock, char *student_id) {
-    char buffer[1024], response[1024];
-    const char *menu = "....... Welcome to Student Menu .......\n"
-                       "1. View All Courses\n"
-                       "2. Enroll New Course\n"
-                       "3. Drop Course\n"
-                       "4. View Enrolled Course Details\n"
-                       "5. Change Password\n"
-                       "6. Logout and Exit\n"
-                       "Enter Your Choice: ";
+// Combine group, whose lock is held and which has no combiner, for up to
+// ENROLL_COMBINE_ROUNDS rounds. Returns with the lock released: 1 if
+// requests were left on the group, which then has no combiner again.
+int combine_enroll_group(EnrollGroup *group) {
+    group->combining = 1;
+    for (int round = 0; group->head && round < ENROLL_COMBINE_ROUNDS; round++) {
+        StorageRequest *list = group->head;
+        group->head = group->tail = NULL;
+        pthread_mutex_unlock(&group->lock);
+        apply_enrollment_list(list);
+        pthread_mutex_lock(&group->lock);
+    }
+    int left = group->head != NULL;
+    group->combining = 0;
+    pthread_mutex_unlock(&group->lock);
+    return left;
+}
 
-    while (1) {
-        send_with_length(sock, menu);
+// Queue an enroll/drop request on its course's group, and combine the group
+// unless another worker already is. Returns the group if this worker stepped
+// down with requests still on it (resume_enroll_group), else NULL.
+EnrollGroup *coalesce_enrollment(StorageRequest *req) {
+    EnrollGroup *group = &enroll_groups[enroll_group_of(req->id)];
+    req->next = NULL;
+    pthread_mutex_lock(&group->lock);
+    if (group->tail) {
+        group->tail->next = req;
+    } else {
+        group->head = req;
+    }
+    group->tail = req;
+    if (group->combining) {
+        pthread_mutex_unlock(&group->lock);
+        return NULL;
+    }
+    return combine_enroll_group(group) ? group : NULL;
+}
 
-        int bytes = read(sock, buffer, sizeof(buffer) - 1);
-        if (bytes <= 0) {
-            log_message("Server: Client disconnected while reading choice, bytes=%d\n", bytes);
-            break;
-        }
-        buffer[bytes] = '\0';
-        int choice = atoi(buffer);
-        log_message("Server: Received student menu choice: %d\n", choice);
+// Combine a group stepped down from, unless it was emptied or another
+// worker took over meanwhile. 1 if requests were left on it again.
+int resume_enroll_group(EnrollGroup *group) {
+    pthread_mutex_lock(&group->lock);
+    if (group->combining || !group->head) {
+        pthread_mutex_unlock(&group->lock);
+        return 0;
+    }
+    return combine_enroll_group(group);
+}
 
-        if (choice == 6) {
-            send_with_length(sock, "Logout successful\n");
-            break;
+// Storage worker: drain its request queue in batches and complete each request
+void *storage_worker(void *arg) {
+    ClassQueue *queue = arg;
+    void *batch[STORAGE_BATCH];
+    EnrollGroup *stepped_down[STORAGE_BATCH];
+    int count;
+    while ((count = class_queue_pop_batch(queue, batch, STORAGE_BATCH)) > 0) {
+        int left = 0;
+        for (int i = 0; i < count; i++) {
+            StorageRequest *req = batch[i];
+            if (req->op == OP_ENROLL_COURSE || req->op == OP_DROP_COURSE) {
+                EnrollGroup *group = coalesce_enrollment(req);
+                if (group) stepped_down[left++] = group;
+                continue;
+            }
+            execute_request(req);
+            finish_request(req, i + 1 < count ? batch[i + 1] : NULL);
+            // Replies rendered by this thread are encoded by now
+            arena_reset(arena_thread());
         }
+        // The batch is answered: finish the groups stepped down from, if no one else has
+        while (left > 0) {
+            EnrollGroup *group = stepped_down[--left];
+            if (resume_enroll_group(group)) stepped_down[left++] = group;
+        }
+    }
+    return NULL;
+}
 
-        char temp_response[1024] = {0};
-        switch (choice) {
-            case 1: { // View All Courses
-                char *courses = view_all_courses();
-                snprintf(temp_response, sizeof(temp_response), "%s", courses ? courses : "No courses found or error occurred\n");
-                if (courses) free(courses);
-                break;
-            }
-            case 2: { // Enroll New Course
-                char course_id[MAX_ID];
-                read(sock, course_id, sizeof(course_id));
-                int ret = enroll_course(student_id, course_id);
-                if (ret == 0) {
-                    snprintf(temp_response, sizeof(temp_response), "Enrolled successfully\n");
-                } else if (ret == ERR_FULL) {
-                    snprintf(temp_response, sizeof(temp_response), "Course is full\n");
-                } else if (ret == ERR_ALREADY_ENROLLED) {
-                    snprintf(temp_response, sizeof(temp_response), "Already enrolled in this course\n");
-                } else if (ret == ERR_COURSE_NOT_FOUND) {
-                    snprintf(temp_response, sizeof(temp_response), "Course not found\n");
-                } else if (ret == ERR_INVALID_INPUT) {
-                    snprintf(temp_response, sizeof(temp_response), "Student is blocked\n");
-                } else {
-                    snprintf(temp_response, sizeof(temp_response), "Failed to enroll\n");
-                }
-                break;
-            }
-            case 3: { // Drop Course
-                char course_id[MAX_ID];
-                read(sock, course_id, sizeof(course_id));
-                int ret = unenroll_course(student_id, course_id);
-                snprintf(temp_response, sizeof(temp_response), ret == 0 ? "Dropped successfully\n" : ret == ERR_NOT_ENROLLED ? "Not enrolled in this course\n" : "Failed to drop course\n");
+// Set by stop_submissions() before the request queues are closed
+static atomic_int submissions_closed;
+
+// Hand a request to the storage workers of queue; req->on_complete runs when
+// it is done. -1 once the server is shutting down.
+int submit_request_async(ClassQueue *queue, StorageRequest *req) {
+    if (atomic_load(&submissions_closed)) return -1;
+    req->submitted_ns = metrics_now();
+    return class_queue_push(queue, req->request_class, req);
+}
+
+// Text sent back to the client for a completed request
+const char *response_text(StorageRequest *req) {
+    return req->text ? req->text : result_message(req->op, req->ret);
+}
+
+// A client connection, owned by the event loop of the acceptor that took
+// it. Both protocols run as state machines over whatever input has arrived,
+// so nothing waits on the client: a session only holds this struct between
+// requests, plus a read buffer while part of a message is in.
+enum SessionState {
+    SESSION_LOGIN_CHOICE,   // Login screen sent: a choice, or PROTO_MAGIC for the binary protocol
+    SESSION_USER_ID,
+    SESSION_PASSWORD,
+    SESSION_MENU,           // Role menu sent, waiting for a choice
+    SESSION_FIELDS,         // Reading the fixed-size fields of the chosen operation
+    SESSION_STORAGE,        // Interactive request or login at the storage workers
+    SESSION_BINARY,
+    SESSION_BINARY_LOGIN,   // OP_AUTHENTICATE at the storage workers; later frames wait for it
+    SESSION_LOGOUT,         // OP_LOGOUT waiting for the requests still in flight
+    SESSION_CLOSING,        // Sending what is queued, then closing
+};
+
+typedef struct {
+    EventWatch watch;
+    EventLoop *loop;
+    ClassQueue *queue;
+    FramedConn conn;
+    enum SessionState state;
+    int binary;
+    int logged_in;
+    enum Role role;
+    char user_id[MAX_ID];
+    int deflate;             // Client accepted PROTO_CAP_DEFLATE
+    int eof;                 // The client closed its side or the connection failed
+    int inflight;            // Requests at the storage workers, at most PROTO_MAX_INFLIGHT in binary mode
+    uint32_t logout_id;      // Request id of a waiting OP_LOGOUT
+    int subscriptions;       // Courses it watches for free seats (OP_SUBSCRIBE)
+    StorageRequest *req;     // Interactive request whose fields are being read
+    const char *fields;      // Its fields still to read, as in proto_op_fields()
+} Session;
+
+// Interactive menu entries: the operation and the fixed-size fields sent
+// right behind the choice ('i' id, 'n' name, 'p' password, 's' seats)
+typedef struct {
+    enum Opcode op;
+    const char *fields;
+} MenuChoice;
+
+static const MenuChoice admin_choices[] = {
+    [1] = {OP_ADD_STUDENT, "inp"},       // Add Student
+    [2] = {OP_VIEW_ALL_STUDENTS, ""},    // View Student Details
+    [3] = {OP_ADD_FACULTY, "inp"},       // Add Faculty
+    [4] = {OP_VIEW_ALL_FACULTY, ""},     // View Faculty Details
+    [5] = {OP_ACTIVATE_STUDENT, "i"},    // Activate Student
+    [6] = {OP_BLOCK_STUDENT, "i"},       // Block Student
+    [7] = {OP_UPDATE_STUDENT, "in"},     // Modify Student Details
+    [8] = {OP_UPDATE_FACULTY, "in"},     // Modify Faculty Details
+    [9] = {OP_LOGOUT, ""},
+    [10] = {OP_VIEW_METRICS, ""},        // View Server Metrics
+};
+
+static const MenuChoice student_choices[] = {
+    [1] = {OP_VIEW_ALL_COURSES, ""},       // View All Courses
+    [2] = {OP_ENROLL_COURSE, "i"},         // Enroll New Course
+    [3] = {OP_DROP_COURSE, "i"},           // Drop Course
+    [4] = {OP_VIEW_ENROLLED_COURSES, ""},  // View Enrolled Course Details
+    [5] = {OP_CHANGE_PASSWORD, "p"},       // Change Password
+    [6] = {OP_LOGOUT, ""},
+};
+
+static const MenuChoice faculty_choices[] = {
+    [1] = {OP_VIEW_FACULTY_COURSES, ""},   // View Offering Courses
+    [2] = {OP_ADD_COURSE, "ins"},          // Add New Course
+    [3] = {OP_REMOVE_COURSE, "i"},         // Remove Course from Catalog
+    [4] = {OP_UPDATE_COURSE, "ins"},       // Update Course Details
+    [5] = {OP_CHANGE_PASSWORD, "p"},       // Change Password
+    [6] = {OP_LOGOUT, ""},
+};
+
+// The menu entry for a choice, NULL if the role has none
+const MenuChoice *menu_choice(enum Role role, int choice) {
+    const MenuChoice *choices = student_choices;
+    int count = sizeof(student_choices) / sizeof(student_choices[0]);
+    if (role == ADMIN) {
+        choices = admin_choices;
+        count = sizeof(admin_choices) / sizeof(admin_choices[0]);
+    } else if (role == FACULTY) {
+        choices = faculty_choices;
+        count = sizeof(faculty_choices) / sizeof(faculty_choices[0]);
+    }
+    return choice > 0 && choice < count && choices[choice].op ? &choices[choice] : NULL;
+}
+
+const char *role_label(enum Role role) {
+    return role == ADMIN ? "admin" : role == FACULTY ? "faculty" : "student";
+}
+
+// Where an interactive field goes in the request, and its size on the wire
+void *field_slot(StorageRequest *req, char kind, size_t *size) {
+    switch (kind) {
+        case 'i': *size = sizeof(req->id); return req->id;
+        case 'n': *size = sizeof(req->name); return req->name;
+        case 'p': *size = sizeof(req->password); return req->password;
+        default: *size = sizeof(req->seats); return &req->seats;
+    }
+}
+
+// Take a menu choice from the buffered input (at least one byte), -1 if it
+// is not a number. Only the digits are consumed, so fields sent right behind
+// the choice stay buffered for the fixed-size field reads that follow.
+int take_choice(FramedConn *conn) {
+    size_t avail;
+    const char *data = framed_buffered(conn, &avail);
+    char buffer[16];
+    size_t len = 0;
+    while (len < avail && len < sizeof(buffer) - 1 && data[len] >= '0' && data[len] <= '9') len++;
+    if (len == 0) {
+        framed_consume(conn, avail);
+        return -1;
+    }
+    memcpy(buffer, data, len);
+    buffer[len] = '\0';
+    framed_consume(conn, len);
+    return atoi(buffer) > 0 ? atoi(buffer) : -1;
+}
+
+// Send a frame, or only queue it when more replies follow right behind it
+void send_frame(Session *session, ProtoBuffer *frame, int more) {
+    if (framed_send(&session->conn, frame->data, frame->len, more) < 0) {
+        log_write(LOG_ERROR, "Server: Failed to send frame, errno=%d\n", errno);
+    }
+}
+
+uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Compressed form of a response text if the client takes one and the text
+// is long enough to be worth it, else -1
+long deflate_response(int deflate, const char *text, char **packed) {
+    size_t len = strlen(text);
+    if (!deflate || compress_threshold < 0 || len < (size_t)compress_threshold) return -1;
+    uint64_t start = thread_cpu_ns();
+    long packed_len = compress_text(text, len, packed);
+    metrics_record_compression(len, packed_len < 0 ? len : (size_t)packed_len, thread_cpu_ns() - start);
+    return packed_len;
+}
+
+// Encode a response; a non-NULL extra is attached as the third field: the
+// session's new resume token, or the catalog version of a course listing
+int build_response(ProtoBuffer *frame, int deflate, uint8_t opcode, uint32_t request_id, int status, const char *text,
+                   const char *extra) {
+    char *packed = NULL;
+    long packed_len = deflate_response(deflate, text, &packed);
+    int ret = -1;
+    if (proto_begin(frame, opcode, PROTO_FLAG_RESPONSE | (packed_len >= 0 ? PROTO_FLAG_DEFLATE : 0), request_id) == 0 &&
+        proto_add_int(frame, status) == 0 &&
+        (packed_len >= 0 ? proto_add_bytes(frame, packed, packed_len) : proto_add_str(frame, text)) == 0 &&
+        (!extra || proto_add_str(frame, extra) == 0)) {
+        proto_finish(frame);
+        ret = 0;
+    }
+    free(packed);
+    return ret;
+}
+
+void send_response(Session *session, uint8_t opcode, uint32_t request_id, int status, const char *text,
+                   const char *token, int more) {
+    ProtoBuffer frame;
+    proto_buffer_init(&frame);
+    if (build_response(&frame, session->deflate, opcode, request_id, status, text, token) == 0) {
+        send_frame(session, &frame, more);
+    }
+    proto_buffer_free(&frame);
+}
+
+void send_reply(Session *session, uint8_t opcode, uint32_t request_id, int status, const char *text) {
+    send_response(session, opcode, request_id, status, text, NULL, 0);
+}
+
+// Which opcodes each role may run, mirroring the interactive menus
+int op_allowed(enum Role role, int op) {
+    switch (op) {
+        case OP_ADD_STUDENT:
+        case OP_VIEW_ALL_STUDENTS:
+        case OP_ADD_FACULTY:
+        case OP_VIEW_ALL_FACULTY:
+        case OP_ACTIVATE_STUDENT:
+        case OP_BLOCK_STUDENT:
+        case OP_UPDATE_STUDENT:
+        case OP_UPDATE_FACULTY:
+        case OP_VIEW_METRICS:
+            return role == ADMIN;
+        case OP_VIEW_ALL_COURSES:
+        case OP_ENROLL_COURSE:
+        case OP_DROP_COURSE:
+        case OP_VIEW_ENROLLED_COURSES:
+        case OP_SUBSCRIBE:
+        case OP_UNSUBSCRIBE:
+            return role == STUDENT;
+        case OP_VIEW_FACULTY_COURSES:
+        case OP_ADD_COURSE:
+        case OP_REMOVE_COURSE:
+        case OP_UPDATE_COURSE:
+            return role == FACULTY;
+        case OP_CHANGE_PASSWORD:
+            return role != ADMIN;
+        default:
+            return 0;
+    }
+}
+
+// A name field: a person's name as validate_name() has it, or any course name that fits
+int check_name(int op, const char *name) {
+    if (op == OP_ADD_COURSE || op == OP_UPDATE_COURSE) return name[0] ? 0 : ERR_INVALID_INPUT;
+    return validate_name(name);
+}
+
+// Fill the request from the message fields listed by proto_op_fields(). A
+// course listing request may add the version of the listing the client holds.
+// ERR_INVALID_INPUT if a field is missing, too long or not valid: an id cut
+// down to size could name another record.
+int decode_request(const ProtoMessage *msg, StorageRequest *req) {
+    const char *fields = proto_op_fields(msg->opcode);
+    int count = strlen(fields);
+    if ((msg->opcode == OP_VIEW_ALL_COURSES || msg->opcode == OP_VIEW_FACULTY_COURSES) && msg->field_count > count &&
+        proto_get_str(msg, count, req->known_version, sizeof(req->known_version)) < 0) {
+        return ERR_INVALID_INPUT;
+    }
+    for (int i = 0; fields[i]; i++) {
+        if (i >= msg->field_count) return ERR_INVALID_INPUT;
+        int bad = 0;
+        switch (fields[i]) {
+            case 'r': req->role = proto_get_int(msg, i); break;
+            case 'i':
+                bad = proto_get_str(msg, i, req->id, sizeof(req->id)) < 0 || validate_id(req->id) != 0;
                 break;
-            }
-            case 4: { // View Enrolled Course Details
-                char *courses = view_enrolled_courses(student_id);
-                snprintf(temp_response, sizeof(temp_response), "%s", courses ? courses : "No courses enrolled or error occurred\n");
-                if (courses) free(courses);
+            case 'n':
+                bad = proto_get_str(msg, i, req->name, sizeof(req->name)) < 0 || check_name(msg->opcode, req->name) != 0;
                 break;
-            }
-            case 5: { // Change Password
-                char new_password[MAX_PASS];
-                read(sock, new_password, sizeof(new_password));
-                int ret = change_password(student_id, new_password);
-                snprintf(temp_response, sizeof(temp_response), ret == 0 ? "Password changed successfully\n" : "Failed to change password\n");
+            case 'p':
+                bad = proto_get_str(msg, i, req->password, sizeof(req->password)) < 0 ||
+                      validate_password(req->password) != 0;
                 break;
-            }
-            default:
-                snprintf(temp_response, sizeof(temp_response), "Invalid choice\n");
+            case 's':
+                req->seats = proto_get_int(msg, i);
+                bad = validate_seats(req->seats) != 0;
                 break;
         }
+        if (bad) return ERR_INVALID_INPUT;
+    }
+    return 0;
+}
 
-        send_with_length(sock, temp_response);
+// Storage worker side of a binary request: encode the response while the
+// worker's arena still holds the text. For a cached listing only the frame
+// up to the text field is encoded; the session sends the text straight from
+// the listing's memfd.
+void encode_binary_reply(StorageRequest *req) {
+    if (req->listing_fd >= 0 && req->deflate && compress_threshold >= 0 &&
+        req->listing_len >= (size_t)compress_threshold) {
+        // Compressed listings are built in memory like any other reply
+        req->text = listing_read_text(req->listing_fd, req->listing_len, arena_thread());
+        close(req->listing_fd);
+        req->listing_fd = -1;
+        if (!req->text) req->ret = -1;
+    }
+    ProtoBuffer frame;
+    proto_buffer_init(&frame);
+    int encoded;
+    if (req->listing_fd >= 0) {
+        // The catalog version goes out after the text, as the reply's tail
+        encoded = proto_begin(&frame, req->op, PROTO_FLAG_RESPONSE, req->request_id) == 0 &&
+                  proto_add_int(&frame, req->ret) == 0 && proto_add_str_header(&frame, req->listing_len) == 0;
+        size_t head_len = frame.len;
+        encoded = encoded && proto_add_str(&frame, req->version) == 0;
+        if (encoded) {
+            req->reply_tail = frame.len - head_len;
+            proto_finish_external(&frame, req->listing_len);
+        }
+    } else {
+        const char *text = req->terse && !req->text ? "" : response_text(req);
+        // A password change revoked the session's token; hand out a new one
+        char token[SESSION_TOKEN_MAX];
+        int new_token = req->op == OP_CHANGE_PASSWORD && req->ret == 0 &&
+                        session_token_issue(req->user_id, req->role, token, sizeof(token)) == 0;
+        const char *extra = new_token ? token : req->version[0] ? req->version : NULL;
+        encoded = build_response(&frame, req->deflate, req->op, req->request_id, req->ret, text, extra) == 0;
+    }
+    if (!encoded) {
+        proto_buffer_free(&frame);
+        if (req->listing_fd >= 0) close(req->listing_fd);
+        req->listing_fd = -1;
+        return;
     }
+    req->reply = frame.data;
+    req->reply_len = frame.len;
 }
 
-void handle_faculty(int sock, char *faculty_id) {
-    char buffer[1024], response[1024];
-    const char *menu = "....... Welcome to Faculty Menu .......\n"
-                       "1. View Offering Courses\n"
-                       "2. Add New Course\n"
-                       "3. Remove Course from Catalog\n"
-                       "4. Update Course Details\n"
-                       "5. Change Password\n"
-                       "6. Logout and Exit\n"
-                       "Enter Your Choice: ";
+// Storage worker side of an interactive request: the reply text, truncated
+// to one reply buffer, unless it is a listing short enough to be sent from
+// its memfd as it is (the file is already framed)
+void encode_interactive_reply(StorageRequest *req) {
+    char temp_response[1024];
+    if (req->listing_fd >= 0) {
+        if (req->listing_len < sizeof(temp_response)) return;
+        req->text = listing_read_text(req->listing_fd, req->listing_len, arena_thread());
+        close(req->listing_fd);
+        req->listing_fd = -1;
+    }
+    snprintf(temp_response, sizeof(temp_response), "%s", response_text(req));
+    req->reply = strdup(temp_response);
+}
 
-    while (1) {
-        send_with_length(sock, menu);
+void session_request_returned(void *arg);
 
-        int bytes = read(sock, buffer, sizeof(buffer) - 1);
-        if (bytes <= 0) {
-            log_message("Server: Client disconnected while reading choice, bytes=%d\n", bytes);
-            break;
+// Storage worker callbacks: encode the reply, then hand the request back to
+// the loop that owns its session (a login changes the session, so its
+// result is handled there)
+void return_to_session(StorageRequest *req) {
+    Session *session = req->context;
+    req->returned = (EventTask){.run = session_request_returned, .arg = req};
+    event_loop_post(session->loop, &req->returned);
+}
+
+void complete_binary_request(StorageRequest *req) {
+    if (req->op != OP_AUTHENTICATE) encode_binary_reply(req);
+    return_to_session(req);
+}
+
+void complete_interactive_request(StorageRequest *req) {
+    if (req->op != OP_AUTHENTICATE) encode_interactive_reply(req);
+    return_to_session(req);
+}
+
+// Scans of a whole data file are bulk work; everything a session asks for
+// is interactive otherwise
+enum RequestClass request_class_of(enum Opcode op) {
+    switch (op) {
+        case OP_VIEW_ALL_STUDENTS:
+        case OP_VIEW_ALL_FACULTY:
+        case OP_REMOVE_COURSE:
+            return CLASS_BULK;
+        default:
+            return CLASS_INTERACTIVE;
+    }
+}
+
+// Hand a request of the session to the storage workers
+void session_submit(Session *session, StorageRequest *req, void (*on_complete)(StorageRequest *req)) {
+    req->context = session;
+    req->on_complete = on_complete;
+    req->request_class = request_class_of(req->op);
+    session->inflight++;
+    if (submit_request_async(session->queue, req) < 0) {
+        // Shutting down: fail the request the way a worker would
+        req->ret = -1;
+        req->text = NULL;
+        req->listing_fd = -1;
+        req->batched = 0;
+        on_complete(req);
+    }
+}
+
+void binary_login(Session *session, const ProtoMessage *msg) {
+    StorageRequest *req = calloc(1, sizeof(StorageRequest));
+    if (!req || decode_request(msg, req) < 0 || req->role < ADMIN || req->role > FACULTY) {
+        free(req);
+        send_reply(session, msg->opcode, msg->request_id, ERR_INVALID_INPUT, "Invalid login request\n");
+        return;
+    }
+    req->op = OP_AUTHENTICATE;
+    req->request_id = msg->request_id;
+    session->state = SESSION_BINARY_LOGIN;
+    session_submit(session, req, complete_binary_request);
+}
+
+void finish_binary_login(Session *session, StorageRequest *req) {
+    session->state = SESSION_BINARY;
+    int authenticated = req->ret;
+    if (authenticated == ERR_LOCK_TIMEOUT) {
+        send_reply(session, req->op, req->request_id, ERR_LOCK_TIMEOUT, "Server is busy, please try again\n");
+    } else if (authenticated < 0) {
+        send_reply(session, req->op, req->request_id, -1, "Server error: Cannot open users file\n");
+    } else if (authenticated) {
+        session->logged_in = 1;
+        session->role = req->role;
+        snprintf(session->user_id, sizeof(session->user_id), "%s", req->id);
+        log_write(LOG_INFO, "Server: Login successful for user %s\n", session->user_id);
+        char token[SESSION_TOKEN_MAX];
+        int issued = session_token_issue(session->user_id, session->role, token, sizeof(token)) == 0;
+        send_response(session, req->op, req->request_id, 0, "Login successful\n", issued ? token : NULL, 0);
+    } else {
+        log_write(LOG_INFO, "Server: Login failed for user %s\n", req->id);
+        send_reply(session, req->op, req->request_id, ERR_NOT_FOUND, "Login failed\n");
+    }
+}
+
+// Capability negotiation: enable what both sides support and report it
+void binary_hello(Session *session, const ProtoMessage *msg) {
+    int32_t wanted = proto_get_int(msg, 0);
+    session->deflate = (wanted & PROTO_CAP_DEFLATE) && compress_threshold >= 0;
+    ProtoBuffer frame;
+    proto_buffer_init(&frame);
+    if (proto_build_response(&frame, msg->opcode, msg->request_id, 0, "") == 0 &&
+        proto_add_int(&frame, session->deflate ? PROTO_CAP_DEFLATE : 0) == 0) {
+        proto_finish(&frame);
+        send_frame(session, &frame, 0);
+    }
+    proto_buffer_free(&frame);
+}
+
+// Resume a session with a token from an earlier login, without touching users.dat
+void binary_resume(Session *session, const ProtoMessage *msg) {
+    uint64_t start = metrics_now();
+    char token[SESSION_TOKEN_MAX], user_id[MAX_ID];
+    enum Role role;
+    if (proto_get_str(msg, 0, token, sizeof(token)) < 0 || session_token_verify(token, user_id, &role) < 0) {
+        log_write(LOG_INFO, "Server: Rejected session token\n");
+        metrics_record_request(OP_RESUME, ERR_NOT_FOUND, metrics_now() - start);
+        send_reply(session, msg->opcode, msg->request_id, ERR_NOT_FOUND, "Session expired\n");
+        return;
+    }
+    session->logged_in = 1;
+    session->role = role;
+    snprintf(session->user_id, sizeof(session->user_id), "%s", user_id);
+    log_write(LOG_INFO, "Server: Resumed session for user %s\n", session->user_id);
+    int issued = session_token_issue(session->user_id, session->role, token, sizeof(token)) == 0;
+    metrics_record_request(OP_RESUME, 0, metrics_now() - start);
+    send_response(session, msg->opcode, msg->request_id, 0, "Session resumed\n", issued ? token : NULL, 0);
+}
+
+// Seat-availability subscriptions: which sessions watch which course. A
+// storage worker whose change frees seats posts one SeatEvent to each event
+// loop with subscribers to the course, and the loop pushes it to its own
+// sessions, which only it may touch. A session leaves the table before it
+// is freed, on its own loop, so an entry a loop finds for itself is live.
+#define SUBSCRIPTION_BUCKETS 64
+#define SESSION_MAX_SUBSCRIPTIONS 16
+
+typedef struct Subscription {
+    char course_id[MAX_ID];
+    Session *session;
+    struct Subscription *next;
+} Subscription;
+
+typedef struct {
+    pthread_mutex_t lock;
+    Subscription *head;
+} SubscriptionBucket;
+
+static SubscriptionBucket subscriptions[SUBSCRIPTION_BUCKETS];
+
+typedef struct {
+    EventTask task;
+    EventLoop *loop;
+    char course_id[MAX_ID];
+    int free_seats;
+    int total_seats;
+} SeatEvent;
+
+SubscriptionBucket *subscription_bucket(const char *course_id) {
+    return &subscriptions[course_hash(course_id) % SUBSCRIPTION_BUCKETS];
+}
+
+int subscribe_session(Session *session, const char *course_id) {
+    SubscriptionBucket *bucket = subscription_bucket(course_id);
+    int ret = 0;
+    pthread_mutex_lock(&bucket->lock);
+    Subscription *sub = bucket->head;
+    while (sub && (sub->session != session || strcmp(sub->course_id, course_id) != 0)) sub = sub->next;
+    if (!sub && session->subscriptions >= SESSION_MAX_SUBSCRIPTIONS) ret = ERR_FULL;
+    if (!sub && ret == 0) {
+        sub = calloc(1, sizeof(Subscription));
+        if (sub) {
+            snprintf(sub->course_id, sizeof(sub->course_id), "%s", course_id);
+            sub->session = session;
+            sub->next = bucket->head;
+            bucket->head = sub;
+            session->subscriptions++;
+        } else {
+            ret = -1;
         }
-        buffer[bytes] = '\0';
-        int choice = atoi(buffer);
-        log_message("Server: Received faculty menu choice: %d\n", choice);
+    }
+    pthread_mutex_unlock(&bucket->lock);
+    return ret;
+}
 
-        if (choice == 6) {
-            send_with_length(sock, "Logout successful\n");
+int unsubscribe_session(Session *session, const char *course_id) {
+    SubscriptionBucket *bucket = subscription_bucket(course_id);
+    int ret = ERR_NOT_FOUND;
+    pthread_mutex_lock(&bucket->lock);
+    for (Subscription **link = &bucket->head; *link; link = &(*link)->next) {
+        Subscription *sub = *link;
+        if (sub->session == session && strcmp(sub->course_id, course_id) == 0) {
+            *link = sub->next;
+            free(sub);
+            session->subscriptions--;
+            ret = 0;
             break;
         }
+    }
+    pthread_mutex_unlock(&bucket->lock);
+    return ret;
+}
 
-        char temp_response[1024] = {0};
-        switch (choice) {
-            case 1: { // View Offering Courses
-                char *courses = view_faculty_courses(faculty_id);
-                snprintf(temp_response, sizeof(temp_response), "%s", courses ? courses : "No courses found or error occurred\n");
-                if (courses) free(courses);
-                break;
+// A closing session leaves every bucket
+void unsubscribe_all(Session *session) {
+    for (int i = 0; session->subscriptions > 0 && i < SUBSCRIPTION_BUCKETS; i++) {
+        SubscriptionBucket *bucket = &subscriptions[i];
+        pthread_mutex_lock(&bucket->lock);
+        Subscription **link = &bucket->head;
+        while (*link) {
+            Subscription *sub = *link;
+            if (sub->session == session) {
+                *link = sub->next;
+                free(sub);
+                session->subscriptions--;
+            } else {
+                link = &sub->next;
             }
-            case 2: { // Add New Course
-                char id[MAX_ID], name[MAX_NAME];
-                int seats;
-                read(sock, id, sizeof(id));
-                read(sock, name, sizeof(name));
-                read(sock, &seats, sizeof(seats));
-                int ret = add_course(id, name, faculty_id, seats);
-                snprintf(temp_response, sizeof(temp_response), ret == 0 ? "Course added successfully\n" : "Failed to add course\n");
-                break;
-            }
-            case 3: { // Remove Course from Catalog
-                char id[MAX_ID];
-                read(sock, id, sizeof(id));
-                int ret = remove_course(id);
-                snprintf(temp_response, sizeof(temp_response), ret == 0 ? "Course removed successfully\n" : "Failed to remove course\n");
-                break;
-            }
-            case 4: { // Update Course Details
-                char id[MAX_ID], new_name[MAX_NAME];
-                int new_seats;
-                read(sock, id, sizeof(id));
-                read(sock, new_name, sizeof(new_name));
-                read(sock, &new_seats, sizeof(new_seats));
-                int ret = update_course(id, new_name, new_seats);
-                snprintf(temp_response, sizeof(temp_response), ret == 0 ? "Course updated successfully\n" : "Failed to update course\n");
-                break;
-            }
-            case 5: { // Change Password
-                char new_password[MAX_PASS];
-                read(sock, new_password, sizeof(new_password));
-                int ret = change_password(faculty_id, new_password);
-                snprintf(temp_response, sizeof(temp_response), ret == 0 ? "Password changed successfully\n" : "Failed to change password\n");
-                break;
-            }
-            default:
-                snprintf(temp_response, sizeof(temp_response), "Invalid choice\n");
-                break;
         }
+        pthread_mutex_unlock(&bucket->lock);
+    }
+}
 
-        send_with_length(sock, temp_response);
+void session_sync(Session *session);
+
+// Event loop side: push the event to the loop's subscribed sessions. They are
+// collected under the bucket lock and written to after it, since a failed
+// write may close a session, which takes the lock again.
+void deliver_seat_event(void *arg) {
+    SeatEvent *event = arg;
+    SubscriptionBucket *bucket = subscription_bucket(event->course_id);
+    Session **targets = NULL;
+    int count = 0, cap = 0;
+    pthread_mutex_lock(&bucket->lock);
+    for (Subscription *sub = bucket->head; sub; sub = sub->next) {
+        if (sub->session->loop != event->loop || strcmp(sub->course_id, event->course_id) != 0) continue;
+        if (count == cap) {
+            Session **grown = realloc(targets, (cap ? cap * 2 : 8) * sizeof(Session *));
+            if (!grown) break;
+            targets = grown;
+            cap = cap ? cap * 2 : 8;
+        }
+        targets[count++] = sub->session;
     }
+    pthread_mutex_unlock(&bucket->lock);
+
+    char text[128];
+    snprintf(text, sizeof(text), "Course %s now has %d of %d seats free\n", event->course_id, event->free_seats,
+             event->total_seats);
+    ProtoBuffer frame;
+    proto_buffer_init(&frame);
+    if (proto_begin(&frame, OP_SEAT_EVENT, PROTO_FLAG_RESPONSE | PROTO_FLAG_PUSH, 0) == 0 &&
+        proto_add_int(&frame, 0) == 0 && proto_add_str(&frame, text) == 0 &&
+        proto_add_str(&frame, event->course_id) == 0 && proto_add_int(&frame, event->free_seats) == 0 &&
+        proto_add_int(&frame, event->total_seats) == 0) {
+        proto_finish(&frame);
+        int pushed = 0;
+        for (int i = 0; i < count; i++) {
+            // A session that is logging out or closing gets no more frames
+            if (targets[i]->state != SESSION_BINARY && targets[i]->state != SESSION_BINARY_LOGIN) continue;
+            send_frame(targets[i], &frame, 0);
+            session_sync(targets[i]);
+            pushed++;
+        }
+        metrics_record_seat_pushes(pushed);
+    }
+    proto_buffer_free(&frame);
+    free(targets);
+    free(event);
 }
 
-void *client_handler(void *arg) {
-    int sock = *(int *)arg;
-    free(arg);
+// Seat listener (set_seat_listener), on a storage worker
+void notify_seat_change(const char *course_id, int free_seats, int total_seats) {
+    SubscriptionBucket *bucket = subscription_bucket(course_id);
+    EventLoop *loops[MAX_LISTENERS];
+    int count = 0;
+    pthread_mutex_lock(&bucket->lock);
+    for (Subscription *sub = bucket->head; sub; sub = sub->next) {
+        if (strcmp(sub->course_id, course_id) != 0) continue;
+        int known = 0;
+        for (int i = 0; i < count; i++) known |= loops[i] == sub->session->loop;
+        if (!known && count < MAX_LISTENERS) loops[count++] = sub->session->loop;
+    }
+    pthread_mutex_unlock(&bucket->lock);
+    if (count > 0) metrics_record_seat_event();
 
-    // Disable Nagle's algorithm for immediate data transmission
-    int flag = 1;
-    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
+    for (int i = 0; i < count; i++) {
+        SeatEvent *event = calloc(1, sizeof(SeatEvent));
+        if (!event) break;
+        event->loop = loops[i];
+        snprintf(event->course_id, sizeof(event->course_id), "%s", course_id);
+        event->free_seats = free_seats;
+        event->total_seats = total_seats;
+        event->task = (EventTask){.run = deliver_seat_event, .arg = event};
+        event_loop_post(loops[i], &event->task);
+    }
+}
 
-    // Send login screen with length prefix
-    const char *login_screen = "....................Welcome Back to Academia :: Course Registration....................\n"
-                               "Login Type\n"
-                               "Enter Your Choice { 1.Admin , 2.Professor, 3. Student } : ";
-    send_with_length(sock, login_screen);
-
-    // Receive login choice
-    char buffer[1024];
-    int bytes = read(sock, buffer, sizeof(buffer) - 1);
-    if (bytes <= 0) {
-        log_message("Server: Client disconnected while reading login choice, bytes=%d\n", bytes);
-        close(sock);
-        return NULL;
+// OP_SUBSCRIBE / OP_UNSUBSCRIBE: handled on the session's loop, no storage involved
+void binary_subscribe(Session *session, const ProtoMessage *msg) {
+    uint64_t start = metrics_now();
+    char course_id[MAX_ID];
+    int ret;
+    if (!op_allowed(session->role, msg->opcode) || proto_get_str(msg, 0, course_id, sizeof(course_id)) < 0 ||
+        validate_id(course_id) != 0) {
+        ret = ERR_INVALID_INPUT;
+    } else if (msg->opcode == OP_SUBSCRIBE) {
+        ret = subscribe_session(session, course_id);
+    } else {
+        ret = unsubscribe_session(session, course_id);
     }
-    buffer[bytes] = '\0';
-    int login_choice = atoi(buffer);
-    log_message("Server: Received login choice: %d\n", login_choice);
+    metrics_record_request(msg->opcode, ret, metrics_now() - start);
+    send_reply(session, msg->opcode, msg->request_id, ret, result_message(msg->opcode, ret));
+}
 
-    if (login_choice < 1 || login_choice > 3) {
-        send_with_length(sock, "Invalid choice\n");
-        close(sock);
-        return NULL;
+// Confirm a waiting logout once everything in flight has been answered
+void binary_logout_ready(Session *session) {
+    if (session->state != SESSION_LOGOUT || session->inflight > 0) return;
+    send_reply(session, OP_LOGOUT, session->logout_id, 0, "Logout successful\n");
+    session->state = SESSION_CLOSING;
+}
+
+// One frame of a binary session: requests are pipelined and answered as they complete
+void binary_request(Session *session, const ProtoMessage *msg) {
+    if (msg->opcode == OP_HELLO) {
+        binary_hello(session, msg);
+        return;
+    }
+    if (msg->opcode == OP_AUTHENTICATE) {
+        binary_login(session, msg);
+        return;
+    }
+    if (msg->opcode == OP_RESUME) {
+        binary_resume(session, msg);
+        return;
+    }
+    if (!session->logged_in) {
+        send_reply(session, msg->opcode, msg->request_id, ERR_INVALID_INPUT, "Not logged in\n");
+        return;
+    }
+    if (msg->opcode == OP_LOGOUT) {
+        session->logout_id = msg->request_id;
+        session->state = SESSION_LOGOUT;
+        binary_logout_ready(session);
+        return;
+    }
+    if (msg->opcode == OP_GET_MENU) {
+        send_reply(session, msg->opcode, msg->request_id, 0, command_menu(session->role));
+        return;
+    }
+    if (msg->opcode == OP_SUBSCRIBE || msg->opcode == OP_UNSUBSCRIBE) {
+        binary_subscribe(session, msg);
+        return;
     }
 
-    // Prompt for credentials
-    send_with_length(sock, "Enter User ID: ");
-    bytes = read(sock, buffer, sizeof(buffer) - 1);
-    if (bytes <= 0) {
-        log_message("Server: Client disconnected while reading user ID, bytes=%d\n", bytes);
-        close(sock);
-        return NULL;
+    StorageRequest *req = calloc(1, sizeof(StorageRequest));
+    if (!req || !op_allowed(session->role, msg->opcode)) {
+        free(req);
+        send_reply(session, msg->opcode, msg->request_id, ERR_INVALID_INPUT, "Invalid choice\n");
+        return;
     }
-    buffer[bytes] = '\0';
-    char user_id[MAX_ID];
-    strncpy(user_id, buffer, MAX_ID - 1);
-    user_id[MAX_ID - 1] = '\0';
-    log_message("Server: Received user ID: %s\n", user_id);
-
-    send_with_length(sock, "Enter Password: ");
-    bytes = read(sock, buffer, sizeof(buffer) - 1);
-    if (bytes <= 0) {
-        log_message("Server: Client disconnected while reading password, bytes=%d\n", bytes);
-        close(sock);
-        return NULL;
+    if (decode_request(msg, req) < 0) {
+        free(req);
+        send_reply(session, msg->opcode, msg->request_id, ERR_INVALID_INPUT, "Invalid input\n");
+        return;
     }
-    buffer[bytes] = '\0';
-    char password[MAX_PASS];
-    strncpy(password, buffer, MAX_PASS - 1);
-    password[MAX_PASS - 1] = '\0';
-    log_message("Server: Received password: %s\n", password);
+    req->op = msg->opcode;
+    snprintf(req->user_id, sizeof(req->user_id), "%s", session->user_id);
+    req->role = session->role;
+    req->request_id = msg->request_id;
+    req->terse = (msg->flags & PROTO_FLAG_TERSE) != 0;
+    req->deflate = session->deflate;
+    session_submit(session, req, complete_binary_request);
+}
 
-    // Authenticate user
-    int fd = open("users.dat", O_RDONLY);
-    if (fd < 0) {
-        send_with_length(sock, "Server error: Cannot open users file\n");
-        close(sock);
-        return NULL;
+void finish_interactive_login(Session *session, StorageRequest *req) {
+    if (req->ret == ERR_LOCK_TIMEOUT) {
+        send_with_length(&session->conn, "Server is busy, please try again\n");
+        session->state = SESSION_CLOSING;
+        return;
+    }
+    if (req->ret < 0) {
+        send_with_length(&session->conn, "Server error: Cannot open users file\n");
+        session->state = SESSION_CLOSING;
+        return;
     }
+    if (!req->ret) {
+        log_write(LOG_INFO, "Server: Login failed for user %s\n", req->id);
+        send_with_length(&session->conn, "Login failed\n");
+        session->state = SESSION_CLOSING;
+        return;
+    }
+    log_write(LOG_INFO, "Server: Login successful for user %s\n", req->id);
+    send_with_length(&session->conn, "Login successful\n");
+    session->logged_in = 1;
+    session->role = req->role;
+    snprintf(session->user_id, sizeof(session->user_id), "%s", req->id);
+    send_with_length(&session->conn, role_menu(session->role));
+    session->state = SESSION_MENU;
+}
 
-    sem_wait(&file_sem);
-    read_lock(fd);
+// Out of input in a state that reads: wait for more, or end the session if
+// none will come
+int wait_for_input(Session *session, const char *what) {
+    if (session->eof) {
+        if (what) log_write(LOG_INFO, "Server: Client disconnected while reading %s\n", what);
+        session->state = SESSION_CLOSING;
+    }
+    return 0;
+}
 
-    User user;
-    int authenticated = 0;
-    enum Role expected_role = (login_choice == 1) ? ADMIN : (login_choice == 2) ? FACULTY : STUDENT;
-    while (read(fd, &user, sizeof(User)) > 0) {
-        if (strcmp(user.id, user_id) == 0 && strcmp(user.password, password) == 0 && user.role == expected_role) {
-            authenticated = 1;
-            break;
+// The state machine. Each step returns 1 when the session can go on with
+// the input it has, 0 when it waits for the client or the storage workers.
+int step_login_choice(Session *session) {
+    size_t avail;
+    const char *data = framed_buffered(&session->conn, &avail);
+    if (avail == 0) return wait_for_input(session, "login choice");
+
+    // Binary clients send the protocol magic instead of a choice and wait for OP_HELLO
+    size_t prefix = avail < PROTO_MAGIC_LEN ? avail : PROTO_MAGIC_LEN;
+    if (memcmp(data, PROTO_MAGIC, prefix) == 0) {
+        if (prefix < PROTO_MAGIC_LEN) return session->eof ? wait_for_input(session, "login choice") : 0;
+        log_write(LOG_INFO, "Server: Client selected the binary protocol\n");
+        framed_consume(&session->conn, PROTO_MAGIC_LEN);
+        session->binary = 1;
+        session->state = SESSION_BINARY;
+        send_reply(session, OP_HELLO, 0, 0, "Academia binary protocol 1\n");
+        return 1;
+    }
+
+    // Interactive replies are corked and leave together with the next prompt
+    framed_cork(&session->conn);
+    int login_choice = take_choice(&session->conn);
+    log_write(LOG_INFO, "Server: Received login choice: %d\n", login_choice);
+    StorageRequest *req = NULL;
+    if (login_choice < 1 || login_choice > 3 || !(req = calloc(1, sizeof(StorageRequest)))) {
+        send_with_length(&session->conn, "Invalid choice\n");
+        session->state = SESSION_CLOSING;
+        return 0;
+    }
+    req->op = OP_AUTHENTICATE;
+    req->role = (login_choice == 1) ? ADMIN : (login_choice == 2) ? FACULTY : STUDENT;
+    session->req = req;
+
+    // Prompt for credentials
+    send_with_length(&session->conn, "Enter User ID: ");
+    session->state = SESSION_USER_ID;
+    return 1;
+}
+
+int step_user_id(Session *session) {
+    StorageRequest *req = session->req;
+    if (!framed_try_read_full(&session->conn, req->id, sizeof(req->id))) return wait_for_input(session, "user ID");
+    req->id[MAX_ID - 1] = '\0';
+    log_write(LOG_INFO, "Server: Received user ID: %s\n", req->id);
+    send_with_length(&session->conn, "Enter Password: ");
+    session->state = SESSION_PASSWORD;
+    return 1;
+}
+
+int step_password(Session *session) {
+    StorageRequest *req = session->req;
+    if (!framed_try_read_full(&session->conn, req->password, sizeof(req->password))) {
+        return wait_for_input(session, "password");
+    }
+    req->password[MAX_PASS - 1] = '\0';
+
+    // Authenticate user
+    session->req = NULL;
+    session->state = SESSION_STORAGE;
+    session_submit(session, req, complete_interactive_request);
+    return 0;
+}
+
+int step_menu(Session *session) {
+    size_t avail;
+    framed_buffered(&session->conn, &avail);
+    if (avail == 0) return wait_for_input(session, "choice");
+    int choice = take_choice(&session->conn);
+    log_sampled(LOG_INFO, "Server: Received %s menu choice: %d\n", role_label(session->role), choice);
+
+    const MenuChoice *entry = menu_choice(session->role, choice);
+    if (entry && entry->op == OP_LOGOUT) {
+        send_with_length(&session->conn, "Logout successful\n");
+        session->state = SESSION_CLOSING;
+        return 0;
+    }
+    StorageRequest *req = entry ? calloc(1, sizeof(StorageRequest)) : NULL;
+    if (!req) {
+        // Invalid choice: no request, just the message and the menu again
+        send_with_length(&session->conn, result_message(0, 0));
+        send_with_length(&session->conn, role_menu(session->role));
+        return 1;
+    }
+    req->op = entry->op;
+    snprintf(req->user_id, sizeof(req->user_id), "%s", session->user_id);
+    session->req = req;
+    session->fields = entry->fields;
+    session->state = SESSION_FIELDS;
+    return 1;
+}
+
+int step_fields(Session *session) {
+    StorageRequest *req = session->req;
+    while (*session->fields) {
+        size_t size;
+        void *slot = field_slot(req, *session->fields, &size);
+        if (!framed_try_read_full(&session->conn, slot, size)) return wait_for_input(session, NULL);
+        // A seat count outside the roster never reaches the storage workers
+        if (*session->fields == 's' && validate_seats(req->seats) != 0) {
+            send_with_length(&session->conn, result_message(req->op, ERR_INVALID_INPUT));
+            send_with_length(&session->conn, role_menu(session->role));
+            session->req = NULL;
+            session->state = SESSION_MENU;
+            free(req);
+            return 1;
         }
+        session->fields++;
     }
+    session->req = NULL;
+    session->state = SESSION_STORAGE;
+    session_submit(session, req, complete_interactive_request);
+    return 0;
+}
 
-    unlock(fd);
-    sem_post(&file_sem);
-    close(fd);
+int step_binary(Session *session) {
+    // Backpressure: the next frame waits for a free request slot and for the
+    // client to take its replies. Frames already buffered get no readiness
+    // event of their own, so the flush that makes room is tried from here.
+    if (session->inflight >= PROTO_MAX_INFLIGHT) return 0;
+    if (framed_pending(&session->conn) >= SESSION_OUTPUT_LIMIT) {
+        framed_flush(&session->conn);
+        if (framed_pending(&session->conn) >= SESSION_OUTPUT_LIMIT) return 0;
+    }
 
-    // Send authentication result
-    char auth_response[32];
-    snprintf(auth_response, sizeof(auth_response), authenticated ? "Login successful\n" : "Login failed\n");
-    log_message("Server: Raw bytes of message: ");
-    for (int i = 0; i < strlen(auth_response); i++) {
-        log_message("%02x ", (unsigned char)auth_response[i]);
+    char body[PROTO_MAX_REQUEST];
+    size_t len;
+    int got = framed_try_read_message(&session->conn, body, sizeof(body), &len);
+    if (got == 0) return wait_for_input(session, NULL);
+    if (got < 0 || len == 0) {
+        session->state = SESSION_CLOSING;
+        return 0;
     }
-    log_message("\n");
-    if (authenticated) {
-        log_message("Server: Login successful for user %s\n", user_id);
-    } else {
-        log_message("Server: Login failed for user %s\n", user_id);
-        send_with_length(sock, auth_response);
-        close(sock);
-        return NULL;
+    ProtoMessage msg;
+    if (proto_parse(body, len, &msg) < 0) {
+        log_write(LOG_WARN, "Server: Malformed frame, closing connection\n");
+        session->state = SESSION_CLOSING;
+        return 0;
+    }
+    binary_request(session, &msg);
+    return 1;
+}
+
+// Run the session over its buffered input until it has to wait
+void session_process(Session *session) {
+    int more = 1;
+    while (more) {
+        switch (session->state) {
+            case SESSION_LOGIN_CHOICE: more = step_login_choice(session); break;
+            case SESSION_USER_ID: more = step_user_id(session); break;
+            case SESSION_PASSWORD: more = step_password(session); break;
+            case SESSION_MENU: more = step_menu(session); break;
+            case SESSION_FIELDS: more = step_fields(session); break;
+            case SESSION_BINARY: more = step_binary(session); break;
+            default: more = 0; break;   // Waiting for the storage workers, or closing
+        }
     }
-    send_with_length(sock, auth_response);
+}
 
-    // Handle user based on role
-    switch (login_choice) {
-        case 1: handle_admin(sock, user_id); break;
-        case 2: handle_faculty(sock, user_id); break;
-        case 3: handle_student(sock, user_id); break;
+// Whether the session takes more input from the socket now
+int session_reading(Session *session) {
+    if (session->eof) return 0;
+    switch (session->state) {
+        case SESSION_STORAGE:
+        case SESSION_BINARY_LOGIN:
+        case SESSION_LOGOUT:
+        case SESSION_CLOSING:
+            return 0;
+        case SESSION_BINARY:
+            return session->inflight < PROTO_MAX_INFLIGHT && framed_pending(&session->conn) < SESSION_OUTPUT_LIMIT;
         default:
-            send_with_length(sock, "Invalid role\n");
-            break;
+            return 1;
     }
+}
 
-    close(sock);
-    return NULL;
+void session_close(Session *session) {
+    unsubscribe_all(session);
+    event_loop_watch(session->loop, &session->watch, 0);
+    close(session->watch.fd);
+    framed_free(&session->conn);
+    free(session->req);
+    free(session);
+    metrics_session_closed();
+    atomic_fetch_sub(&live_sessions, 1);
 }
 
-int main() {
-    // Initialize log file
-    log_file = fopen("server.log", "a");
-    if (!log_file) {
-        perror("Failed to open server.log");
-        exit(1);
+// Flush what the session owes its client, then watch for what it can handle
+// next; a session that is done is closed
+void session_sync(Session *session) {
+    if (framed_flush(&session->conn) < 0) {
+        log_write(LOG_ERROR, "Server: Failed to send message, errno=%d\n", errno);
+        session->eof = 1;
+        if (session->state != SESSION_STORAGE && session->state != SESSION_BINARY_LOGIN) {
+            session->state = SESSION_CLOSING;
+        }
+    }
+    if (session->state == SESSION_CLOSING && session->inflight == 0 && framed_pending(&session->conn) == 0) {
+        session_close(session);
+        return;
     }
+    framed_release_buffers(&session->conn);
+    uint32_t events = session_reading(session) ? EPOLLIN : 0;
+    if (framed_pending(&session->conn) > 0) events |= EPOLLOUT;
+    event_loop_watch(session->loop, &session->watch, events);
+}
 
-    // Initialize semaphore
-    if (sem_init(&file_sem, 0, 1) < 0) {
-        perror("Semaphore initialization failed");
-        fclose(log_file);
-        exit(1);
+// Readiness of a session's socket
+void session_event(EventWatch *watch, uint32_t events) {
+    Session *session = watch->context;
+    if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && session_reading(session)) {
+        ssize_t n = framed_fill(&session->conn);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) session->eof = 1;
     }
+    session_process(session);
+    session_sync(session);
+}
 
-    // Perform initial setup
-    initial_setup();
+// A request is back from the storage workers: send the reply and go on with
+// whatever input arrived in the meantime
+void binary_request_returned(Session *session, StorageRequest *req) {
+    if (req->op == OP_AUTHENTICATE) {
+        finish_binary_login(session, req);
+    } else if (req->listing_fd >= 0) {
+        size_t head_len = req->reply_len - req->reply_tail;
+        if (framed_send_file(&session->conn, req->reply, head_len, req->listing_fd, LISTING_TEXT_OFFSET,
+                             req->listing_len) < 0 ||
+            framed_send(&session->conn, req->reply + head_len, req->reply_tail, req->batched) < 0) {
+            log_write(LOG_ERROR, "Server: Failed to send listing, errno=%d\n", errno);
+        }
+    } else if (req->reply) {
+        if (framed_send(&session->conn, req->reply, req->reply_len, req->batched) < 0) {
+            log_write(LOG_ERROR, "Server: Failed to send frame, errno=%d\n", errno);
+        }
+    }
+    binary_logout_ready(session);
+}
 
-    // Ignore SIGPIPE
-    ignore_sigpipe();
+void interactive_request_returned(Session *session, StorageRequest *req) {
+    if (req->op == OP_AUTHENTICATE) {
+        finish_interactive_login(session, req);
+        return;
+    }
+    if (req->listing_fd >= 0) {
+        // The listing file is already framed; it goes out ahead of the corked menu
+        if (framed_send_file(&session->conn, NULL, 0, req->listing_fd, 0, LISTING_TEXT_OFFSET + req->listing_len) < 0) {
+            log_write(LOG_ERROR, "Server: Failed to send listing, errno=%d\n", errno);
+        }
+    } else {
+        send_with_length(&session->conn, req->reply ? req->reply : result_message(req->op, -1));
+    }
+    send_with_length(&session->conn, role_menu(session->role));
+    session->state = SESSION_MENU;
+}
+
+void session_request_returned(void *arg) {
+    StorageRequest *req = arg;
+    Session *session = req->context;
+    session->inflight--;
+    if (session->binary) {
+        binary_request_returned(session, req);
+    } else {
+        interactive_request_returned(session, req);
+    }
+    int batched = req->batched;
+    if (req->listing_fd >= 0) close(req->listing_fd);
+    free(req->reply);
+    free(req);
+    // The next completion for this session follows right behind and flushes both
+    if (batched) return;
+    session_process(session);
+    session_sync(session);
+}
 
+// Start a session on a connection accepted by this acceptor
+void session_open(Acceptor *acceptor, int sock) {
+    Session *session = calloc(1, sizeof(Session));
+    if (!session) {
+        close(sock);
+        return;
+    }
+    session->watch = (EventWatch){.fd = sock, .handler = session_event, .context = session};
+    session->loop = &acceptor->loop;
+    session->queue = acceptor->queue;
+    framed_init_nonblocking(&session->conn, sock);
+    session->state = SESSION_LOGIN_CHOICE;
+    atomic_fetch_add(&live_sessions, 1);
+    metrics_session_opened();
+
+    // Send login screen with length prefix
+    send_with_length(&session->conn, login_menu());
+    session_sync(session);
+}
+
+// Listening socket on PORT that other acceptors (and processes) can share
+int open_listener(void) {
     int server_sock = socket(AF_INET, SOCK_STREAM, 0);
     if (server_sock < 0) {
         perror("Socket creation failed");
-        fclose(log_file);
-        exit(1);
+        return -1;
     }
 
     struct sockaddr_in server_addr;
@@ -467,46 +1401,561 @@ int main() {
 
     int opt = 1;
     setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (setsockopt(server_sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("SO_REUSEPORT failed");
+        close(server_sock);
+        return -1;
+    }
 
     if (bind(server_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         perror("Bind failed");
         close(server_sock);
-        fclose(log_file);
-        exit(1);
+        return -1;
+    }
+
+    if (listen(server_sock, LISTEN_BACKLOG) < 0) {
+        perror("Listen failed");
+        close(server_sock);
+        return -1;
+    }
+    return server_sock;
+}
+
+// Listening socket on a Unix domain path, for clients on the same host. A
+// stale socket file is replaced, but not one a running server accepts on.
+int open_unix_listener(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Unix socket path too long: %s\n", path);
+        return -1;
     }
+    strcpy(addr.sun_path, path);
 
-    if (listen(server_sock, 5) < 0) {
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    int in_use = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    if (probe >= 0) close(probe);
+    if (in_use) {
+        fprintf(stderr, "A server is already listening on %s (use --takeover)\n", path);
+        return -1;
+    }
+
+    int server_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server_sock < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    unlink(path);
+    if (bind(server_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Bind failed");
+        close(server_sock);
+        return -1;
+    }
+    if (listen(server_sock, LISTEN_BACKLOG) < 0) {
         perror("Listen failed");
         close(server_sock);
-        fclose(log_file);
+        return -1;
+    }
+    return server_sock;
+}
+
+// Move an inherited Unix domain listener from fds to *unix_fd; returns how
+// many (TCP) sockets are left in fds
+int take_unix_listener(int *fds, int count, int *unix_fd) {
+    int tcp = 0;
+    for (int i = 0; i < count; i++) {
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        if (getsockname(fds[i], (struct sockaddr *)&addr, &len) == 0 && addr.ss_family == AF_UNIX) {
+            *unix_fd = fds[i];
+        } else {
+            fds[tcp++] = fds[i];
+        }
+    }
+    return tcp;
+}
+
+// Readiness of a listening socket: a session for each new connection
+void acceptor_event(EventWatch *watch, uint32_t events) {
+    Acceptor *acceptor = watch->context;
+    (void)events;
+    for (int i = 0; i < ACCEPT_BATCH; i++) {
+        int client_sock = accept4(acceptor->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (client_sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("Accept failed");
+            return;
+        }
+
+        // Disable Nagle's algorithm for immediate data transmission
+        if (!acceptor->local) {
+            int flag = 1;
+            setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
+        }
+        session_open(acceptor, client_sock);
+    }
+}
+
+// Set up an acceptor's loop with its listening socket. The socket is made
+// nonblocking: with SO_REUSEPORT siblings and a successor sharing it, a
+// readiness event does not guarantee this loop gets the connection.
+int acceptor_init(Acceptor *acceptor) {
+    if (event_loop_init(&acceptor->loop) < 0) return -1;
+    fcntl(acceptor->listen_fd, F_SETFL, fcntl(acceptor->listen_fd, F_GETFL) | O_NONBLOCK);
+    acceptor->listen_watch = (EventWatch){.fd = acceptor->listen_fd, .handler = acceptor_event, .context = acceptor};
+    sem_init(&acceptor->stopped, 0, 0);
+    return event_loop_watch(&acceptor->loop, &acceptor->listen_watch, EPOLLIN);
+}
+
+// Acceptor thread: run the loop of its listening socket and its sessions
+void *acceptor_main(void *arg) {
+    Acceptor *acceptor = arg;
+    event_loop_run(&acceptor->loop);
+    return NULL;
+}
+
+// Start a server thread on cpu (-1: anywhere). A CPU the process may not use
+// is reported and the thread left to the scheduler.
+int start_thread(pthread_t *thread, int cpu, const char *kind, int index, void *(*start)(void *), void *arg) {
+    if (cpu >= 0) {
+        if (cpu_thread_create(thread, cpu, start, arg) == 0) return 0;
+        log_write(LOG_WARN, "Server: Could not pin %s %d to CPU %d\n", kind, index, cpu);
+    }
+    return pthread_create(thread, NULL, start, arg);
+}
+
+// Set up a request queue; run from a CPU of the node whose workers drain it
+void *init_request_queue(void *arg) {
+    return class_queue_init(arg, class_weights, REQUEST_CLASSES, REQUEST_QUEUE_SIZE) == 0 ? arg : NULL;
+}
+
+// Loop side of stop_acceptors(). The socket leaves the epoll set before it
+// is closed: the successor's copy keeps it open, so closing alone would not
+// remove it.
+void acceptor_stop(void *arg) {
+    Acceptor *acceptor = arg;
+    event_loop_watch(&acceptor->loop, &acceptor->listen_watch, 0);
+    close(acceptor->listen_fd);
+    sem_post(&acceptor->stopped);
+}
+
+// Stop accepting on every listening socket; the sessions go on running on
+// the acceptors' loops. The sockets stay open in the successor, so
+// connections still queued on them are not lost.
+void stop_acceptors(Acceptor *acceptors, int count) {
+    for (int i = 0; i < count; i++) {
+        acceptors[i].stop_task = (EventTask){.run = acceptor_stop, .arg = &acceptors[i]};
+        event_loop_post(&acceptors[i].loop, &acceptors[i].stop_task);
+    }
+    for (int i = 0; i < count; i++) {
+        while (sem_wait(&acceptors[i].stopped) < 0 && errno == EINTR);
+    }
+}
+
+// Loop side of stop_submissions(): whatever the loop runs after this sees
+// submissions closed, and no push of its own is still under way
+void acceptor_quiesce(void *arg) {
+    Acceptor *acceptor = arg;
+    sem_post(&acceptor->stopped);
+}
+
+// Make every later submit_request_async() fail, and wait until no session
+// still running on the acceptors' loops can be inside one, so the request
+// queues can be closed (work_queue_close() wants the producers stopped)
+void stop_submissions(Acceptor *acceptors, int count) {
+    atomic_store(&submissions_closed, 1);
+    for (int i = 0; i < count; i++) {
+        acceptors[i].stop_task = (EventTask){.run = acceptor_quiesce, .arg = &acceptors[i]};
+        event_loop_post(&acceptors[i].loop, &acceptors[i].stop_task);
+    }
+    for (int i = 0; i < count; i++) {
+        while (sem_wait(&acceptors[i].stopped) < 0 && errno == EINTR);
+    }
+}
+
+// Wait up to timeout seconds for the open sessions to end. Binary clients
+// still connected after that reconnect and resume on the successor.
+void drain_sessions(int timeout) {
+    for (int waited = 0; atomic_load(&live_sessions) > 0 && waited < timeout * 10; waited++) {
+        usleep(100 * 1000);
+    }
+    int left = atomic_load(&live_sessions);
+    if (left > 0) log_write(LOG_WARN, "Server: Closing %d sessions still open after %d s\n", left, timeout);
+}
+
+// Run read-only scans of every data file on the storage workers, so the
+// files are in the page cache and each worker has set up its I/O ring and
+// buffer before the first client is accepted
+static sem_t warm_done;
+
+void warm_request_done(StorageRequest *req) {
+    if (req->listing_fd >= 0) close(req->listing_fd);
+    sem_post(&warm_done);
+}
+
+void warm_caches(void) {
+    static const enum Opcode scans[] = {OP_VIEW_ALL_COURSES, OP_VIEW_ALL_STUDENTS, OP_VIEW_ALL_FACULTY};
+    enum { SCAN_COUNT = sizeof(scans) / sizeof(scans[0]) };
+    StorageRequest reqs[STORAGE_WORKERS * SCAN_COUNT];
+    int submitted = 0;
+    uint64_t start = metrics_now();
+
+    sem_init(&warm_done, 0, 0);
+    for (int i = 0; i < STORAGE_WORKERS * SCAN_COUNT; i++) {
+        reqs[i] = (StorageRequest){.op = scans[i % SCAN_COUNT], .request_class = CLASS_MAINTENANCE,
+                                   .on_complete = warm_request_done};
+        if (submit_request_async(&request_queues[i % request_queue_count], &reqs[i]) == 0) submitted++;
+    }
+    for (int i = 0; i < submitted; i++) {
+        while (sem_wait(&warm_done) < 0 && errno == EINTR);
+    }
+    sem_destroy(&warm_done);
+    log_write(LOG_INFO, "Server: Warmed caches in %llu us\n", (unsigned long long)(metrics_now() - start) / 1000);
+}
+
+// Token revocations (password changes, blocked students) made while this
+// process hands over. The successor loaded the token state when it was
+// saved, and the sessions still draining here can revoke after that, so
+// each later revocation is forwarded to it: journaled until it has taken
+// over, then sent straight away.
+static pthread_mutex_t forward_lock = PTHREAD_MUTEX_INITIALIZER;
+static int forward_conn = -1;       // The successor's handoff connection
+static int forward_journaling;      // Token state saved for a successor that has not taken over yet
+static char (*forward_journal)[MAX_ID];
+static int forward_journal_len, forward_journal_cap;
+
+void forward_revocation(const char *user_id) {
+    pthread_mutex_lock(&forward_lock);
+    if (forward_conn >= 0) {
+        if (handoff_send_update(forward_conn, user_id, strlen(user_id)) < 0) {
+            log_write(LOG_WARN, "Server: Could not forward the token revocation of %s\n", user_id);
+        }
+    } else if (forward_journaling) {
+        if (forward_journal_len == forward_journal_cap) {
+            int cap = forward_journal_cap ? forward_journal_cap * 2 : 64;
+            char (*journal)[MAX_ID] = realloc(forward_journal, cap * sizeof(*journal));
+            if (journal) {
+                forward_journal = journal;
+                forward_journal_cap = cap;
+            }
+        }
+        if (forward_journal_len < forward_journal_cap) {
+            snprintf(forward_journal[forward_journal_len++], MAX_ID, "%s", user_id);
+        } else {
+            log_write(LOG_WARN, "Server: Could not journal the token revocation of %s\n", user_id);
+        }
+    }
+    pthread_mutex_unlock(&forward_lock);
+}
+
+// handoff_serve() state: the token state, as of now
+void *save_handoff_state(size_t *len) {
+    pthread_mutex_lock(&forward_lock);
+    forward_journaling = 1;
+    forward_journal_len = 0;
+    pthread_mutex_unlock(&forward_lock);
+    return session_tokens_save(len);
+}
+
+// The successor took over (conn >= 0) or none will (-1): send it what it
+// missed and forward from now on, or drop the journal
+void start_forwarding(int conn) {
+    pthread_mutex_lock(&forward_lock);
+    forward_conn = conn;
+    for (int i = 0; conn >= 0 && i < forward_journal_len; i++) {
+        handoff_send_update(conn, forward_journal[i], strlen(forward_journal[i]));
+    }
+    forward_journaling = 0;
+    free(forward_journal);
+    forward_journal = NULL;
+    forward_journal_len = forward_journal_cap = 0;
+    pthread_mutex_unlock(&forward_lock);
+}
+
+// Successor side: a revocation the predecessor made after saving its state
+void apply_forwarded_revocation(const void *data, size_t len) {
+    char user_id[MAX_ID];
+    if (len == 0 || len >= MAX_ID) return;
+    memcpy(user_id, data, len);
+    user_id[len] = '\0';
+    session_token_revoke(user_id);
+    log_write(LOG_INFO, "Server: Revoked the session tokens of %s on behalf of the previous server\n", user_id);
+}
+
+// The predecessor of a takeover may still change the data files while it
+// drains; cached renderings and catalog versions are only trusted again
+// once it has exited. Its token revocations are applied as they come.
+void *watch_predecessor(void *arg) {
+    handoff_wait_exit((int)(intptr_t)arg, apply_forwarded_revocation);
+    catalog_set_shared(0);
+    listing_cache_set_enabled(1);
+    log_write(LOG_INFO, "Server: Previous server exited, response caches enabled\n");
+    return NULL;
+}
+
+// --class-weights: three weights of at least 1, in RequestClass order
+int parse_class_weights(const char *arg) {
+    int weights[REQUEST_CLASSES];
+    char extra;
+    if (sscanf(arg, "%d,%d,%d%c", &weights[0], &weights[1], &weights[2], &extra) != REQUEST_CLASSES) return -1;
+    int total = 0;
+    for (int c = 0; c < REQUEST_CLASSES; c++) {
+        if (weights[c] < 1) return -1;
+        total += weights[c];
+    }
+    if (total > CLASS_QUEUE_MAX_ROUND) return -1;
+    memcpy(class_weights, weights, sizeof(weights));
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *io_backend = NULL;
+    int log_level = LOG_INFO;
+    int log_sample = 1;
+    int metrics_interval = METRICS_DUMP_INTERVAL;
+    int acceptor_count = DEFAULT_ACCEPTORS;
+    // --pin-acceptors alone spreads the acceptors over every CPU the process may use
+    cpu_set_t acceptor_cpus, worker_cpus;
+    int pin_acceptors = 0, pin_workers = 0;
+    CPU_ZERO(&acceptor_cpus);
+    sched_getaffinity(0, sizeof(acceptor_cpus), &acceptor_cpus);
+    int takeover = 0;
+    int drain_timeout = DEFAULT_DRAIN_TIMEOUT;
+    const char *unix_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            io_backend = argv[++i];
+        } else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc && (log_level = logger_parse_level(argv[i + 1])) >= 0) {
+            i++;
+        } else if (strcmp(argv[i], "--log-sample") == 0 && i + 1 < argc && (log_sample = atoi(argv[i + 1])) > 0) {
+            i++;
+        } else if (strcmp(argv[i], "--acceptors") == 0 && i + 1 < argc && (acceptor_count = atoi(argv[i + 1])) > 0 &&
+                   acceptor_count <= MAX_ACCEPTORS) {
+            i++;
+        } else if (strcmp(argv[i], "--pin-acceptors") == 0) {
+            pin_acceptors = 1;
+        } else if (strcmp(argv[i], "--acceptor-cpus") == 0 && i + 1 < argc && cpu_list_parse(argv[i + 1], &acceptor_cpus) == 0) {
+            pin_acceptors = 1;
+            i++;
+        } else if (strcmp(argv[i], "--worker-cpus") == 0 && i + 1 < argc && cpu_list_parse(argv[i + 1], &worker_cpus) == 0) {
+            pin_workers = 1;
+            i++;
+        } else if (strcmp(argv[i], "--takeover") == 0) {
+            takeover = 1;
+        } else if (strcmp(argv[i], "--drain-timeout") == 0 && i + 1 < argc && (drain_timeout = atoi(argv[i + 1])) >= 0) {
+            i++;
+        } else if (strcmp(argv[i], "--compress-threshold") == 0 && i + 1 < argc &&
+                   (compress_threshold = atoi(argv[i + 1])) >= 0) {
+            i++;
+        } else if (strcmp(argv[i], "--no-compress") == 0) {
+            compress_threshold = -1;
+        } else if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc) {
+            unix_path = argv[++i];
+        } else if (strcmp(argv[i], "--class-weights") == 0 && i + 1 < argc && parse_class_weights(argv[i + 1]) == 0) {
+            i++;
+        } else if (strcmp(argv[i], "--lock-timeout") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 0) {
+            set_lock_timeout(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--metrics-interval") == 0 && i + 1 < argc && (metrics_interval = atoi(argv[i + 1])) >= 0) {
+            i++;
+        } else {
+            fprintf(stderr, "Usage: %s [--io uring|blocking] [--log-level debug|info|warn|error] [--log-sample N] [--metrics-interval SECONDS]\n"
+                            "       [--acceptors N] [--pin-acceptors] [--acceptor-cpus LIST] [--worker-cpus LIST]\n"
+                            "       [--class-weights INTERACTIVE,BULK,MAINTENANCE] [--lock-timeout MS] [--takeover] [--drain-timeout SECONDS]\n"
+                            "       [--compress-threshold BYTES] [--no-compress] [--unix PATH]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    // Initialize log file and its flusher thread
+    if (logger_init("server.log", log_level) < 0) {
+        perror("Failed to open server.log");
         exit(1);
     }
+    logger_set_sampling(log_sample);
+
+    // Initialize semaphore
+    if (sem_init(&file_sem, 0, 1) < 0) {
+        perror("Semaphore initialization failed");
+        logger_shutdown();
+        exit(1);
+    }
+
+    // Select the I/O backend before any thread touches the data files
+    if (io_backend_init(io_backend) < 0) {
+        fprintf(stderr, "Unknown I/O backend: %s\n", io_backend);
+        logger_shutdown();
+        exit(1);
+    }
+    log_write(LOG_INFO, "Server: Using %s I/O backend\n", io_backend_name());
+
+    // Key for signing session tokens
+    if (session_tokens_init() < 0) {
+        perror("Session token key generation failed");
+        logger_shutdown();
+        exit(1);
+    }
+
+    // Perform initial setup
+    initial_setup();
+
+    // Periodic Prometheus-style dump next to server.log (0 disables it)
+    if (metrics_interval > 0 && metrics_start_dump("server_metrics.prom", metrics_interval) < 0) {
+        log_write(LOG_WARN, "Server: Could not start the metrics dump thread\n");
+    }
+
+    // Start the storage workers that execute file operations. With
+    // --worker-cpus, worker i runs on the i-th CPU of the list, and each NUMA
+    // node the workers span gets a request queue set up from one of its CPUs
+    int node_queue[CPU_MAX_NODES];   // Queue of each node's workers, -1 for none
+    for (int i = 0; i < CPU_MAX_NODES; i++) node_queue[i] = -1;
+    int worker_cpu[STORAGE_WORKERS];
+    ClassQueue *worker_queue[STORAGE_WORKERS];
+    for (int i = 0; i < STORAGE_WORKERS; i++) {
+        worker_cpu[i] = pin_workers ? cpu_nth(&worker_cpus, i) : -1;
+        int node = worker_cpu[i] >= 0 ? cpu_node(worker_cpu[i]) : 0;
+        if (node_queue[node] < 0) {
+            ClassQueue *queue = &request_queues[request_queue_count];
+            void *ready = NULL;
+            if (cpu_run_on(worker_cpu[i], init_request_queue, queue, &ready) != 0) {
+                ready = init_request_queue(queue);
+            }
+            if (!ready) {
+                perror("Request queue initialization failed");
+                logger_shutdown();
+                exit(1);
+            }
+            node_queue[node] = request_queue_count++;
+        }
+        worker_queue[i] = &request_queues[node_queue[node]];
+    }
+    for (int i = 0; i < ENROLL_GROUPS; i++) pthread_mutex_init(&enroll_groups[i].lock, NULL);
+    for (int i = 0; i < SUBSCRIPTION_BUCKETS; i++) pthread_mutex_init(&subscriptions[i].lock, NULL);
+    set_seat_listener(notify_seat_change);
+    session_token_set_revoke_listener(forward_revocation);
+    pthread_t workers[STORAGE_WORKERS];
+    for (int i = 0; i < STORAGE_WORKERS; i++) {
+        if (start_thread(&workers[i], worker_cpu[i], "storage worker", i, storage_worker, worker_queue[i]) != 0) {
+            perror("Storage worker creation failed");
+            logger_shutdown();
+            exit(1);
+        }
+    }
+    if (pin_workers) {
+        log_write(LOG_INFO, "Server: %d storage workers placed on %d NUMA node(s)\n", STORAGE_WORKERS, request_queue_count);
+    }
+
+    // Ignore SIGPIPE
+    ignore_sigpipe();
+
+    warm_caches();
+
+    // With --takeover, adopt the running server's listening sockets and token state
+    int inherited[HANDOFF_MAX_FDS];
+    int inherited_count = 0;
+    int inherited_unix = -1;
+    int handoff_conn = -1;
+    if (takeover) {
+        void *state;
+        size_t state_len;
+        handoff_conn = handoff_connect(HANDOFF_SOCKET, inherited, &inherited_count, &state, &state_len);
+        if (handoff_conn >= 0) {
+            if (session_tokens_load(state, state_len) < 0) {
+                log_write(LOG_WARN, "Server: Ignoring malformed session token state\n");
+            }
+            free(state);
+            catalog_set_shared(1);
+            listing_cache_set_enabled(0);
+            inherited_count = take_unix_listener(inherited, inherited_count, &inherited_unix);
+            if (inherited_count > MAX_ACCEPTORS) inherited_count = MAX_ACCEPTORS;
+            if (inherited_count > acceptor_count) acceptor_count = inherited_count;
+        } else if (errno == ENOENT || errno == ECONNREFUSED) {
+            log_write(LOG_WARN, "Server: No running server to take over, listening afresh\n");
+        } else {
+            perror("Takeover failed");
+            logger_shutdown();
+            exit(1);
+        }
+    }
+
+    // One listening socket and acceptor thread each, plus one for the Unix
+    // domain socket (kept across a takeover even without --unix). Sessions
+    // run on the loop of the acceptor that took them. A pinned acceptor runs
+    // on the i-th CPU of its list and submits to the workers of its node if
+    // there are any; the others take the queues in turn
+    Acceptor acceptors[MAX_LISTENERS];
+    int tcp_count = acceptor_count;
+    if (inherited_unix >= 0 || unix_path) acceptor_count++;
+    for (int i = 0; i < acceptor_count; i++) {
+        acceptors[i].index = i;
+        acceptors[i].cpu = pin_acceptors ? cpu_nth(&acceptor_cpus, i) : -1;
+        int queue = acceptors[i].cpu >= 0 ? node_queue[cpu_node(acceptors[i].cpu)] : -1;
+        acceptors[i].queue = &request_queues[queue >= 0 ? queue : i % request_queue_count];
+        acceptors[i].local = i == tcp_count;
+        if (i < tcp_count) {
+            acceptors[i].listen_fd = i < inherited_count ? inherited[i] : open_listener();
+        } else {
+            acceptors[i].listen_fd = inherited_unix >= 0 ? inherited_unix : open_unix_listener(unix_path);
+        }
+        if (acceptors[i].listen_fd < 0) {
+            logger_shutdown();
+            exit(1);
+        }
+        if (acceptor_init(&acceptors[i]) < 0) {
+            perror("Event loop creation failed");
+            logger_shutdown();
+            exit(1);
+        }
+    }
 
     // Print to terminal (not redirected to log file)
-    printf("Server listening on port %d...\n", PORT);
+    printf("Server %s port %d (%s I/O, %d acceptors)...\n", handoff_conn >= 0 ? "took over" : "listening on", PORT,
+           io_backend_name(), tcp_count);
+    if (acceptor_count > tcp_count) {
+        printf("Server also accepting on Unix socket %s\n", unix_path ? unix_path : "inherited from the previous server");
+    }
 
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        int *client_sock = malloc(sizeof(int));
-        *client_sock = accept(server_sock, (struct sockaddr *)&client_addr, &client_len);
-        if (*client_sock < 0) {
-            perror("Accept failed");
-            free(client_sock);
-            continue;
+    for (int i = 0; i < acceptor_count; i++) {
+        if (start_thread(&acceptors[i].thread, acceptors[i].cpu, "acceptor", i, acceptor_main, &acceptors[i]) != 0) {
+            perror("Acceptor creation failed");
+            logger_shutdown();
+            exit(1);
         }
+    }
+    if (handoff_conn >= 0) {
+        handoff_complete(handoff_conn);
+        log_write(LOG_INFO, "Server: Took over %d listening sockets%s\n", inherited_count,
+                  inherited_unix >= 0 ? " and the Unix socket" : "");
+        pthread_t watcher;
+        if (pthread_create(&watcher, NULL, watch_predecessor, (void *)(intptr_t)handoff_conn) == 0) {
+            pthread_detach(watcher);
+        }
+    }
 
-        pthread_t thread;
-        if (pthread_create(&thread, NULL, client_handler, client_sock) != 0) {
-            perror("Thread creation failed");
-            close(*client_sock);
-            free(client_sock);
+    // Wait for a successor; without a handoff socket, serve until the acceptors fail
+    int handoff_fd = handoff_listen(HANDOFF_SOCKET);
+    if (handoff_fd < 0) log_write(LOG_WARN, "Server: No handoff socket, restarts will drop connections\n");
+    int fds[MAX_LISTENERS];
+    for (int i = 0; i < acceptor_count; i++) fds[i] = acceptors[i].listen_fd;
+    int successor = handoff_fd >= 0 ? handoff_serve(handoff_fd, fds, acceptor_count, save_handoff_state) : -1;
+    start_forwarding(successor);
+    if (successor >= 0) {
+        close(handoff_fd);
+        stop_acceptors(acceptors, acceptor_count);
+        log_write(LOG_INFO, "Server: Stopped accepting, draining %d sessions\n", atomic_load(&live_sessions));
+        drain_sessions(drain_timeout);
+        // Sessions left over still run; their requests fail from here on
+        stop_submissions(acceptors, acceptor_count);
+    } else {
+        for (int i = 0; i < acceptor_count; i++) {
+            pthread_join(acceptors[i].thread, NULL);
+            close(acceptors[i].listen_fd);
         }
-        pthread_detach(thread);
     }
 
-    close(server_sock);
+    // Let the workers finish every queued request before exiting
+    for (int i = 0; i < request_queue_count; i++) class_queue_close(&request_queues[i]);
+    for (int i = 0; i < STORAGE_WORKERS; i++) pthread_join(workers[i], NULL);
+    if (successor >= 0) close(successor);
     sem_destroy(&file_sem);
-    fclose(log_file);
+    logger_shutdown();
     return 0;
 }